@@ -1,26 +1,44 @@
-#include "vertex.h"
+#include <vector>
 #include "vectors.h"
-#include "edge.h"
+#include "quadric.h"
 class Pair {
 public:
-	Pair(Vertex* a, Vertex* b,Edge *ee) :p1(a), p2(b),e(ee),distance(0) {}
-    Vertex* getP1(){return p1;}
-    Vertex* getP2(){return p2;}
-    Edge* getEdge(){return e;};
-    void computeDistance(double MaxDis);
-    double  getDistance(){return distance;};
-    Vec3f getResult(){return result;};
+	Pair(int a, int b,int ee,int version_a,int version_b) :p1(a), p2(b),distance(0),e(ee),
+        version1(version_a),version2(version_b) {}
+    int getP1() const {return p1;}
+    int getP2() const {return p2;}
+    int getEdge() const {return e;};
+    /// @brief 计算折叠代价和折叠后的位置
+    /// @param Q 两个端点Q之和
+    /// @param pos1 p1的位置
+    /// @param pos2 p2的位置
+    void computeDistance(const Quadric &Q, const Vec3f &pos1, const Vec3f &pos2, double MaxDis);
+    double  getDistance() const {return distance;};
+    const Vec3f& getResult() const {return result;};
     void setDistance(double dis){
         distance=dis;
     }
     void setResult(Vec3f v){
         result=v;
     }
+    /// @brief 两个端点在入堆之后都没有被修改过，点对才有效
+    /// @param versions 每个顶点当前的版本号
+    bool isValid(const std::vector<int> &versions) const {
+        return versions[p1] == version1 && versions[p2] == version2;
+    }
 
 private:
-    Vertex* p1;
-	Vertex* p2;
+    int p1;
+	int p2;
 	double distance;
 	Vec3f result;
-	Edge* e;
-};
\ No newline at end of file
+	int e;
+    //入堆时两个端点的版本号
+    int version1;
+    int version2;
+};
+
+/// @brief 堆的比较函数，distance小的在堆顶
+struct PairGreater {
+    bool operator()(const Pair &a, const Pair &b) const { return a.getDistance() > b.getDistance(); }
+};
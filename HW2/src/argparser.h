@@ -2,9 +2,25 @@
 #define __ARG_PARSER_H__
 
 #include <string>
+#include <vector>
 #include <cassert>
+#include <cstdlib>
 #include "MersenneTwister.h"
 
+// ====================================================================================
+// one step of the headless pipeline (see batch.cpp), in command line order:
+//   -subdivide loop:2        2 levels of Loop (or butterfly) subdivision
+//   -simplify qem:10000      QEM (or parallel_qem, random) down to 10000 triangles
+//   -simplify qem:25%        ... down to 25% of the triangles it has at that point
+//   -simplify cluster:256    out-of-core vertex clustering on a grid 256 cells
+//                            wide (only as the first step, see clustersimplify.h)
+
+struct MeshOperation {
+  std::string method;
+  int amount;
+  bool percent;
+};
+
 // ====================================================================================
 
 class ArgParser {
@@ -17,8 +33,10 @@ public:
     DefaultValues();
     for (int i = 1; i < argc; i++) {
       if (argv[i] == std::string("-input")) {
+        // may be given more than once, or be a directory (batch mode)
         i++; assert (i < argc); 
-        input_file = argv[i];
+        if (input_file == "") input_file = argv[i];
+        input_files.push_back(argv[i]);
       } else if (argv[i] == std::string("-size")) {
         i++; assert (i < argc); 
         width = height = atoi(argv[i]);
@@ -26,6 +44,48 @@ public:
         wireframe = true;
       } else if (argv[i] == std::string("-gouraud")) {
         gouraud = true;
+      } else if (argv[i] == std::string("-no_cache")) {
+        use_cache = false;
+      } else if (argv[i] == std::string("-benchmark_load")) {
+        benchmark_load = true;
+      } else if (argv[i] == std::string("-stream_subdivision")) {
+        i++; assert (i < argc); 
+        stream_levels = atoi(argv[i]);
+        i++; assert (i < argc); 
+        stream_output = argv[i];
+      } else if (argv[i] == std::string("-butterfly")) {
+        butterfly = true;
+      } else if (argv[i] == std::string("-progressive")) {
+        progressive = true;
+      } else if (argv[i] == std::string("-parallel_qem")) {
+        parallel_qem = true;
+      } else if (argv[i] == std::string("-qem_tolerance")) {
+        i++; assert (i < argc);
+        qem_tolerance = atof(argv[i]);
+      } else if (argv[i] == std::string("-subdivide") || argv[i] == std::string("-simplify")) {
+        bool subdivide = (argv[i] == std::string("-subdivide"));
+        i++; assert (i < argc);
+        MeshOperation op;
+        if (!parseOperation(argv[i], subdivide, op)) {
+          printf ("whoops error with %s '%s'\n", argv[i-1], argv[i]);
+          assert(0);
+        }
+        operations.push_back(op);
+      } else if (argv[i] == std::string("-output")) {
+        i++; assert (i < argc);
+        output = argv[i];
+      } else if (argv[i] == std::string("-output_format")) {
+        i++; assert (i < argc);
+        output_format = argv[i];
+        assert (output_format == "ply" || output_format == "obj");
+      } else if (argv[i] == std::string("-ascii_ply")) {
+        ascii_ply = true;
+      } else if (argv[i] == std::string("-measure_error")) {
+        measure_error = true;
+      } else if (argv[i] == std::string("-reorder")) {
+        i++; assert (i < argc);
+        reorder = argv[i];
+        assert (reorder == "morton" || reorder == "hilbert" || reorder == "none");
       } else {
         printf ("whoops error with command line argument %d: '%s'\n",i,argv[i]);
         assert(0);
@@ -38,6 +98,41 @@ public:
     height = 500;
     wireframe = false;
     gouraud = false;
+    use_cache = true;
+    benchmark_load = false;
+    stream_levels = 0;
+    butterfly = false;
+    progressive = false;
+    parallel_qem = false;
+    qem_tolerance = 1;
+    output_format = "ply";
+    ascii_ply = false;
+    measure_error = false;
+    reorder = "none";
+  }
+
+  // "method:amount", the amount is optional for a subdivision (1 level)
+  static bool parseOperation(const std::string &spec, bool subdivide, MeshOperation &op) {
+    std::string::size_type colon = spec.find(':');
+    op.method = spec.substr(0, colon);
+    op.amount = 1;
+    op.percent = false;
+    if (colon != std::string::npos) {
+      std::string amount = spec.substr(colon+1);
+      if (amount.empty()) return false;
+      if (!subdivide && amount[amount.size()-1] == '%') {
+        op.percent = true;
+        amount.erase(amount.size()-1);
+      }
+      char *end;
+      op.amount = strtol(amount.c_str(), &end, 10);
+      if (*end != '\0' || op.amount < 0) return false;
+    } else if (!subdivide) {
+      return false;
+    }
+    if (subdivide) return op.method == "loop" || op.method == "butterfly";
+    if (op.method == "cluster") return !op.percent && op.amount > 0;
+    return op.method == "qem" || op.method == "parallel_qem" || op.method == "random";
   }
 
   // ==============
@@ -48,6 +143,33 @@ public:
   int height;
   bool wireframe;
   bool gouraud;
+  bool use_cache;
+  bool benchmark_load;
+  // subdivide without the viewer & write the result to this file
+  int stream_levels;
+  std::string stream_output;
+  bool butterfly;
+  // record the QEM collapses once, 'd' / 'f' then just replay them
+  bool progressive;
+  // simplify spatial clusters in parallel first (see parallelqem.cpp)
+  bool parallel_qem;
+  // the clusters only collapse pairs up to (1 + qem_tolerance) times
+  // the cost of the last pair the serial run needs; a heuristic cap on
+  // each collapse, not a bound on the error of the result
+  double qem_tolerance;
+  // headless batch mode (batch.cpp): every input goes through the
+  // operations & is written to output (a file, or a directory when
+  // there are several inputs)
+  std::vector<std::string> input_files;
+  std::vector<MeshOperation> operations;
+  std::string output;
+  std::string output_format;
+  bool ascii_ply;
+  // report the Hausdorff & rms distance between input & output
+  bool measure_error;
+  // renumber vertices & triangles along this space-filling curve after
+  // loading (meshreorder.cpp): none, morton or hilbert
+  std::string reorder;
   MTRand mtrand;
 
 };
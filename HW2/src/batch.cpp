@@ -0,0 +1,221 @@
+#include "glCanvas.h"
+
+#include <cstdio>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <map>
+
+#include "argparser.h"
+#include "mesh.h"
+#include "meshwriter.h"
+#include "clustersimplify.h"
+#include "meshdistance.h"
+#include "parallel.h"
+#include "batch.h"
+
+// =======================================================================
+// Headless batch mode: no window & no GL context, so it also runs on
+// machines without a display, e.g.
+//
+//   ./mesher -input bunny.obj -subdivide loop:2 -simplify qem:10000 -output out.ply
+//   ./mesher -input ../model -simplify qem:50% -output simplified -output_format obj
+//   ./mesher -input scan.ply -simplify cluster:512 -simplify qem:200000 -output out.ply
+//
+// -input may be given several times and may name a directory (all its
+// .obj & .pm files, and .ply files when the first step is a cluster
+// step, the only one that reads them).  With one input, -output is the
+// file to write; with more it is a directory that gets one file per
+// input, named after it; two inputs that would get the same name (x.obj
+// & x.pm, or x.obj in two directories) are an error.  The inputs
+// are processed in parallel, one per thread; the loops inside each of
+// them then stay on that thread (see parallelTasks).  A cluster step
+// reads the input out of core (clustersimplify.h) & the mesh is only
+// built if there are more steps after it.
+// =======================================================================
+
+namespace fs = std::filesystem;
+
+// what happened to one input
+struct BatchResult {
+  std::string output_file;
+  std::string error;
+  long long input_triangles;
+  int output_triangles;
+  double seconds;
+  // with -measure_error (not for a clustered input, that is never loaded)
+  bool measured;
+  ApproximationError approximation_error;
+};
+
+static bool isMeshFile(const fs::path &path, bool cluster) {
+  return path.extension() == ".obj" || path.extension() == ".pm" || (cluster && path.extension() == ".ply");
+}
+
+// the -input files, with the directories replaced by their mesh files
+static bool collectInputs(const std::vector<std::string> &inputs, bool cluster, std::vector<std::string> &files) {
+  for (unsigned int i = 0; i < inputs.size(); i++) {
+    std::error_code error;
+    if (!fs::is_directory(inputs[i], error)) {
+      files.push_back(inputs[i]);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (fs::directory_iterator itr(inputs[i], error), end; !error && itr != end; itr.increment(error)) {
+      if (itr->is_regular_file() && isMeshFile(itr->path(), cluster)) found.push_back(itr->path().string());
+    }
+    if (error) {
+      printf ("ERROR! CANNOT READ DIRECTORY: %s\n", inputs[i].c_str());
+      return false;
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  return true;
+}
+
+static void runOperations(Mesh &mesh, ArgParser &args, unsigned int first) {
+  for (unsigned int i = first; i < args.operations.size(); i++) {
+    const MeshOperation &op = args.operations[i];
+    if (op.method == "loop") {
+      for (int level = 0; level < op.amount; level++) mesh.LoopSubdivision();
+    } else if (op.method == "butterfly") {
+      for (int level = 0; level < op.amount; level++) mesh.ButterflySubdivision();
+    } else {
+      int target = op.amount;
+      if (op.percent) target = (long long)mesh.numTriangles() * op.amount / 100;
+      if (op.method == "qem") mesh.Simplification_QEM(target);
+      else if (op.method == "parallel_qem") mesh.ParallelSimplification_QEM(target, args.qem_tolerance);
+      else mesh.Simplification(target);
+    }
+  }
+}
+
+static void processInput(ArgParser &args, const std::string &input_file, BatchResult &result) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  result.measured = false;
+  Mesh mesh(&args);
+  mesh.setPrintProgress(false);
+  bool in_core = true;
+  unsigned int first = 0;
+  std::vector<Vec3f> verts;
+  std::vector<int> tris;
+  if (!args.operations.empty() && args.operations[0].method == "cluster") {
+    ClusterStats stats;
+    if (!ClusterSimplify(input_file, args.operations[0].amount, verts, tris, &stats)) {
+      result.error = "cannot cluster";
+      return;
+    }
+    result.input_triangles = stats.input_triangles;
+    first = 1;
+    in_core = (args.operations.size() > 1);
+    if (in_core) mesh.LoadTriangles(verts, tris);
+  } else if (fs::path(input_file).extension() == ".ply") {
+    result.error = "only -simplify cluster reads .ply";
+    return;
+  } else {
+    mesh.Load(input_file);
+    result.input_triangles = mesh.numTriangles();
+  }
+  if (in_core) {
+    if (mesh.numTriangles() == 0) {
+      result.error = "no triangles loaded";
+      return;
+    }
+    TriangleBVH original;
+    if (args.measure_error && first == 0) original.build(mesh);
+    runOperations(mesh, args, first);
+    result.output_triangles = mesh.numTriangles();
+    if (args.measure_error && first == 0) {
+      TriangleBVH approximation;
+      approximation.build(mesh);
+      result.approximation_error = MeasureApproximationError(original, approximation);
+      result.measured = true;
+    }
+  } else {
+    result.output_triangles = tris.size() / 3;
+  }
+  MeshWriter *writer = MeshWriter::create(result.output_file, args.ascii_ply);
+  if (writer == NULL) {
+    result.error = "output must be .obj or .ply";
+    return;
+  }
+  bool ok = in_core ? mesh.Save(*writer, result.output_file) : writer->write(result.output_file, verts, tris);
+  if (!ok) result.error = "cannot write " + result.output_file;
+  delete writer;
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int RunBatch(ArgParser &args) {
+  std::vector<std::string> files;
+  bool cluster = !args.operations.empty() && args.operations[0].method == "cluster";
+  if (!collectInputs(args.input_files, cluster, files)) return 1;
+  if (files.empty()) {
+    printf ("ERROR! no input meshes\n");
+    return 1;
+  }
+  for (unsigned int i = 1; i < args.operations.size(); i++) {
+    if (args.operations[i].method == "cluster") {
+      printf ("ERROR! -simplify cluster can only be the first step\n");
+      return 1;
+    }
+  }
+
+  // one input & an output with a mesh extension: that is the file,
+  // otherwise the output is a directory
+  std::vector<BatchResult> results(files.size());
+  fs::path output(args.output);
+  if (files.size() == 1 && (output.extension() == ".obj" || output.extension() == ".ply")) {
+    results[0].output_file = args.output;
+  } else {
+    std::error_code error;
+    fs::create_directories(output, error);
+    if (!fs::is_directory(output, error)) {
+      printf ("ERROR! CANNOT CREATE DIRECTORY: %s\n", args.output.c_str());
+      return 1;
+    }
+    // the inputs run in parallel, two of them must not write one file
+    std::map<std::string,unsigned int> named;
+    for (unsigned int i = 0; i < files.size(); i++) {
+      results[i].output_file = (output / fs::path(files[i]).stem()).string() + "." + args.output_format;
+      std::pair<std::map<std::string,unsigned int>::iterator,bool> inserted =
+        named.insert(std::make_pair(results[i].output_file, i));
+      if (!inserted.second) {
+        printf ("ERROR! %s & %s WOULD BOTH BE WRITTEN TO %s\n", files[inserted.first->second].c_str(),
+                files[i].c_str(), results[i].output_file.c_str());
+        return 1;
+      }
+    }
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  parallelTasks(files.size(), [&](int i) {
+    processInput(args, files[i], results[i]);
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  int failed = 0;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    const BatchResult &result = results[i];
+    if (result.error != "") {
+      printf ("%s: ERROR! %s\n", files[i].c_str(), result.error.c_str());
+      failed++;
+    } else {
+      printf ("%s -> %s: %lld -> %d triangles, %.3f s", files[i].c_str(), result.output_file.c_str(),
+              result.input_triangles, result.output_triangles, result.seconds);
+      if (result.measured) {
+        // also as a percentage of the bounding box diagonal
+        const ApproximationError &e = result.approximation_error;
+        double percent = (e.diagonal > 0) ? 100 / e.diagonal : 0;
+        printf (", hausdorff %.4g (%.3f%%), rms %.4g (%.3f%%)",
+                e.hausdorff(), e.hausdorff() * percent, e.rms(), e.rms() * percent);
+      }
+      printf ("\n");
+    }
+  }
+  printf ("%d meshes in %.3f s, %d failed\n", (int)files.size(), seconds, failed);
+  return failed > 0 ? 1 : 0;
+}
+
+// =======================================================================
@@ -0,0 +1,11 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+class ArgParser;
+
+// runs the -subdivide / -simplify operations on every -input & writes
+// the results to -output, without a window (see batch.cpp); returns the
+// exit code for main
+int RunBatch(ArgParser &args);
+
+#endif
@@ -0,0 +1,324 @@
+#include "glCanvas.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#include "bvh.h"
+#include "mesh.h"
+
+// the cost of visiting a node, relative to testing one triangle
+#define BVH_TRAVERSAL_COST 1.0f
+
+// ====================================================================
+// BUILDING
+// ====================================================================
+
+static float surfaceArea(const float min[3], const float max[3]) {
+  float x = max[0]-min[0], y = max[1]-min[1], z = max[2]-min[2];
+  return 2 * (x*y + y*z + z*x);
+}
+
+static void emptyBox(float min[3], float max[3]) {
+  for (int k = 0; k < 3; k++) {
+    min[k] = FLT_MAX;
+    max[k] = -FLT_MAX;
+  }
+}
+
+static void growBox(float min[3], float max[3], const float *box_min, const float *box_max) {
+  for (int k = 0; k < 3; k++) {
+    min[k] = std::min(min[k], box_min[k]);
+    max[k] = std::max(max[k], box_max[k]);
+  }
+}
+
+struct BVHBin {
+  float min[3], max[3];
+  int count;
+};
+
+
+void TriangleBVH::build(const Mesh &mesh) {
+  vertices.clear();
+  triangles.clear();
+  mesh_triangles.clear();
+  nodes.clear();
+
+  // copy the live triangles & the vertices they use
+  std::vector<int> new_index(mesh.numVertices(), -1);
+  for (int t = 0; t < mesh.numTriangleSlots(); t++) {
+    if (!mesh.isTriangleAlive(t)) continue;
+    for (int k = 0; k < 3; k++) {
+      int v = mesh.getTriangleVertex(t,k);
+      if (new_index[v] < 0) {
+        new_index[v] = numVertices();
+        const Vec3f &pos = mesh.getPos(v);
+        vertices.push_back(pos.x());
+        vertices.push_back(pos.y());
+        vertices.push_back(pos.z());
+      }
+      triangles.push_back(new_index[v]);
+    }
+    mesh_triangles.push_back(t);
+  }
+  int n = numTriangles();
+  if (n == 0) return;
+
+  // the box & centroid of every triangle
+  std::vector<float> centroids(3*n);
+  std::vector<float> boxes(6*n);
+  for (int t = 0; t < n; t++) {
+    const float *corners[3];
+    for (int k = 0; k < 3; k++) corners[k] = &vertices[3*triangles[3*t+k]];
+    float *box = &boxes[6*t];
+    emptyBox(box, box+3);
+    for (int k = 0; k < 3; k++) growBox(box, box+3, corners[k], corners[k]);
+    for (int k = 0; k < 3; k++) centroids[3*t+k] = (corners[0][k] + corners[1][k] + corners[2][k]) / 3;
+  }
+
+  std::vector<int> order(n);
+  for (int t = 0; t < n; t++) order[t] = t;
+  nodes.reserve(2*n);
+  nodes.push_back(BVHNode());
+  buildNode(0, 0, n, 0, order, centroids, boxes);
+
+  // put the triangles in leaf order
+  std::vector<int> sorted_triangles(3*n);
+  std::vector<int> sorted_mesh_triangles(n);
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < 3; k++) sorted_triangles[3*i+k] = triangles[3*order[i]+k];
+    sorted_mesh_triangles[i] = mesh_triangles[order[i]];
+  }
+  triangles.swap(sorted_triangles);
+  mesh_triangles.swap(sorted_mesh_triangles);
+}
+
+
+void TriangleBVH::buildNode(int node, int begin, int end, int depth, std::vector<int> &order,
+                            const std::vector<float> &centroids, const std::vector<float> &boxes) {
+  // the bounds of the triangles & of their centroids
+  float min[3], max[3], centroid_min[3], centroid_max[3];
+  emptyBox(min, max);
+  emptyBox(centroid_min, centroid_max);
+  for (int i = begin; i < end; i++) {
+    int t = order[i];
+    growBox(min, max, &boxes[6*t], &boxes[6*t+3]);
+    growBox(centroid_min, centroid_max, &centroids[3*t], &centroids[3*t]);
+  }
+  BVHNode &n = nodes[node];
+  for (int k = 0; k < 3; k++) {
+    n.min[k] = min[k];
+    n.max[k] = max[k];
+  }
+  // a leaf, unless it is split below
+  int count = end - begin;
+  n.start = begin;
+  n.count = count;
+  if (count == 1 || depth >= BVH_MAX_DEPTH) return;
+
+  // bin the centroids along each axis and find the cheapest split:
+  // the triangles on each side times the area of their box
+  float best_cost = FLT_MAX;
+  int best_axis = -1;
+  int best_split = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = centroid_max[axis] - centroid_min[axis];
+    if (extent <= 0) continue;
+    float scale = BVH_BINS / extent;
+    BVHBin bins[BVH_BINS];
+    for (int b = 0; b < BVH_BINS; b++) {
+      emptyBox(bins[b].min, bins[b].max);
+      bins[b].count = 0;
+    }
+    for (int i = begin; i < end; i++) {
+      int t = order[i];
+      int b = std::min(BVH_BINS-1, (int)((centroids[3*t+axis] - centroid_min[axis]) * scale));
+      growBox(bins[b].min, bins[b].max, &boxes[6*t], &boxes[6*t+3]);
+      bins[b].count++;
+    }
+    // left of split s are the bins 0..s
+    float left_area[BVH_BINS-1];
+    int left_count[BVH_BINS-1];
+    float box_min[3], box_max[3];
+    emptyBox(box_min, box_max);
+    int total = 0;
+    for (int s = 0; s < BVH_BINS-1; s++) {
+      growBox(box_min, box_max, bins[s].min, bins[s].max);
+      total += bins[s].count;
+      left_count[s] = total;
+      left_area[s] = (total > 0) ? surfaceArea(box_min, box_max) : 0;
+    }
+    emptyBox(box_min, box_max);
+    total = 0;
+    for (int s = BVH_BINS-1; s > 0; s--) {
+      growBox(box_min, box_max, bins[s].min, bins[s].max);
+      total += bins[s].count;
+      if (total == 0 || left_count[s-1] == 0) continue;
+      float cost = left_area[s-1] * left_count[s-1] + surfaceArea(box_min, box_max) * total;
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = s-1;
+      }
+    }
+  }
+
+  int mid;
+  if (best_axis < 0) {
+    // all the centroids are in one spot: split in the middle if there
+    // are too many for a leaf
+    if (count <= BVH_MAX_LEAF) return;
+    mid = (begin + end) / 2;
+  } else {
+    float area = surfaceArea(min, max);
+    if (BVH_TRAVERSAL_COST * area + best_cost >= count * area && count <= BVH_MAX_LEAF) return;
+    float scale = BVH_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+    float origin = centroid_min[best_axis];
+    mid = std::partition(order.begin()+begin, order.begin()+end, [&](int t) {
+        return std::min(BVH_BINS-1, (int)((centroids[3*t+best_axis] - origin) * scale)) <= best_split;
+      }) - order.begin();
+  }
+
+  int left = nodes.size();
+  nodes.push_back(BVHNode());
+  nodes.push_back(BVHNode());
+  // (n may have moved)
+  nodes[node].start = left;
+  nodes[node].count = 0;
+  buildNode(left, begin, mid, depth+1, order, centroids, boxes);
+  buildNode(left+1, mid, end, depth+1, order, centroids, boxes);
+}
+
+
+BoundingBox TriangleBVH::getBounds() const {
+  if (nodes.empty()) return BoundingBox();
+  const BVHNode &root = nodes[0];
+  return BoundingBox(Vec3f(root.min[0], root.min[1], root.min[2]),
+                     Vec3f(root.max[0], root.max[1], root.max[2]));
+}
+
+// ====================================================================
+// CLOSEST POINT
+// ====================================================================
+
+static double boxDistanceSq(const BVHNode &n, const double p[3]) {
+  double sum = 0;
+  for (int k = 0; k < 3; k++) {
+    double d = std::max(std::max(n.min[k] - p[k], p[k] - n.max[k]), 0.0);
+    sum += d*d;
+  }
+  return sum;
+}
+
+static inline void sub(double r[3], const double a[3], const double b[3]) {
+  r[0] = a[0]-b[0]; r[1] = a[1]-b[1]; r[2] = a[2]-b[2];
+}
+
+static inline double dot(const double a[3], const double b[3]) {
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// r = a + s*u + t*v
+static inline void combine(double r[3], const double a[3], double s, const double u[3], double t, const double v[3]) {
+  for (int k = 0; k < 3; k++) r[k] = a[k] + s*u[k] + t*v[k];
+}
+
+// the point of triangle abc closest to p, by the region of the
+// triangle p projects into (Ericson, "Real-Time Collision Detection",
+// 5.1.5); returns the squared distance
+static double closestOnTriangle(const double p[3], const double a[3], const double b[3], const double c[3],
+                                double r[3]) {
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  sub(ab, b, a);
+  sub(ac, c, a);
+  sub(ap, p, a);
+  double d1 = dot(ab, ap), d2 = dot(ac, ap);
+  sub(bp, p, b);
+  double d3 = dot(ab, bp), d4 = dot(ac, bp);
+  sub(cp, p, c);
+  double d5 = dot(ab, cp), d6 = dot(ac, cp);
+  double va = d3*d6 - d5*d4;
+  double vb = d5*d2 - d1*d6;
+  double vc = d1*d4 - d3*d2;
+  if (d1 <= 0 && d2 <= 0) {
+    combine(r, a, 0, ab, 0, ac);
+  } else if (d3 >= 0 && d4 <= d3) {
+    combine(r, b, 0, ab, 0, ac);
+  } else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    combine(r, a, d1 / (d1 - d3), ab, 0, ac);
+  } else if (d6 >= 0 && d5 <= d6) {
+    combine(r, c, 0, ab, 0, ac);
+  } else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    combine(r, a, 0, ab, d2 / (d2 - d6), ac);
+  } else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    double bc[3];
+    sub(bc, c, b);
+    combine(r, b, (d4 - d3) / ((d4 - d3) + (d5 - d6)), bc, 0, ac);
+  } else if (va + vb + vc > 0) {
+    double denom = 1 / (va + vb + vc);
+    combine(r, a, vb * denom, ab, vc * denom, ac);
+  } else {
+    // degenerate (no area)
+    combine(r, a, 0, ab, 0, ac);
+  }
+  double d[3];
+  sub(d, p, r);
+  return dot(d, d);
+}
+
+
+int TriangleBVH::closestPoint(const Vec3f &p, Vec3f &closest, double &distance_sq) const {
+  if (nodes.empty()) return -1;
+  double q[3] = { p.x(), p.y(), p.z() };
+  int best = -1;
+  double best_point[3] = { 0, 0, 0 };
+  // the nodes still to visit & their distance when they were pushed;
+  // at most one per level is waiting
+  int stack[BVH_MAX_DEPTH+2];
+  double stack_distance[BVH_MAX_DEPTH+2];
+  int top = 0;
+  stack[top] = 0;
+  stack_distance[top++] = boxDistanceSq(nodes[0], q);
+  while (top > 0) {
+    top--;
+    if (stack_distance[top] >= distance_sq) continue;
+    const BVHNode &n = nodes[stack[top]];
+    if (n.count > 0) {
+      for (int i = n.start; i < n.start + n.count; i++) {
+        double corners[3][3];
+        for (int k = 0; k < 3; k++) {
+          const float *v = &vertices[3*triangles[3*i+k]];
+          corners[k][0] = v[0]; corners[k][1] = v[1]; corners[k][2] = v[2];
+        }
+        double r[3];
+        double d = closestOnTriangle(q, corners[0], corners[1], corners[2], r);
+        if (d < distance_sq) {
+          distance_sq = d;
+          best = i;
+          best_point[0] = r[0]; best_point[1] = r[1]; best_point[2] = r[2];
+        }
+      }
+      continue;
+    }
+    // the nearer child goes on top, so it is searched first
+    int near = n.start, far = n.start+1;
+    double near_distance = boxDistanceSq(nodes[near], q);
+    double far_distance = boxDistanceSq(nodes[far], q);
+    if (far_distance < near_distance) {
+      std::swap(near, far);
+      std::swap(near_distance, far_distance);
+    }
+    if (far_distance < distance_sq) {
+      stack[top] = far;
+      stack_distance[top++] = far_distance;
+    }
+    if (near_distance < distance_sq) {
+      stack[top] = near;
+      stack_distance[top++] = near_distance;
+    }
+  }
+  if (best >= 0) closest = Vec3f(best_point[0], best_point[1], best_point[2]);
+  return best;
+}
+
+// ====================================================================
@@ -0,0 +1,84 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <vector>
+#include "vectors.h"
+#include "boundingbox.h"
+
+class Mesh;
+
+// ====================================================================
+// Bounding volume hierarchy over the triangles of a Mesh, for closest
+// point queries (see meshdistance.h) & picking.  The tree is built top
+// down; every node is split where the surface area heuristic (binned
+// over the triangle centroids) says it is cheapest, and it becomes a
+// leaf when no split is cheaper than testing all its triangles.
+//
+// The BVH keeps its own copy of the positions (as floats), so it stays
+// valid while the mesh is changed, e.g. to compare it with the result
+// of a simplification.  Queries are const & can run in parallel.
+// ====================================================================
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 16
+#define BVH_MAX_DEPTH 64
+
+struct BVHNode {
+  float min[3];
+  float max[3];
+  int start;    // a leaf's first triangle, else the left child (right is start+1)
+  int count;    // the triangles in a leaf, 0 for an inner node
+};
+
+class TriangleBVH {
+
+public:
+
+  TriangleBVH() {}
+  // the live triangles of mesh
+  void build(const Mesh &mesh);
+
+  // =========
+  // ACCESSORS
+  int numTriangles() const { return triangles.size() / 3; }
+  int numVertices() const { return vertices.size() / 3; }
+  int numNodes() const { return nodes.size(); }
+  BoundingBox getBounds() const;
+  Vec3f getVertex(int i) const {
+    return Vec3f(vertices[3*i], vertices[3*i+1], vertices[3*i+2]);
+  }
+  // the corners of the i-th triangle (in the order of the tree)
+  void getTriangle(int i, Vec3f &a, Vec3f &b, Vec3f &c) const {
+    a = getVertex(triangles[3*i]);
+    b = getVertex(triangles[3*i+1]);
+    c = getVertex(triangles[3*i+2]);
+  }
+  // the mesh triangle it was made from
+  int meshTriangle(int i) const { return mesh_triangles[i]; }
+
+  // =======
+  // QUERIES
+  // the closest point to p on any triangle that is closer than
+  // sqrt(distance_sq) (pass a large number to search everything);
+  // returns the tree triangle or -1 if there is none that close, and
+  // then leaves closest & distance_sq alone
+  int closestPoint(const Vec3f &p, Vec3f &closest, double &distance_sq) const;
+
+private:
+
+  // makes nodes[node] the root of the tree over order[begin,end), and
+  // sorts that range of order so every leaf's triangles are together
+  void buildNode(int node, int begin, int end, int depth, std::vector<int> &order,
+                 const std::vector<float> &centroids, const std::vector<float> &boxes);
+
+  // ==============
+  // REPRESENTATION
+  std::vector<float> vertices;       // x y z of the mesh vertices the triangles use
+  std::vector<int> triangles;        // 3 vertices each, in leaf order
+  std::vector<int> mesh_triangles;   // the mesh triangle of each
+  std::vector<BVHNode> nodes;        // nodes[0] is the root
+};
+
+// ====================================================================
+
+#endif
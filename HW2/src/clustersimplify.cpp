@@ -0,0 +1,498 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <stdint.h>
+
+#include "clustersimplify.h"
+#include "boundingbox.h"
+#include "flathash.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include "quadric.h"
+
+// the .obj is parsed in pieces of about this size, so the parsed
+// numbers of only one piece are in memory at a time
+#define CLUSTER_WINDOW_BYTES (16<<20)
+
+// a .ply header longer than this is not one we wrote
+#define PLY_MAX_HEADER (1<<16)
+
+// ====================================================================
+// TRIANGLE SOURCES
+//
+// open() reads the bounding box of the vertices, forEachTriangle then
+// calls f(p1,p2,p3) for every triangle in file order (polygons are
+// split into fans) and returns false if the file turns out to be broken.
+// ====================================================================
+
+static uint32_t getUint32(const char *p) {
+  const unsigned char *b = (const unsigned char*)p;
+  return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+}
+
+static float getFloat(const char *p) {
+  uint32_t u = getUint32(p);
+  float f;
+  memcpy(&f, &u, sizeof(float));
+  return f;
+}
+
+// ====================================================================
+// binary little endian .ply with float x y z vertices and a uchar / int
+// list of vertex indices per face, like PlyWriter writes them
+
+class PlySource {
+
+public:
+
+  PlySource() { vertices = faces = NULL; num_vertices = num_faces = 0; }
+
+  bool open(const std::string &filename);
+  const BoundingBox& getBounds() const { return bbox; }
+  long long numVertices() const { return num_vertices; }
+
+  template <class F>
+  bool forEachTriangle(F f) const {
+    const char *p = faces;
+    const char *end = file.data() + file.size();
+    for (long long i = 0; i < num_faces; i++) {
+      if (p >= end) return false;
+      int n = (unsigned char)*p++;
+      if (4*n > end-p) return false;
+      uint32_t first = getUint32(p);
+      for (int k = 1; k+1 < n; k++) {
+        uint32_t b = getUint32(p+4*k);
+        uint32_t c = getUint32(p+4*(k+1));
+        if (first >= num_vertices || b >= num_vertices || c >= num_vertices) return false;
+        f(position(first), position(b), position(c));
+      }
+      p += 4*n;
+    }
+    return true;
+  }
+
+private:
+
+  // don't use these constructors
+  PlySource(const PlySource&) { assert(0); exit(0); }
+  PlySource& operator=(const PlySource&) { assert(0); exit(0); }
+
+  Vec3f position(uint32_t i) const {
+    const char *p = vertices + 12*size_t(i);
+    return Vec3f(getFloat(p), getFloat(p+4), getFloat(p+8));
+  }
+
+  MappedFile file;
+  const char *vertices;
+  const char *faces;
+  long long num_vertices;
+  long long num_faces;
+  BoundingBox bbox;
+};
+
+
+bool PlySource::open(const std::string &filename) {
+  if (!file.open(filename)) {
+    printf ("ERROR! CANNOT OPEN: %s\n", filename.c_str());
+    return false;
+  }
+  std::string header(file.data(), std::min<size_t>(file.size(), PLY_MAX_HEADER));
+  std::string::size_type stop = header.find("end_header");
+  std::string::size_type line_end = (stop == std::string::npos) ? stop : header.find('\n', stop);
+
+  // vertex must be the first element & have just x y z, face the second
+  bool ok = (header.compare(0, 3, "ply") == 0 && line_end != std::string::npos);
+  bool binary = false;
+  int num_elements = 0;
+  int vertex_properties = 0;
+  int face_properties = 0;
+  std::string element;
+  std::istringstream istr(header.substr(0, stop));
+  std::string line;
+  while (ok && std::getline(istr, line)) {
+    std::istringstream ls(line);
+    std::string keyword;
+    ls >> keyword;
+    if (keyword == "format") {
+      std::string format;
+      ls >> format;
+      binary = (format == "binary_little_endian");
+    } else if (keyword == "element") {
+      long long count = 0;
+      ls >> element >> count;
+      if (element == "vertex") {
+        ok = (num_elements == 0);
+        num_vertices = count;
+      } else if (element == "face") {
+        ok = (num_elements == 1);
+        num_faces = count;
+      }
+      num_elements++;
+    } else if (keyword == "property") {
+      std::string type, count_type, index_type, name;
+      ls >> type;
+      if (element == "vertex") {
+        static const char *xyz[3] = { "x", "y", "z" };
+        ls >> name;
+        ok = (type == "float" && vertex_properties < 3 && name == xyz[vertex_properties]);
+        vertex_properties++;
+      } else if (element == "face") {
+        ls >> count_type >> index_type;
+        ok = (type == "list" && face_properties == 0 &&
+              (count_type == "uchar" || count_type == "uint8") &&
+              (index_type == "int" || index_type == "int32" || index_type == "uint" || index_type == "uint32"));
+        face_properties++;
+      }
+    }
+  }
+  if (!ok || !binary || vertex_properties != 3 || face_properties != 1) {
+    printf ("ERROR! only binary little endian .ply files with float x y z vertices can be clustered: %s\n",
+            filename.c_str());
+    return false;
+  }
+  vertices = file.data() + line_end + 1;
+  faces = vertices + 12*num_vertices;
+  if (num_vertices < 0 || num_vertices > (long long)UINT32_MAX ||
+      12*num_vertices > (long long)(file.data() + file.size() - vertices)) {
+    printf ("ERROR! BROKEN FILE: %s\n", filename.c_str());
+    return false;
+  }
+  for (long long i = 0; i < num_vertices; i++) {
+    Vec3f p = position(i);
+    if (i == 0) bbox.Set(p, p);
+    else bbox.Extend(p);
+  }
+  return true;
+}
+
+// ====================================================================
+// .obj: the vertices cannot be found by their index in the text, so
+// the first pass copies their positions into a temporary file of
+// floats, which the second pass (over the faces) maps
+
+// calls f(chunk) for the chunks of every window in file order
+template <class F>
+static void forEachObjWindow(const MappedFile &file, F f) {
+  const char *p = file.data();
+  const char *end = p + file.size();
+  std::vector<ObjChunk> chunks;
+  while (p < end) {
+    const char *q = p + std::min<size_t>(CLUSTER_WINDOW_BYTES, end-p);
+    if (q < end) {
+      const char *nl = (const char*)memchr(q, '\n', end-q);
+      q = (nl == NULL) ? end : nl+1;
+    }
+    parseObj(p, q-p, chunks);
+    for (unsigned int i = 0; i < chunks.size(); i++) f(chunks[i]);
+    p = q;
+  }
+}
+
+// a new file in the temporary directory
+static FILE* createTemporaryFile(std::string &filename) {
+  std::error_code error;
+  std::filesystem::path dir = std::filesystem::temp_directory_path(error);
+  if (error) return NULL;
+  std::random_device random;
+  for (int attempt = 0; attempt < 16; attempt++) {
+    char name[64];
+    snprintf(name, sizeof(name), "mesher_cluster_%08x.bin", (unsigned int)random());
+    filename = (dir / name).string();
+    // "x" fails if the file exists already
+    FILE *f = fopen(filename.c_str(), "wbx");
+    if (f != NULL) return f;
+  }
+  filename = "";
+  return NULL;
+}
+
+class ObjSource {
+
+public:
+
+  ObjSource() { num_vertices = 0; }
+  ~ObjSource() {
+    positions.close();
+    std::error_code error;
+    if (spill_file != "") std::filesystem::remove(spill_file, error);
+  }
+
+  bool open(const std::string &filename);
+  const BoundingBox& getBounds() const { return bbox; }
+  long long numVertices() const { return num_vertices; }
+
+  template <class F>
+  bool forEachTriangle(F f) const {
+    bool ok = true;
+    long long vert_offset = 0;
+    forEachObjWindow(file, [&](ObjChunk &chunk) {
+      for (unsigned int j = 0; j < chunk.relative_indices.size(); j++) {
+        chunk.tris[chunk.relative_indices[j]] += vert_offset;
+      }
+      for (unsigned int j = 0; j+2 < chunk.tris.size(); j += 3) {
+        int a = chunk.tris[j], b = chunk.tris[j+1], c = chunk.tris[j+2];
+        if (std::min(a, std::min(b, c)) < 0 || std::max(a, std::max(b, c)) >= num_vertices) {
+          ok = false;
+          continue;
+        }
+        f(position(a), position(b), position(c));
+      }
+      vert_offset += chunk.verts.size() / 3;
+    });
+    return ok;
+  }
+
+private:
+
+  // don't use these constructors
+  ObjSource(const ObjSource&) { assert(0); exit(0); }
+  ObjSource& operator=(const ObjSource&) { assert(0); exit(0); }
+
+  Vec3f position(int i) const {
+    float p[3];
+    memcpy(p, positions.data() + 3*sizeof(float)*size_t(i), sizeof(p));
+    return Vec3f(p[0], p[1], p[2]);
+  }
+
+  MappedFile file;
+  MappedFile positions;
+  std::string spill_file;
+  long long num_vertices;
+  BoundingBox bbox;
+};
+
+
+bool ObjSource::open(const std::string &filename) {
+  if (!file.open(filename)) {
+    printf ("ERROR! CANNOT OPEN: %s\n", filename.c_str());
+    return false;
+  }
+  FILE *spill = createTemporaryFile(spill_file);
+  if (spill == NULL) {
+    printf ("ERROR! CANNOT CREATE A TEMPORARY FILE\n");
+    return false;
+  }
+  setvbuf(spill, NULL, _IOFBF, 1<<20);
+  bool ok = true;
+  forEachObjWindow(file, [&](ObjChunk &chunk) {
+    for (unsigned int j = 0; j+2 < chunk.verts.size(); j += 3) {
+      Vec3f p(chunk.verts[j], chunk.verts[j+1], chunk.verts[j+2]);
+      if (num_vertices == 0 && j == 0) bbox.Set(p, p);
+      else bbox.Extend(p);
+    }
+    size_t n = chunk.verts.size();
+    ok = ok && fwrite(chunk.verts.data(), sizeof(float), n, spill) == n;
+    num_vertices += n / 3;
+  });
+  ok = (fclose(spill) == 0) && ok;
+  // the faces look the vertices up in any order
+  if (!ok || !positions.open(spill_file, false)) {
+    printf ("ERROR! CANNOT WRITE THE TEMPORARY FILE %s\n", spill_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+// ====================================================================
+// THE GRID
+// ====================================================================
+
+struct Cluster {
+  Cluster() { count = 0; }
+  Quadric quadric;
+  Vec3f sum;    // of all the triangle corners in the cell
+  int count;
+};
+
+// a kept triangle: its 3 clusters, rotated so the smallest comes first
+// (which keeps the orientation), so copies compare equal
+struct ClusterTriangle {
+  ClusterTriangle(int a, int b, int c) {
+    if (b < a && b < c) { v[0] = b; v[1] = c; v[2] = a; }
+    else if (c < a && c < b) { v[0] = c; v[1] = a; v[2] = b; }
+    else { v[0] = a; v[1] = b; v[2] = c; }
+  }
+  bool operator<(const ClusterTriangle &t) const {
+    if (v[0] != t.v[0]) return v[0] < t.v[0];
+    if (v[1] != t.v[1]) return v[1] < t.v[1];
+    return v[2] < t.v[2];
+  }
+  bool operator==(const ClusterTriangle &t) const {
+    return v[0] == t.v[0] && v[1] == t.v[1] && v[2] == t.v[2];
+  }
+  int v[3];
+};
+
+class ClusterGrid {
+
+public:
+
+  ClusterGrid(const BoundingBox &bbox, int resolution);
+
+  void addTriangle(const Vec3f &p1, const Vec3f &p2, const Vec3f &p3);
+  // the vertices of the clusters used by the kept triangles, in the
+  // order the triangles first use them
+  void getMesh(std::vector<Vec3f> &verts, std::vector<int> &tris);
+
+  int numClusters() const { return clusters.size(); }
+  long long numInputTriangles() const { return num_input_triangles; }
+
+private:
+
+  int getCluster(const Vec3f &p);
+  Vec3f clusterPosition(int i) const;
+  // many input triangles end up as the same one, so the copies are
+  // dropped whenever the list has doubled
+  void removeDuplicates();
+
+  Vec3f minimum;
+  double cell_size;
+  int dims[3];
+  // the occupied cells: (x, y << 15 | z) -> index in clusters + 1
+  FlatPairMap<OrderedPairKey> cells;
+  std::vector<Cluster> clusters;
+  std::vector<ClusterTriangle> triangles;
+  size_t unique_triangles;
+  long long num_input_triangles;
+};
+
+
+ClusterGrid::ClusterGrid(const BoundingBox &bbox, int resolution) {
+  assert (resolution >= 1 && resolution <= CLUSTER_MAX_RESOLUTION);
+  minimum = bbox.getMin();
+  double size = bbox.maxDim();
+  cell_size = (size > 0) ? size / resolution : 1;
+  Vec3f extent = bbox.getMax();
+  extent -= minimum;
+  for (int k = 0; k < 3; k++) {
+    dims[k] = std::min(resolution, std::max(1, (int)ceil(extent[k] / cell_size)));
+  }
+  unique_triangles = 0;
+  num_input_triangles = 0;
+}
+
+
+int ClusterGrid::getCluster(const Vec3f &p) {
+  int c[3];
+  for (int k = 0; k < 3; k++) {
+    c[k] = std::min(dims[k]-1, std::max(0, (int)((p[k] - minimum[k]) / cell_size)));
+  }
+  int &slot = cells[std::make_pair(c[0], (c[1] << 15) | c[2])];
+  if (slot == 0) {
+    clusters.push_back(Cluster());
+    slot = clusters.size();
+  }
+  return slot-1;
+}
+
+
+void ClusterGrid::addTriangle(const Vec3f &p1, const Vec3f &p2, const Vec3f &p3) {
+  num_input_triangles++;
+  Quadric plane = Quadric::plane(p1, p2, p3);
+  const Vec3f *corners[3] = { &p1, &p2, &p3 };
+  int c[3];
+  for (int k = 0; k < 3; k++) {
+    c[k] = getCluster(*corners[k]);
+    Cluster &cluster = clusters[c[k]];
+    cluster.quadric += plane;
+    cluster.sum += *corners[k];
+    cluster.count++;
+  }
+  // collapsed to an edge or a point
+  if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0]) return;
+  triangles.push_back(ClusterTriangle(c[0], c[1], c[2]));
+  if (triangles.size() >= 2*unique_triangles + 4096) removeDuplicates();
+}
+
+
+void ClusterGrid::removeDuplicates() {
+  std::sort(triangles.begin(), triangles.end());
+  triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+  unique_triangles = triangles.size();
+}
+
+
+Vec3f ClusterGrid::clusterPosition(int i) const {
+  const Cluster &cluster = clusters[i];
+  Vec3f mean = cluster.sum;
+  mean.Scale(1.0 / cluster.count);
+  // on a (nearly) flat or straight patch the optimum is badly defined
+  // and may be far away, so it is only used if it stays near the cell
+  Vec3f v;
+  if (cluster.quadric.optimize(v)) {
+    Vec3f offset = v;
+    offset -= mean;
+    if (offset.Length() <= cell_size) return v;
+  }
+  return mean;
+}
+
+
+void ClusterGrid::getMesh(std::vector<Vec3f> &verts, std::vector<int> &tris) {
+  removeDuplicates();
+  std::vector<int> new_index(clusters.size(), -1);
+  verts.clear();
+  tris.clear();
+  tris.reserve(3*triangles.size());
+  for (unsigned int i = 0; i < triangles.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      int &index = new_index[triangles[i].v[k]];
+      if (index < 0) {
+        index = verts.size();
+        verts.push_back(clusterPosition(triangles[i].v[k]));
+      }
+      tris.push_back(index);
+    }
+  }
+}
+
+// ====================================================================
+
+template <class Source>
+static bool clusterSource(const Source &source, int resolution, std::vector<Vec3f> &verts,
+                          std::vector<int> &tris, ClusterStats *stats) {
+  ClusterGrid grid(source.getBounds(), resolution);
+  bool ok = source.forEachTriangle([&](const Vec3f &p1, const Vec3f &p2, const Vec3f &p3) {
+    grid.addTriangle(p1, p2, p3);
+  });
+  if (!ok) return false;
+  grid.getMesh(verts, tris);
+  if (stats != NULL) {
+    stats->input_vertices = source.numVertices();
+    stats->input_triangles = grid.numInputTriangles();
+    stats->occupied_cells = grid.numClusters();
+  }
+  return true;
+}
+
+
+bool ClusterSimplify(const std::string &input_file, int resolution,
+                     std::vector<Vec3f> &verts, std::vector<int> &tris,
+                     ClusterStats *stats) {
+  if (resolution < 1 || resolution > CLUSTER_MAX_RESOLUTION) {
+    printf ("ERROR! the grid resolution must be 1 to %d\n", CLUSTER_MAX_RESOLUTION);
+    return false;
+  }
+  std::string extension = std::filesystem::path(input_file).extension().string();
+  bool ok;
+  if (extension == ".ply") {
+    PlySource source;
+    if (!source.open(input_file)) return false;
+    ok = clusterSource(source, resolution, verts, tris, stats);
+  } else if (extension == ".obj") {
+    ObjSource source;
+    if (!source.open(input_file)) return false;
+    ok = clusterSource(source, resolution, verts, tris, stats);
+  } else {
+    printf ("ERROR! only .obj & .ply files can be clustered: %s\n", input_file.c_str());
+    return false;
+  }
+  if (!ok) printf ("ERROR! BROKEN FILE: %s\n", input_file.c_str());
+  return ok;
+}
+
+// ====================================================================
@@ -0,0 +1,49 @@
+#ifndef _CLUSTER_SIMPLIFY_H_
+#define _CLUSTER_SIMPLIFY_H_
+
+#include <string>
+#include <vector>
+#include "vectors.h"
+
+// ====================================================================
+// Out-of-core simplification by vertex clustering (Lindstrom,
+// "Out-of-Core Simplification of Large Polygonal Models", 2000).  The
+// bounding box is cut into a uniform grid and all vertices in a cell
+// become one: every triangle of the input adds its plane quadric to
+// the cells of its 3 corners, and is kept only if they are 3 different
+// cells.  The vertex of a cell is the point with the smallest error
+// for its quadric (or the mean of its corners if that is not well
+// defined).
+//
+// The input is read front to back from a memory mapped file, and only
+// the occupied cells & the kept triangles are held in memory, so the
+// memory use grows with the output, not the input:
+//   binary .ply   (as written by PlyWriter) the vertex positions are
+//                 read straight from the mapped file
+//   .obj          is read twice; the first pass copies the positions
+//                 into a temporary binary file that is then mapped too
+//
+// The result can be written as it is or be loaded into a Mesh (see
+// Mesh::LoadTriangles) and simplified further with QEM.
+// ====================================================================
+
+// up to this many cells along each side of the bounding box
+#define CLUSTER_MAX_RESOLUTION 32767
+
+struct ClusterStats {
+  long long input_vertices;
+  long long input_triangles;
+  int occupied_cells;
+};
+
+// clusters input_file on a grid with resolution cells along the longest
+// side of its bounding box; verts & tris (3 indices per triangle) get
+// the simplified mesh.  returns false (after printing why) if the file
+// cannot be read
+bool ClusterSimplify(const std::string &input_file, int resolution,
+                     std::vector<Vec3f> &verts, std::vector<int> &tris,
+                     ClusterStats *stats = NULL);
+
+// ====================================================================
+
+#endif
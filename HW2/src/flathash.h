@@ -0,0 +1,192 @@
+#ifndef _FLAT_HASH_H_
+#define _FLAT_HASH_H_
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+// ===================================================================================
+// An open-addressing hash table from a pair of vertex indices to an int.
+// The pair is packed into one 64 bit key, the keys & values live in two
+// flat arrays (no allocation per entry), collisions are resolved by
+// linear probing over the key array and erase shifts the following
+// entries back, so there are no tombstones.  The table is kept at most
+// half full.
+//
+// The interface is the part of std::unordered_map that the mesh uses:
+// find / end / operator[] / erase / clear / reserve / size.  Iterators
+// are read only and are invalidated by any insert or erase.
+//
+// KeyPolicy::pack(a,b) gives the 64 bit key; see OrderedPairKey below.
+// ===================================================================================
+
+// (a,b) and (b,a) are different keys
+struct OrderedPairKey {
+  static uint64_t pack(int a, int b) {
+    return (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+  }
+};
+
+// the 64 bit finalizer of MurmurHash3: every input bit affects every
+// output bit, so neighboring indices do not land in neighboring slots
+inline uint64_t mix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+template <class KeyPolicy>
+class FlatPairMap {
+
+public:
+
+  typedef std::pair<std::pair<int,int>,int> value_type;
+
+  // an iterator gives a copy of the entry: it->first, it->second
+  class const_iterator {
+  public:
+    const_iterator() : map(NULL), slot(0) {}
+    const_iterator(const FlatPairMap *m, size_t s) : map(m), slot(s) {
+      if (map != NULL && slot < map->keys.size()) {
+        uint64_t k = map->keys[slot];
+        entry = value_type(std::make_pair(int(k >> 32), int(uint32_t(k))), map->values[slot]);
+      }
+    }
+    const value_type& operator*() const { return entry; }
+    const value_type* operator->() const { return &entry; }
+    bool operator==(const const_iterator &other) const { return slot == other.slot; }
+    bool operator!=(const const_iterator &other) const { return slot != other.slot; }
+  private:
+    const FlatPairMap *map;
+    size_t slot;
+    value_type entry;
+  };
+  typedef const_iterator iterator;
+
+  // ========================
+  // CONSTRUCTOR
+  FlatPairMap() { num_entries = 0; }
+
+  // =========
+  // ACCESSORS
+  size_t size() const { return num_entries; }
+  bool empty() const { return num_entries == 0; }
+  size_t bucket_count() const { return keys.size(); }
+  size_t memoryBytes() const {
+    return keys.capacity() * sizeof(uint64_t) + values.capacity() * sizeof(int);
+  }
+  // slots looked at by a successful find, averaged over the entries
+  // (1 is every entry in its home slot)
+  double averageProbeLength() const {
+    if (num_entries == 0) return 0;
+    size_t mask = keys.size() - 1;
+    size_t total = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] != EMPTY) total += ((i - mix64(keys[i])) & mask) + 1;
+    }
+    return double(total) / num_entries;
+  }
+
+  const_iterator end() const { return const_iterator(this, NOT_FOUND); }
+  const_iterator find(const std::pair<int,int> &p) const {
+    return const_iterator(this, findSlot(KeyPolicy::pack(p.first,p.second)));
+  }
+
+  // =========
+  // MODIFIERS
+  int& operator[](const std::pair<int,int> &p) {
+    uint64_t key = KeyPolicy::pack(p.first,p.second);
+    assert (key != EMPTY);
+    if (2*(num_entries+1) > keys.size()) rehash(std::max<size_t>(16, 2*keys.size()));
+    size_t mask = keys.size() - 1;
+    size_t slot = mix64(key) & mask;
+    while (keys[slot] != EMPTY) {
+      if (keys[slot] == key) return values[slot];
+      slot = (slot + 1) & mask;
+    }
+    keys[slot] = key;
+    values[slot] = 0;
+    num_entries++;
+    return values[slot];
+  }
+
+  size_t erase(const std::pair<int,int> &p) {
+    size_t slot = findSlot(KeyPolicy::pack(p.first,p.second));
+    if (slot == NOT_FOUND) return 0;
+    // move back every following entry of the cluster that would not be
+    // found from its home slot once this one is empty
+    size_t mask = keys.size() - 1;
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask;
+    while (keys[next] != EMPTY) {
+      size_t home = mix64(keys[next]) & mask;
+      // is home cyclically outside (hole, next]?
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        keys[hole] = keys[next];
+        values[hole] = values[next];
+        hole = next;
+      }
+      next = (next + 1) & mask;
+    }
+    keys[hole] = EMPTY;
+    num_entries--;
+    return 1;
+  }
+
+  void clear() {
+    std::fill(keys.begin(), keys.end(), EMPTY);
+    num_entries = 0;
+  }
+
+  void reserve(size_t n) {
+    size_t capacity = 16;
+    while (capacity < 2*n) capacity *= 2;
+    if (capacity > keys.size()) rehash(capacity);
+  }
+
+private:
+
+  static constexpr uint64_t EMPTY = ~uint64_t(0);
+  static constexpr size_t NOT_FOUND = ~size_t(0);
+
+  size_t findSlot(uint64_t key) const {
+    if (keys.empty()) return NOT_FOUND;
+    size_t mask = keys.size() - 1;
+    size_t slot = mix64(key) & mask;
+    while (keys[slot] != EMPTY) {
+      if (keys[slot] == key) return slot;
+      slot = (slot + 1) & mask;
+    }
+    return NOT_FOUND;
+  }
+
+  void rehash(size_t capacity) {
+    assert ((capacity & (capacity-1)) == 0 && capacity >= 2*num_entries);
+    std::vector<uint64_t> old_keys(capacity, EMPTY);
+    std::vector<int> old_values(capacity);
+    old_keys.swap(keys);
+    old_values.swap(values);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < old_keys.size(); i++) {
+      if (old_keys[i] == EMPTY) continue;
+      size_t slot = mix64(old_keys[i]) & mask;
+      while (keys[slot] != EMPTY) slot = (slot + 1) & mask;
+      keys[slot] = old_keys[i];
+      values[slot] = old_values[i];
+    }
+  }
+
+  // ==============
+  // REPRESENTATION
+  std::vector<uint64_t> keys;   // EMPTY for a free slot
+  std::vector<int> values;
+  size_t num_entries;
+};
+
+#endif
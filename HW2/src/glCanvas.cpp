@@ -219,10 +219,27 @@ void GLCanvas::keyboard(unsigned char key, int /*x*/, int /*y*/) {
     break;
   case 'd': case 'D':
     // mesh->Simplification((int)floor(0.9*mesh->numTriangles()));
-    mesh->Simplification_QEM((int)floor(0.9*mesh->numTriangles()));
-    mesh->setupVBOs();
+    if (mesh->hasProgressiveMesh())
+      mesh->SetLevelOfDetail((int)floor(0.9*mesh->numTriangles()));
+    else if (args->parallel_qem)
+      mesh->ParallelSimplification_QEM((int)floor(0.9*mesh->numTriangles()), args->qem_tolerance);
+    else
+      mesh->Simplification_QEM((int)floor(0.9*mesh->numTriangles()));
+    // only the triangles around the collapsed edges are uploaded again
+    mesh->updateVBOs();
     glutPostRedisplay();
     break;
+  case 'f': case 'F':
+    // back to a finer level of the progressive mesh
+    if (mesh->hasProgressiveMesh()) {
+      mesh->SetLevelOfDetail((int)ceil(mesh->numTriangles()/0.9));
+      mesh->updateVBOs();
+      glutPostRedisplay();
+    }
+    break;
+  case 'm': case 'M':
+    mesh->printMemoryStats();
+    break;
   case 'q':  case 'Q':
     exit(0);
     break;
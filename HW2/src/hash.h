@@ -15,17 +15,18 @@
 #error "unknown system"
 #endif
 
-class Edge;
-class Triangle;
-#include "vertex.h"
+#include <utility>
+#include <cassert>
+#include "flathash.h"
 
 #define LARGE_PRIME_A 10007
 #define LARGE_PRIME_B 11003
 
 
 // ===================================================================================
-// DIRECTED EDGES are stored in a hash table using a simple hash
-// function based on the indices of the start and end vertices
+// DIRECTED EDGES are stored in a hash table (start & end vertex index
+// -> half-edge index) using a simple hash function based on the
+// indices of the start and end vertices
 // ===================================================================================
 
 inline unsigned int ordered_two_int_hash(unsigned int a, unsigned int b) {
@@ -33,14 +34,14 @@ inline unsigned int ordered_two_int_hash(unsigned int a, unsigned int b) {
 }
 
 struct orderedvertexpairhash {
-  size_t operator()(std::pair<Vertex*,Vertex*> p) const {
-    return ordered_two_int_hash(p.first->getIndex(),p.second->getIndex());
+  size_t operator()(std::pair<int,int> p) const {
+    return ordered_two_int_hash(p.first,p.second);
   }
 };
 
 struct orderedsamevertexpair {
-  bool operator()(std::pair<Vertex*,Vertex*> p1, std::pair<Vertex*,Vertex*>p2) const {
-    if (p1.first->getIndex() == p2.first->getIndex() && p1.second->getIndex() == p2.second->getIndex())
+  bool operator()(std::pair<int,int> p1, std::pair<int,int> p2) const {
+    if (p1.first == p2.first && p1.second == p2.second)
       return true;
     return false;
   }
@@ -49,77 +50,24 @@ struct orderedsamevertexpair {
 
 
 // ===================================================================================
-// PARENT/CHILD VERTEX relationships (for subdivision) are stored in a
-// hash table using a simple hash function based on the indices of the
-// parent vertices, smaller index first
+// the table the mesh uses: a flat open-addressing table on packed
+// 64 bit keys (see flathash.h)
 // ===================================================================================
 
-inline unsigned int unordered_two_int_hash(unsigned int a, unsigned int b) {
-  assert (a != b);
-  if (b < a) {
-    return ordered_two_int_hash(b,a);
-  } else {
-    assert (a < b);
-    return ordered_two_int_hash(a,b);
-  }
-}
-
-struct unorderedvertexpairhash {
-  size_t operator()(std::pair<Vertex*,Vertex*> p) const {
-    return unordered_two_int_hash(p.first->getIndex(),p.second->getIndex());
-  }
-};
-
-struct unorderedsamevertexpair {
-  bool operator()(std::pair<Vertex*,Vertex*> p1, std::pair<Vertex*,Vertex*>p2) const {
-    if ((p1.first->getIndex() == p2.first->getIndex() && p1.second->getIndex() == p2.second->getIndex()) ||
-	(p1.first->getIndex() == p2.second->getIndex() && p1.second->getIndex() == p2.first->getIndex())) return true;
-    return false;
-  }
-};
-
-
-
-// ===================================================================================
-// TRIANGLES are stored in a hash table using a simple hash function
-// based on the id of the triangle (unique ids are assigned when the
-// triangle is constructed)
-// ===================================================================================
-
-struct idhash {
-  size_t operator()(unsigned int id) const {
-    return LARGE_PRIME_A * id;
-  }
-};
-
-struct sameid {
-  bool operator()(unsigned int a, unsigned int b) const {
-    if (a == b)
-      return true;
-    return false;
-  }
-};
-
+typedef FlatPairMap<OrderedPairKey> edgeshashtype;
 
 
+// the node based table it replaced (kept for comparison, see hashbench.cpp)
 // to handle different platforms with different variants of a developing standard
 // NOTE: You may need to adjust these depending on your installation
 #ifdef __APPLE__
-typedef __gnu_cxx::hash_map<std::pair<Vertex*,Vertex*>,Vertex*,unorderedvertexpairhash,unorderedsamevertexpair> vphashtype;
-typedef __gnu_cxx::hash_map<std::pair<Vertex*,Vertex*>,Edge*,orderedvertexpairhash,orderedsamevertexpair> edgeshashtype;
-typedef __gnu_cxx::hash_map<unsigned int,Triangle*,idhash,sameid> triangleshashtype;
+typedef __gnu_cxx::hash_map<std::pair<int,int>,int,orderedvertexpairhash,orderedsamevertexpair> node_edgeshashtype;
 #elif defined(_WIN32)
-typedef std::unordered_map<std::pair<Vertex*,Vertex*>,Vertex*,unorderedvertexpairhash,unorderedsamevertexpair> vphashtype;
-typedef std::unordered_map<std::pair<Vertex*,Vertex*>,Edge*,orderedvertexpairhash,orderedsamevertexpair> edgeshashtype;
-typedef std::unordered_map<unsigned int,Triangle*,idhash,sameid> triangleshashtype;
+typedef std::unordered_map<std::pair<int,int>,int,orderedvertexpairhash,orderedsamevertexpair> node_edgeshashtype;
 #elif defined(__linux__)
-typedef std::unordered_map<std::pair<Vertex*,Vertex*>,Vertex*,unorderedvertexpairhash,unorderedsamevertexpair> vphashtype;
-typedef std::unordered_map<std::pair<Vertex*,Vertex*>,Edge*,orderedvertexpairhash,orderedsamevertexpair> edgeshashtype;
-typedef std::unordered_map<unsigned int,Triangle*,idhash,sameid> triangleshashtype;
+typedef std::unordered_map<std::pair<int,int>,int,orderedvertexpairhash,orderedsamevertexpair> node_edgeshashtype;
 #elif defined(__FreeBSD__)
-typedef __gnu_cxx::hash_map<std::pair<Vertex*,Vertex*>,Vertex*,unorderedvertexpairhash,unorderedsamevertexpair> vphashtype;
-typedef __gnu_cxx::hash_map<std::pair<Vertex*,Vertex*>,Edge*,orderedvertexpairhash,orderedsamevertexpair> edgeshashtype;
-typedef __gnu_cxx::hash_map<unsigned int,Triangle*,idhash,sameid> triangleshashtype;
+typedef __gnu_cxx::hash_map<std::pair<int,int>,int,orderedvertexpairhash,orderedsamevertexpair> node_edgeshashtype;
 #else
 #endif
 
@@ -0,0 +1,115 @@
+// =======================================================================
+// hash_bench: times the edge table (flathash.h) against the node
+// based std::unordered_map table it replaced, on the directed edges of
+// real meshes.
+//
+//   ./hash_bench ../model/*.obj
+//
+// For each model and table: insert every directed edge, find every
+// edge and its opposite (like addTriangle does, so about half of the
+// lookups on a closed mesh miss only on the boundary), then erase every
+// edge.  Times are the best of a few runs, in nanoseconds per operation.
+// =======================================================================
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "mappedfile.h"
+#include "objparser.h"
+
+#define BENCH_RUNS 5
+
+// the directed edges of all triangles in the file
+static bool loadEdges(const std::string &filename, std::vector<std::pair<int,int> > &edges) {
+  MappedFile file;
+  if (!file.open(filename)) return false;
+  std::vector<ObjChunk> chunks;
+  parseObj(file.data(), file.size(), chunks);
+  int vert_offset = 0;
+  for (unsigned int i = 0; i < chunks.size(); i++) {
+    ObjChunk &chunk = chunks[i];
+    for (unsigned int j = 0; j < chunk.relative_indices.size(); j++) {
+      chunk.tris[chunk.relative_indices[j]] += vert_offset;
+    }
+    for (unsigned int j = 0; j+2 < chunk.tris.size(); j += 3) {
+      for (int k = 0; k < 3; k++) {
+        edges.push_back(std::make_pair(chunk.tris[j+k], chunk.tris[j+(k+1)%3]));
+      }
+    }
+    vert_offset += chunk.verts.size() / 3;
+  }
+  return true;
+}
+
+static double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchTimes {
+  double insert, find, erase;
+};
+
+// ns per operation, best of BENCH_RUNS
+template <class Table>
+static BenchTimes benchTable(const std::vector<std::pair<int,int> > &keys, long long &checksum) {
+  BenchTimes best = { 1e30, 1e30, 1e30 };
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    Table table;
+    double t0 = now();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+      table[keys[i]] = i;
+    }
+    double t1 = now();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+      typename Table::const_iterator itr = table.find(keys[i]);
+      if (itr != table.end()) checksum += itr->second;
+      itr = table.find(std::make_pair(keys[i].second, keys[i].first));
+      if (itr != table.end()) checksum += itr->second;
+    }
+    double t2 = now();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+      checksum += table.erase(keys[i]);
+    }
+    double t3 = now();
+    double n = std::max<double>(keys.size(), 1);
+    best.insert = std::min(best.insert, (t1-t0) * 1e9 / n);
+    best.find = std::min(best.find, (t2-t1) * 1e9 / (2*n));
+    best.erase = std::min(best.erase, (t3-t2) * 1e9 / n);
+  }
+  return best;
+}
+
+static void printRow(const char *model, const char *table, int n, const BenchTimes &node, const BenchTimes &flat) {
+  printf("%-24s %-8s %9d   insert %6.1f -> %6.1f   find %6.1f -> %6.1f   erase %6.1f -> %6.1f   (%.1fx)\n",
+         model, table, n, node.insert, flat.insert, node.find, flat.find, node.erase, flat.erase,
+         (node.insert + 2*node.find + node.erase) / (flat.insert + 2*flat.find + flat.erase));
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("usage: %s model.obj ...\n", argv[0]);
+    return 1;
+  }
+  printf("ns per operation, std::unordered_map -> flat table\n");
+  long long checksum = 0;
+  for (int i = 1; i < argc; i++) {
+    std::vector<std::pair<int,int> > edges;
+    if (!loadEdges(argv[i], edges)) {
+      printf("ERROR! CANNOT OPEN: %s\n", argv[i]);
+      continue;
+    }
+    std::string name = argv[i];
+    std::string::size_type slash = name.find_last_of("/\\");
+    if (slash != std::string::npos) name = name.substr(slash+1);
+
+    BenchTimes node = benchTable<node_edgeshashtype>(edges, checksum);
+    BenchTimes flat = benchTable<edgeshashtype>(edges, checksum);
+    printRow(name.c_str(), "edges", edges.size(), node, flat);
+  }
+  // keeps the lookups from being optimized away
+  printf("(checksum %lld)\n", checksum);
+  return 0;
+}
@@ -1,17 +1,74 @@
 #include "glCanvas.h"
 
 #include <iostream> 
+#include <chrono>
 #include "argparser.h"
 #include "mesh.h"
+#include "meshwriter.h"
+#include "batch.h"
 
 // =========================================
 // =========================================
 
+// time parsing the .obj against reading the .meshbin cache
+// e.g.  for f in ../model/*.obj; do ./mesher -input $f -benchmark_load; done
+double TimeLoad(ArgParser &args, int repeat) {
+  double best = 0;
+  for (int i = 0; i < repeat; i++) {
+    Mesh mesh(&args);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    mesh.Load(args.input_file);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || seconds < best) best = seconds;
+  }
+  return best;
+}
+
+void BenchmarkLoad(ArgParser &args) {
+  const int repeat = 5;
+  // this also (re)writes the cache
+  args.use_cache = true;
+  TimeLoad(args,1);
+  args.use_cache = false;
+  double obj_time = TimeLoad(args,repeat);
+  args.use_cache = true;
+  double cache_time = TimeLoad(args,repeat);
+  printf ("%s: obj %.4f s, meshbin %.4f s (%.1fx)\n", args.input_file.c_str(),
+          obj_time, cache_time, obj_time / cache_time);
+}
+
 int main(int argc, char *argv[]) {
   ArgParser args(argc, argv);
+  if (args.benchmark_load) {
+    BenchmarkLoad(args);
+    return 0;
+  }
+  // headless: process & write the meshes, never open a window
+  if (args.output != "") {
+    return RunBatch(args);
+  }
+  if (!args.operations.empty()) {
+    std::cout << "ERROR! -subdivide / -simplify need an -output" << std::endl;
+    return 1;
+  }
   Mesh mesh(&args);
 
   mesh.Load(args.input_file);
+  if (args.stream_output != "") {
+    MeshWriter *writer = MeshWriter::create(args.stream_output, args.ascii_ply);
+    if (writer == NULL) {
+      std::cout << "ERROR! output must be .obj or .ply: " << args.stream_output << std::endl;
+      return 1;
+    }
+    bool ok = mesh.StreamSubdivision(args.stream_levels, args.butterfly, *writer, args.stream_output);
+    delete writer;
+    return ok ? 0 : 1;
+  }
+  // a .pm input already has its collapse sequence
+  if (args.progressive && !mesh.hasProgressiveMesh()) {
+    mesh.BuildProgressiveMesh();
+    mesh.SaveProgressiveMesh(Mesh::progressiveFileName(args.input_file));
+  }
   glutInit(&argc,argv);
   GLCanvas::initialize(&args,&mesh); 
 
@@ -0,0 +1,57 @@
+#include "mappedfile.h"
+
+#include <fstream>
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+#define USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+bool MappedFile::open(const std::string &filename, bool sequential) {
+  close();
+#ifdef USE_MMAP
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+  length = st.st_size;
+  if (length > 0) {
+    void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      // read ahead (and drop what was read) only if the file is
+      // parsed front to back
+      madvise(p, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+      contents = (const char*)p;
+      ::close(fd);
+      return true;
+    }
+  }
+  ::close(fd);
+#endif
+  // empty file, or no mmap on this platform: read it into memory
+  std::ifstream istr(filename.c_str(), std::ios::binary);
+  if (!istr) return false;
+  istr.seekg(0, std::ios::end);
+  length = istr.tellg();
+  istr.seekg(0, std::ios::beg);
+  buffer.resize(length + 1);
+  istr.read(&buffer[0], length);
+  buffer[length] = '\0';
+  contents = &buffer[0];
+  return true;
+}
+
+
+void MappedFile::close() {
+  if (contents == NULL) return;
+#ifdef USE_MMAP
+  if (buffer.empty()) munmap((void*)contents, length);
+#endif
+  buffer.clear();
+  contents = NULL;
+  length = 0;
+}
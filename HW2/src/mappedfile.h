@@ -0,0 +1,51 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+
+// ====================================================================
+// Read-only view of a whole file.  On POSIX systems the file is
+// memory mapped, elsewhere it is read into a buffer.
+// ====================================================================
+
+class MappedFile {
+
+public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  MappedFile() { contents = NULL; length = 0; }
+  ~MappedFile() { close(); }
+
+  // returns false if the file cannot be opened; sequential is a hint
+  // that the file is read front to back, otherwise it is read at random
+  bool open(const std::string &filename, bool sequential = true);
+  void close();
+
+  // =========
+  // ACCESSORS
+  bool isOpen() const { return contents != NULL; }
+  const char* data() const { return contents; }
+  size_t size() const { return length; }
+
+private:
+
+  // don't use these constructors
+  MappedFile(const MappedFile&) { assert(0); exit(0); }
+  MappedFile& operator=(const MappedFile&) { assert(0); exit(0); }
+
+  // ==============
+  // REPRESENTATION
+  const char *contents;
+  size_t length;
+  // used when the file could not be mapped
+  std::vector<char> buffer;
+};
+
+// ====================================================================
+
+#endif
@@ -1,15 +1,15 @@
 #include "glCanvas.h"
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <chrono>
 
 #include "mesh.h"
-#include "edge.h"
-#include "vertex.h"
-#include "triangle.h"
+#include "meshwriter.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include "parallel.h"
+#include "vertexcache.h"
 
 
-int Triangle::next_triangle_id = 0;
-
 // helper for VBOs
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 #define MaxDis 99999
@@ -19,56 +19,85 @@ int Triangle::next_triangle_id = 0;
 // =======================================================================
 
 Mesh::~Mesh() {
-  cleanupVBOs();
-
-  // delete all the triangles
-  std::vector<Triangle*> todo;
-  for (triangleshashtype::iterator iter = triangles.begin();
-    iter != triangles.end(); iter++) {
-    Triangle *t = iter->second;
-    todo.push_back(t);
-  }
-  int num_triangles = todo.size();
-  for (int i = 0; i < num_triangles; i++) {
-    removeTriangle(todo[i]);
-  }
-  // delete all the vertices
-  int num_vertices = numVertices();
-  for (int i = 0; i < num_vertices; i++) {
-    delete vertices[i];
-  }
+  // meshes used only for processing (e.g. subdivision patches) never
+  // create buffers
+  if (vbos_initialized) cleanupVBOs();
+  // all the vertices, edges & triangles live in the arrays, nothing
+  // else to delete
 }
 
 // =======================================================================
 // MODIFIERS:   ADD & REMOVE
 // =======================================================================
 
-Vertex* Mesh::addVertex(const Vec3f &position) {
-  int index = numVertices();
-  Vertex *v = new Vertex(index, position);
-  vertices.push_back(v);
-  v->clearQ();
+int Mesh::addVertex(const Vec3f &position) {
+  int index;
+  if (!free_vertices.empty()) {
+    // reuse the slot of a vertex that was collapsed away (the version
+    // keeps counting, so old heap entries for the slot stay invalid)
+    index = free_vertices.back();
+    free_vertices.pop_back();
+    clearProgressiveMesh();
+    positions[index] = position;
+    quadrics[index].clear();
+    vertex_creases[index] = 0;
+    vertex_versions[index]++;
+    vertex_halfedge[index] = -1;
+  } else {
+    index = numVertices();
+    // the per-vertex arrays grow together, so only a reallocation of
+    // positions can raise the peak
+    bool grows = positions.size() == positions.capacity();
+    positions.push_back(position);
+    quadrics.push_back(Quadric());
+    vertex_creases.push_back(0);
+    vertex_versions.push_back(0);
+    vertex_halfedge.push_back(-1);
+    if (grows) noteMemoryUse();
+  }
   if (numVertices() == 1)
     bbox = BoundingBox(position,position);
   else 
     bbox.Extend(position);
-  return v;
+  return index;
 }
 
 
-void Mesh::addTriangle(Vertex *a, Vertex *b, Vertex *c) {
-  // create the triangle
-    Triangle* t = new Triangle();
-    // create the edges
-    Edge* ea = new Edge(a, b, t);
-    Edge* eb = new Edge(b, c, t);
-    Edge* ec = new Edge(c, a, t);
-    // point the triangle to one of its edges
-    t->setEdge(ea);
-    // connect the edges to each other
-    ea->setNext(eb);
-    eb->setNext(ec);
-    ec->setNext(ea);
+int Mesh::addTriangle(int a, int b, int c) {
+  // create the triangle in a free slot if there is one, else in the
+  // next 3 half-edges
+    // the peak can only rise when the half-edge arrays or the edge
+    // table reallocate
+    size_t capacity = he_vertex.capacity();
+    size_t edge_slots = edges.bucket_count();
+    int t;
+    if (!free_triangles.empty()) {
+      t = free_triangles.back();
+      free_triangles.pop_back();
+      clearProgressiveMesh();
+      assert (!isTriangleAlive(t));
+      he_vertex[3*t] = a;
+      he_vertex[3*t+1] = b;
+      he_vertex[3*t+2] = c;
+      for (int i = 0; i < 3; i++) {
+        he_opposite[3*t+i] = -1;
+        he_crease[3*t+i] = 0;
+        he_ok[3*t+i] = 1;
+      }
+    } else {
+      t = numTriangleSlots();
+      he_vertex.push_back(a);
+      he_vertex.push_back(b);
+      he_vertex.push_back(c);
+      for (int i = 0; i < 3; i++) {
+        he_opposite.push_back(-1);
+        he_crease.push_back(0);
+        he_ok.push_back(1);
+      }
+    }
+    int ea = 3*t;
+    int eb = ea+1;
+    int ec = ea+2;
     assert(edges.find(std::make_pair(a, b)) == edges.end());
     assert(edges.find(std::make_pair(b, c)) == edges.end());
     assert(edges.find(std::make_pair(c, a)) == edges.end());
@@ -76,36 +105,78 @@ void Mesh::addTriangle(Vertex *a, Vertex *b, Vertex *c) {
     edges[std::make_pair(a, b)] = ea;
     edges[std::make_pair(b, c)] = eb;
     edges[std::make_pair(c, a)] = ec;
+    if (he_vertex.capacity() != capacity || edges.bucket_count() != edge_slots) noteMemoryUse();
     // connect up with opposite edges (if they exist)
     edgeshashtype::iterator ea_op = edges.find(std::make_pair(b, a));
     edgeshashtype::iterator eb_op = edges.find(std::make_pair(c, b));
     edgeshashtype::iterator ec_op = edges.find(std::make_pair(a, c));
-    if (ea_op != edges.end()) { ea_op->second->setOpposite(ea); }
-    if (eb_op != edges.end()) { eb_op->second->setOpposite(eb); }
-    if (ec_op != edges.end()) { ec_op->second->setOpposite(ec); }
-    // add the triangle to the master list
-    assert(triangles.find(t->getID()) == triangles.end());
-    triangles[t->getID()] = t;
+    if (ea_op != edges.end()) { he_opposite[ea] = ea_op->second; he_opposite[ea_op->second] = ea; }
+    if (eb_op != edges.end()) { he_opposite[eb] = eb_op->second; he_opposite[eb_op->second] = eb; }
+    if (ec_op != edges.end()) { he_opposite[ec] = ec_op->second; he_opposite[ec_op->second] = ec; }
+    // a triangle that touches a vertex only with its tip makes it
+    // non-manifold, which only a full rebuild of the VBOs handles
+    if (vbos_initialized && !vbos_dirty_all) {
+      int corners[3] = { a, b, c };
+      for (int i = 0; i < 3; i++) {
+        int h = 3*t+i;
+        if (vertex_halfedge[corners[i]] >= 0 && he_opposite[h] < 0 && he_opposite[prevHalfEdge(h)] < 0)
+          markAllDirty();
+      }
+    }
+    // every vertex keeps one of its outgoing half-edges
+    if (vertex_halfedge[a] < 0) vertex_halfedge[a] = ea;
+    if (vertex_halfedge[b] < 0) vertex_halfedge[b] = eb;
+    if (vertex_halfedge[c] < 0) vertex_halfedge[c] = ec;
+    num_triangles++;
+    markTriangleDirty(t);
+    markVertexDirty(a);
+    markVertexDirty(b);
+    markVertexDirty(c);
+    return t;
 }
 
 
-void Mesh::removeTriangle(Triangle *t) {
-  Edge *ea = t->getEdge();
-  Edge *eb = ea->getNext();
-  Edge *ec = eb->getNext();
-  Vertex *a = ea->getStartVertex();
-  Vertex *b = eb->getStartVertex();
-  Vertex *c = ec->getStartVertex();
-  // remove these elements from master lists
-  edges.erase(std::make_pair(a,b)); 
-  edges.erase(std::make_pair(b,c)); 
-  edges.erase(std::make_pair(c,a)); 
-  triangles.erase(t->getID());
-  // clean up memory
-  delete ea;
-  delete eb;
-  delete ec;
-  delete t;
+void Mesh::removeTriangle(int t) {
+  assert (isTriangleAlive(t));
+  // the recorded collapses expect the free slots in their own order
+  clearProgressiveMesh();
+  // taking a triangle out of the middle of an open fan leaves a
+  // non-manifold vertex, which only a full rebuild of the VBOs handles
+  if (vbos_initialized && !vbos_dirty_all) {
+    std::vector<int> outgoing;
+    for (int i = 0; i < 3; i++) {
+      int h = 3*t+i;
+      if (he_opposite[h] >= 0 && he_opposite[prevHalfEdge(h)] >= 0 && !getOutgoingHalfEdges(he_vertex[h], outgoing))
+        markAllDirty();
+    }
+  }
+  markTriangleDirty(t);
+  for (int i = 0; i < 3; i++) {
+    int h = 3*t+i;
+    int v = he_vertex[h];
+    markVertexDirty(v);
+    // remove these elements from master lists
+    edges.erase(std::make_pair(v,endVertex(h)));
+    // move the vertex to another of its outgoing half-edges
+    if (vertex_halfedge[v] == h) {
+      int other = he_opposite[prevHalfEdge(h)];
+      if (other < 0 && he_opposite[h] >= 0) other = nextHalfEdge(he_opposite[h]);
+      vertex_halfedge[v] = other;
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    int h = 3*t+i;
+    // disconnect from the opposite edge
+    if (he_opposite[h] >= 0) he_opposite[he_opposite[h]] = -1;
+  }
+  for (int i = 0; i < 3; i++) {
+    int h = 3*t+i;
+    he_vertex[h] = -1;
+    he_opposite[h] = -1;
+    he_crease[h] = 0;
+  }
+  num_triangles--;
+  free_triangles.push_back(t);
 }
 
 
@@ -113,21 +184,79 @@ void Mesh::removeTriangle(Triangle *t) {
 // Helper functions for accessing data in the hash table
 // =======================================================================
 
-Edge* Mesh::getMeshEdge(Vertex *a, Vertex *b) const {
+int Mesh::getMeshEdge(int a, int b) const {
   edgeshashtype::const_iterator iter = edges.find(std::make_pair(a,b));
-  if (iter == edges.end()) return NULL;
+  if (iter == edges.end()) return -1;
   return iter->second;
 }
 
-Vertex* Mesh::getChildVertex(Vertex *p1, Vertex *p2) const {
-  vphashtype::const_iterator iter = vertex_parents.find(std::make_pair(p1,p2)); 
-  if (iter == vertex_parents.end()) return NULL;
-  return iter->second; 
+
+// =======================================================================
+// One-ring circulation
+// =======================================================================
+
+bool Mesh::getOutgoingHalfEdges(int v, std::vector<int> &outgoing) const {
+  outgoing.clear();
+  int start = vertex_halfedge[v];
+  if (start < 0) return false;
+  // turn around the vertex through the opposite of the previous half-edge
+  int h = start;
+  while (1) {
+    outgoing.push_back(h);
+    h = he_opposite[prevHalfEdge(h)];
+    if (h == start) return true;
+    if (h < 0) break;
+  }
+  // hit the boundary, go back the other way from the start
+  h = start;
+  while (1) {
+    int o = he_opposite[h];
+    if (o < 0) break;
+    h = nextHalfEdge(o);
+    if (h == start) break;
+    outgoing.push_back(h);
+  }
+  return false;
+}
+
+void Mesh::getOneRing(int v, std::vector<int> &ring) const {
+  ring.clear();
+  std::vector<int> outgoing;
+  getOutgoingHalfEdges(v, outgoing);
+  for (unsigned int i = 0; i < outgoing.size(); i++) {
+    int h = outgoing[i];
+    ring.push_back(endVertex(h));
+    // the incoming boundary half-edge has no outgoing twin
+    int p = prevHalfEdge(h);
+    if (he_opposite[p] < 0) ring.push_back(he_vertex[p]);
+  }
 }
 
-void Mesh::setParentsChild(Vertex *p1, Vertex *p2, Vertex *child) {
-  // assert (vertex_parents.find(std::make_pair(p1,p2)) == vertex_parents.end());
-  vertex_parents[std::make_pair(p1,p2)] = child; 
+
+// =======================================================================
+// the output is written through a MeshWriter (.obj or .ply); removed
+// vertices & triangles leave no holes in the file
+// =======================================================================
+
+bool Mesh::Save(MeshWriter &writer, const std::string &output_file) const {
+  std::vector<int> new_index(numVertices(), -1);
+  int num_live = 0;
+  for (int v = 0; v < numVertices(); v++) {
+    if (isVertexAlive(v)) new_index[v] = num_live++;
+  }
+  if (!writer.begin(output_file, num_live, numTriangles())) return false;
+  for (int v = 0; v < numVertices(); v++) {
+    if (isVertexAlive(v)) writer.addVertex(positions[v]);
+  }
+  for (int t = 0; t < numTriangleSlots(); t++) {
+    if (!isTriangleAlive(t)) continue;
+    int a = new_index[he_vertex[3*t]];
+    int b = new_index[he_vertex[3*t+1]];
+    int c = new_index[he_vertex[3*t+2]];
+    assert (a >= 0 && b >= 0 && c >= 0);
+    writer.addTriangle(a,b,c);
+  }
+  return writer.end();
 }
 
 
@@ -137,80 +266,222 @@ void Mesh::setParentsChild(Vertex *p1, Vertex *p2, Vertex *child) {
 // of crease weights on the edges.
 // =======================================================================
 
-#define MAX_CHAR_PER_LINE 200
-
 void Mesh::Load(const std::string &input_file) {
 
-  std::ifstream istr(input_file.c_str());
-  if (!istr) {
+  // a progressive mesh file (see progressivemesh.cpp) holds everything
+  std::string::size_type dot = input_file.rfind('.');
+  if (dot != std::string::npos && input_file.substr(dot) == ".pm") {
+    if (!LoadProgressiveMesh(input_file))
+      std::cout << "ERROR! CANNOT OPEN: " << input_file << std::endl;
+    return;
+  }
+
+  // a binary cache of a previous load is used if it is still up to date
+  std::string cache_file = cacheFileName(input_file);
+  // (the cache is in file order, the -reorder option is applied after it)
+  if (args->use_cache && numVertices() == 0 && LoadCache(cache_file,input_file)) {
+    applyReorderOption();
+    return;
+  }
+
+  MappedFile file;
+  if (!file.open(input_file)) {
     std::cout << "ERROR! CANNOT OPEN: " << input_file << std::endl;
     return;
   }
 
-  char line[MAX_CHAR_PER_LINE];
-  std::string token, token2;
-  float x,y,z;
-  int a,b,c;
-  int index = 0;
-  int vert_count = 0;
-  int vert_index = 1;
-
-  // read in each line of the file
-  while (istr.getline(line,MAX_CHAR_PER_LINE)) { 
-    // put the line into a stringstream for parsing
-    std::stringstream ss;
-    ss << line;
-
-    // check for blank line
-    token = "";   
-    ss >> token;
-    if (token == "") continue;
-
-    if (token == std::string("usemtl") ||token == std::string("g")) {
-      vert_index = 1; 
-      index++;
-    } else if (token == std::string("v")) {
-      vert_count++;
-      ss >> x >> y >> z;
-      addVertex(Vec3f(x,y,z));
-    } else if (token == std::string("f")) {
-      a = b = c = -1;
-      ss >> a >> b >> c;
-      a -= vert_index;
-      b -= vert_index;
-      c -= vert_index;
-      assert (a >= 0 && a < numVertices());
-      assert (b >= 0 && b < numVertices());
-      assert (c >= 0 && c < numVertices());
-      addTriangle(getVertex(a),getVertex(b),getVertex(c));
-    } else if (token == std::string("e")) {
-      a = b = -1;
-      ss >> a >> b >> token2;
+  // parse the file in parallel chunks
+  std::vector<ObjChunk> chunks;
+  parseObj(file.data(), file.size(), chunks);
+
+  // merge the chunks in file order
+  int total_verts = numVertices();
+  int total_tris = 0;
+  for (unsigned int i = 0; i < chunks.size(); i++) {
+    total_verts += chunks[i].verts.size() / 3;
+    total_tris += chunks[i].tris.size() / 3;
+  }
+  positions.reserve(total_verts);
+  quadrics.reserve(total_verts);
+  vertex_creases.reserve(total_verts);
+  vertex_versions.reserve(total_verts);
+  vertex_halfedge.reserve(total_verts);
+  he_vertex.reserve(he_vertex.size() + 3*total_tris);
+
+  for (unsigned int i = 0; i < chunks.size(); i++) {
+    ObjChunk &chunk = chunks[i];
+    int vert_offset = numVertices();
+    for (unsigned int j = 0; j+2 < chunk.verts.size(); j += 3) {
+      addVertex(Vec3f(chunk.verts[j],chunk.verts[j+1],chunk.verts[j+2]));
+    }
+    for (unsigned int j = 0; j < chunk.relative_indices.size(); j++) {
+      chunk.tris[chunk.relative_indices[j]] += vert_offset;
+    }
+    for (unsigned int j = 0; j < chunk.tris.size(); j++) {
+      assert (chunk.tris[j] >= 0 && chunk.tris[j] < numVertices());
+      he_vertex.push_back(chunk.tris[j]);
+    }
+    if (chunk.num_unknown_lines > 0) {
+      printf ("skipped %d unknown lines\n", chunk.num_unknown_lines);
+    }
+  }
+
+  // pair up all the half-edges at once
+  buildConnectivity();
+
+  // the crease weights
+  for (unsigned int i = 0; i < chunks.size(); i++) {
+    for (unsigned int j = 0; j < chunks[i].creases.size(); j++) {
+      int a = chunks[i].creases[j].a;
+      int b = chunks[i].creases[j].b;
       // whoops: inconsistent file format, don't subtract 1
       assert (a >= 0 && a <= numVertices());
       assert (b >= 0 && b <= numVertices());
-      if (token2 == std::string("inf")) x = 1000000; // this is close to infinity...
-      x = atof(token2.c_str());
-      Vertex *va = getVertex(a);
-      Vertex *vb = getVertex(b);
-      Edge *ab = getMeshEdge(va,vb);
-      Edge *ba = getMeshEdge(vb,va);
-      assert (ab != NULL);
-      assert (ba != NULL);
-      ab->setCrease(x);
-      ba->setCrease(x);
+      int ab = getMeshEdge(a,b);
+      int ba = getMeshEdge(b,a);
+      assert (ab >= 0);
+      assert (ba >= 0);
+      he_crease[ab] = chunks[i].creases[j].crease;
+      he_crease[ba] = chunks[i].creases[j].crease;
       //计算入度
-      va->setS(va->getS() + 1);
-      vb->setS(vb->getS() + 1);
-    } else if (token == std::string("vt")) {
-    } else if (token == std::string("vn")) {
-    } else if (token[0] == '#') {
-    } else {
-      printf ("LINE: '%s'",line);
+      vertex_creases[a]++;
+      vertex_creases[b]++;
     }
   }
 
   getAllQ();
+
+  if (args->use_cache)
+    SaveCache(cache_file,input_file);
+  applyReorderOption();
+}
+
+
+void Mesh::LoadTriangles(const std::vector<Vec3f> &verts, const std::vector<int> &tris) {
+  assert (numVertices() == 0);
+  positions.reserve(verts.size());
+  quadrics.reserve(verts.size());
+  vertex_creases.reserve(verts.size());
+  vertex_versions.reserve(verts.size());
+  vertex_halfedge.reserve(verts.size());
+  for (unsigned int i = 0; i < verts.size(); i++) {
+    addVertex(verts[i]);
+  }
+  he_vertex.assign(tris.begin(), tris.end());
+  buildConnectivity();
+  getAllQ();
+  applyReorderOption();
+}
+
+
+// =======================================================================
+// bulk construction of the adjacency: instead of looking up every
+// half-edge in the hash table as it is added, all half-edges are sorted
+// by their (unordered) vertex pair, so twins end up next to each other
+// =======================================================================
+
+void Mesh::buildConnectivity() {
+  int num_half_edges = he_vertex.size();
+  he_opposite.assign(num_half_edges, -1);
+  he_crease.assign(num_half_edges, 0);
+  he_ok.assign(num_half_edges, 1);
+  std::fill(vertex_halfedge.begin(), vertex_halfedge.end(), -1);
+
+  std::vector<std::pair<unsigned long long,int> > keys;
+  keys.reserve(num_half_edges);
+  num_triangles = 0;
+  free_triangles.clear();
+  for (int h = 0; h < num_half_edges; h++) {
+    int a = he_vertex[h];
+    if (a < 0) {
+      if (h % 3 == 0) free_triangles.push_back(h / 3);
+      continue;
+    }
+    if (h % 3 == 0) num_triangles++;
+    int b = endVertex(h);
+    unsigned long long lo = std::min(a,b);
+    unsigned long long hi = std::max(a,b);
+    keys.push_back(std::make_pair((lo << 32) | hi, h));
+    if (vertex_halfedge[a] < 0) vertex_halfedge[a] = h;
+  }
+  std::sort(keys.begin(), keys.end());
+
+  // exactly two half-edges running in opposite directions are twins,
+  // anything else (non-manifold) is left as boundary
+  for (unsigned int i = 0; i < keys.size(); ) {
+    unsigned int j = i+1;
+    while (j < keys.size() && keys[j].first == keys[i].first) j++;
+    if (j == i+2) {
+      int h0 = keys[i].second;
+      int h1 = keys[i+1].second;
+      if (he_vertex[h0] == endVertex(h1)) {
+        he_opposite[h0] = h1;
+        he_opposite[h1] = h0;
+      }
+    }
+    i = j;
+  }
+
+  buildEdgeIndex();
+}
+
+
+// the directed edge index used by getMeshEdge
+void Mesh::buildEdgeIndex() {
+  int num_half_edges = he_vertex.size();
+  edges.clear();
+  edges.reserve(3*num_triangles);
+  for (int h = 0; h < num_half_edges; h++) {
+    if (he_vertex[h] < 0) continue;
+    edges[std::make_pair(he_vertex[h], endVertex(h))] = h;
+  }
+  noteMemoryUse();
+  // the whole mesh is new, the VBOs are rebuilt from scratch
+  markAllDirty();
+}
+
+
+// =======================================================================
+// MEMORY STATISTICS
+// =======================================================================
+
+template <class T>
+static size_t vectorBytes(const std::vector<T> &v) {
+  return v.capacity() * sizeof(T);
+}
+
+size_t Mesh::memoryBytes() const {
+  return vectorBytes(positions) + vectorBytes(quadrics) + vectorBytes(vertex_creases)
+    + vectorBytes(vertex_versions) + vectorBytes(vertex_halfedge)
+    + vectorBytes(he_vertex) + vectorBytes(he_opposite) + vectorBytes(he_crease) + vectorBytes(he_ok)
+    + vectorBytes(free_triangles) + vectorBytes(free_vertices)
+    + vectorBytes(collapse_candidates) + vectorBytes(candidate_slot)
+    + vectorBytes(pm_splits) + vectorBytes(allPairs)
+    + vectorBytes(vbo_tri_slot) + vectorBytes(vbo_vertex_first) + vectorBytes(vbo_vertex_count)
+    + vectorBytes(vbo_edge_class) + vectorBytes(vbo_edge_slot)
+    + vectorBytes(dirty_triangles) + vectorBytes(dirty_vertices)
+    + edges.memoryBytes();
+}
+
+MeshMemoryStats Mesh::getMemoryStats() const {
+  MeshMemoryStats stats;
+  stats.live_vertices = numVertices() - free_vertices.size();
+  stats.vertex_slots = numVertices();
+  stats.live_triangles = numTriangles();
+  stats.triangle_slots = numTriangleSlots();
+  stats.bytes = memoryBytes();
+  stats.peak_bytes = std::max(peak_bytes, stats.bytes);
+  stats.edge_entries = edges.size();
+  stats.edge_slots = edges.bucket_count();
+  stats.edge_probe_length = edges.averageProbeLength();
+  return stats;
+}
+
+void Mesh::printMemoryStats() const {
+  MeshMemoryStats stats = getMemoryStats();
+  printf("vertices %d live / %d slots, triangles %d live / %d slots, %.1f MB (peak %.1f MB)\n",
+         stats.live_vertices, stats.vertex_slots, stats.live_triangles, stats.triangle_slots,
+         stats.bytes / 1048576.0, stats.peak_bytes / 1048576.0);
 }
 
 
@@ -238,6 +509,7 @@ void Mesh::initializeVBOs() {
   glGenBuffers(1, &mesh_boundary_edge_indices_VBO);
   glGenBuffers(1, &mesh_crease_edge_indices_VBO);
   glGenBuffers(1, &mesh_other_edge_indices_VBO);
+  vbos_initialized = true;
   setupVBOs();
 }
 
@@ -245,49 +517,60 @@ void Mesh::setupVBOs() {
   HandleGLError("in setup mesh VBOs");
   setupTriVBOs();
   setupEdgeVBOs();
+  vbos_dirty_all = false;
+  dirty_triangles.clear();
+  dirty_vertices.clear();
   HandleGLError("leaving setup mesh");
 }
 
 
-void Mesh::setupTriVBOs() {
-
-  VBOTriVert* mesh_tri_verts;
-  VBOTri* mesh_tri_indices;
-  unsigned int num_tris = triangles.size();
-
-  // allocate space for the data
-  mesh_tri_verts = new VBOTriVert[num_tris*3];
-  mesh_tri_indices = new VBOTri[num_tris];
-
-  // write the vertex & triangle data
-  unsigned int i = 0;
-  triangleshashtype::iterator iter = triangles.begin();
-  for (; iter != triangles.end(); iter++,i++) {
-    Triangle *t = iter->second;
-    Vec3f a = (*t)[0]->getPos();
-    Vec3f b = (*t)[1]->getPos();
-    Vec3f c = (*t)[2]->getPos();
-    
-    if (args->gouraud) {
-
+// the buffers get room to grow, so that updateVBOs can add records in
+// place for a while
+static int vboCapacity(int n) {
+  return n + n/4 + 256;
+}
 
-      // =====================================
-      // ASSIGNMENT: reimplement 
-      Vec3f normal = ComputeNormal(a,b,c);
-      mesh_tri_verts[i*3]   = VBOTriVert(a,normal);
-      mesh_tri_verts[i*3+1] = VBOTriVert(b,normal);
-      mesh_tri_verts[i*3+2] = VBOTriVert(c,normal);
-      // =====================================
 
+void Mesh::setupTriVBOs() {
 
-    } else {
+  std::vector<VBOTriVert> mesh_tri_verts;
+  std::vector<unsigned int> mesh_tri_indices;
+  unsigned int num_tris = numTriangles();
+  int tri_capacity = vboCapacity(num_tris);
+  vbo_gouraud = args->gouraud;
+  vbo_tri_slot.assign(numTriangleSlots(), -1);
+
+  if (args->gouraud) {
+    buildSmoothTriangleVertices(mesh_tri_verts, mesh_tri_indices);
+    vbo_render_capacity = vboCapacity(mesh_tri_verts.size());
+  } else {
+    // flat shading: 3 vertices of its own for every triangle
+    vbo_vertex_first.clear();
+    vbo_vertex_count.clear();
+    mesh_tri_verts.reserve(num_tris*3);
+    mesh_tri_indices.reserve(num_tris*3);
+    int num_slots = numTriangleSlots();
+    for (int t = 0; t < num_slots; t++) {
+      if (!isTriangleAlive(t)) continue;
+      vbo_tri_slot[t] = mesh_tri_indices.size() / 3;
+      Vec3f a = positions[he_vertex[3*t]];
+      Vec3f b = positions[he_vertex[3*t+1]];
+      Vec3f c = positions[he_vertex[3*t+2]];
       Vec3f normal = ComputeNormal(a,b,c);
-      mesh_tri_verts[i*3]   = VBOTriVert(a,normal);
-      mesh_tri_verts[i*3+1] = VBOTriVert(b,normal);
-      mesh_tri_verts[i*3+2] = VBOTriVert(c,normal);
+      mesh_tri_indices.push_back(mesh_tri_verts.size());
+      mesh_tri_verts.push_back(VBOTriVert(a,normal));
+      mesh_tri_indices.push_back(mesh_tri_verts.size());
+      mesh_tri_verts.push_back(VBOTriVert(b,normal));
+      mesh_tri_indices.push_back(mesh_tri_verts.size());
+      mesh_tri_verts.push_back(VBOTriVert(c,normal));
     }
-    mesh_tri_indices[i] = VBOTri(i*3,i*3+1,i*3+2);
+    vbo_render_capacity = 3 * tri_capacity;
+    vbo_nonmanifold = false;
   }
+  assert (mesh_tri_indices.size() == num_tris*3);
+  vbo_render_verts = mesh_tri_verts.size();
+  vbo_render_garbage = 0;
+  vbo_tri_slots.reset(num_tris, tri_capacity);
 
   // cleanup old buffer data (if any)
   glDeleteBuffers(1, &mesh_tri_verts_VBO);
@@ -296,87 +579,212 @@ void Mesh::setupTriVBOs() {
   // copy the data to each VBO
   glBindBuffer(GL_ARRAY_BUFFER,mesh_tri_verts_VBO); 
   glBufferData(GL_ARRAY_BUFFER,
-	       sizeof(VBOTriVert) * num_tris * 3,
-	       mesh_tri_verts,
-	       GL_STATIC_DRAW); 
+	       sizeof(VBOTriVert) * vbo_render_capacity,
+	       NULL,
+	       GL_DYNAMIC_DRAW); 
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+		  sizeof(VBOTriVert) * mesh_tri_verts.size(),
+		  mesh_tri_verts.data());
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh_tri_indices_VBO); 
   glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	       sizeof(VBOTri) * num_tris,
-	       mesh_tri_indices, GL_STATIC_DRAW);
+	       sizeof(VBOTri) * tri_capacity,
+	       NULL, GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0,
+		  sizeof(unsigned int) * mesh_tri_indices.size(),
+		  mesh_tri_indices.data());
+}
 
-  delete [] mesh_tri_verts;
-  delete [] mesh_tri_indices;
 
+int Mesh::getSmoothingGroups(int v, std::vector<int> &corners, std::vector<int> &groups) const {
+  corners.clear();
+  groups.clear();
+  int start = vertex_halfedge[v];
+  if (start < 0) return 0;
+  // start at the boundary, or at a crease if the fan is closed, so that
+  // every group is one run of corners
+  int h = start;
+  int first = -1;
+  int crease_corner = -1;
+  while (1) {
+    // the corner before h is across half-edge h
+    if (crease_corner < 0 && he_crease[h] > 0) crease_corner = h;
+    int o = he_opposite[h];
+    if (o < 0) { first = h; break; }
+    h = nextHalfEdge(o);
+    if (h == start) { first = (crease_corner >= 0) ? crease_corner : start; break; }
+  }
+  int group = 0;
+  h = first;
+  while (1) {
+    corners.push_back(h);
+    groups.push_back(group);
+    int p = prevHalfEdge(h);
+    int n = he_opposite[p];
+    if (n < 0 || n == first) break;
+    if (he_crease[p] > 0) group++;
+    h = n;
+  }
+  return group + 1;
 }
 
 
-void Mesh::setupEdgeVBOs() {
+// Gouraud shading with shared vertices.  The corners around a mesh
+// vertex are split into smoothing groups at crease edges (& at the
+// boundary), and every group becomes one render vertex whose normal is
+// the area weighted average of the normals of its triangles.  Without
+// creases that is one render vertex per mesh vertex, about 1/6 of the
+// 3 per triangle of the flat path.  The triangles are then reordered
+// for the vertex cache of the GPU and the vertices by first use (the
+// groups of a mesh vertex stay together, so updateVBOs can find them).
+void Mesh::buildSmoothTriangleVertices(std::vector<VBOTriVert> &verts, std::vector<unsigned int> &indices) {
+  int num_slots = numTriangleSlots();
+  int num_verts = positions.size();
+
+  // face normals, the length is twice the area
+  std::vector<Vec3f> face_normals(num_slots);
+  parallelFor(num_slots, [&](int begin, int end) {
+    for (int t = begin; t < end; t++) {
+      if (!isTriangleAlive(t)) continue;
+      const Vec3f &a = positions[he_vertex[3*t]];
+      Vec3f::Cross3(face_normals[t], positions[he_vertex[3*t+1]] - a, positions[he_vertex[3*t+2]] - a);
+    }
+  });
+
+  // number the render vertices: the groups of vertex v start at
+  // vertex_offset[v]
+  std::vector<int> vertex_offset(num_verts+1, 0);
+  parallelFor(num_verts, [&](int begin, int end) {
+    std::vector<int> corners, groups;
+    for (int v = begin; v < end; v++) {
+      vertex_offset[v+1] = getSmoothingGroups(v, corners, groups);
+    }
+  });
+  for (int v = 0; v < num_verts; v++) vertex_offset[v+1] += vertex_offset[v];
+
+  // sum up the face normals of every group
+  std::vector<int> corner_vertex(he_vertex.size(), -1);
+  verts.resize(vertex_offset[num_verts]);
+  parallelFor(num_verts, [&](int begin, int end) {
+    std::vector<int> corners, groups;
+    std::vector<Vec3f> normals;
+    for (int v = begin; v < end; v++) {
+      int count = getSmoothingGroups(v, corners, groups);
+      if (count == 0) continue;
+      normals.assign(count, Vec3f(0,0,0));
+      for (unsigned int i = 0; i < corners.size(); i++) {
+        normals[groups[i]] += face_normals[corners[i]/3];
+        corner_vertex[corners[i]] = vertex_offset[v] + groups[i];
+      }
+      for (int g = 0; g < count; g++) {
+        normals[g].Normalize();
+        verts[vertex_offset[v] + g] = VBOTriVert(positions[v], normals[g]);
+      }
+    }
+  });
+
+  // a corner the walk did not reach (a non-manifold vertex) gets a
+  // vertex of its own with the face normal
+  int num_grouped = verts.size();
+  std::vector<int> triangles;
+  indices.clear();
+  indices.reserve(3*numTriangles());
+  for (int t = 0; t < num_slots; t++) {
+    if (!isTriangleAlive(t)) continue;
+    triangles.push_back(t);
+    for (int k = 0; k < 3; k++) {
+      int h = 3*t+k;
+      if (corner_vertex[h] < 0) {
+        Vec3f normal = face_normals[t];
+        normal.Normalize();
+        corner_vertex[h] = verts.size();
+        verts.push_back(VBOTriVert(positions[he_vertex[h]], normal));
+      }
+      indices.push_back(corner_vertex[h]);
+    }
+  }
+
+  std::vector<int> order;
+  optimizeVertexCache(indices, verts.size(), &order);
+  for (unsigned int i = 0; i < order.size(); i++) {
+    vbo_tri_slot[triangles[order[i]]] = i;
+  }
+
+  // the first use order of the mesh vertices (& of the extra vertices,
+  // numbered after them), then their groups in that order
+  std::vector<unsigned int> owners(indices.size());
+  std::vector<int> owner_of(verts.size());
+  for (int v = 0; v < num_verts; v++) {
+    for (int r = vertex_offset[v]; r < vertex_offset[v+1]; r++) owner_of[r] = v;
+  }
+  for (unsigned int r = num_grouped; r < verts.size(); r++) {
+    owner_of[r] = num_verts + (r - num_grouped);
+  }
+  for (unsigned int i = 0; i < indices.size(); i++) owners[i] = owner_of[indices[i]];
+  std::vector<int> owner_index;
+  int num_owners = num_verts + (verts.size() - num_grouped);
+  reorderVerticesByFirstUse(owners, num_owners, owner_index);
+  std::vector<int> owner_order(num_owners, -1);
+  for (int o = 0; o < num_owners; o++) {
+    if (owner_index[o] >= 0) owner_order[owner_index[o]] = o;
+  }
 
-  VBOVert* mesh_verts;
-  VBOEdge* mesh_boundary_edge_indices;
-  VBOEdge* mesh_crease_edge_indices;
-  VBOEdge* mesh_other_edge_indices;
-
-  mesh_boundary_edge_indices = NULL;
-  mesh_crease_edge_indices = NULL;
-  mesh_other_edge_indices = NULL;
-
-  unsigned int num_verts = vertices.size();
-
-  // first count the edges of each type
-  num_boundary_edges = 0;
-  num_crease_edges = 0;
-  num_other_edges = 0;
-  for (edgeshashtype::iterator iter = edges.begin();
-       iter != edges.end(); iter++) {
-    Edge *e = iter->second;
-    int a = e->getStartVertex()->getIndex();
-    int b = e->getEndVertex()->getIndex();
-    if (e->getOpposite() == NULL) {
-      num_boundary_edges++;
+  vbo_vertex_first.assign(num_verts, -1);
+  vbo_vertex_count.assign(num_verts, 0);
+  std::vector<int> new_index(verts.size(), -1);
+  int next = 0;
+  for (int i = 0; i < num_owners && owner_order[i] >= 0; i++) {
+    int o = owner_order[i];
+    if (o < num_verts) {
+      vbo_vertex_first[o] = next;
+      vbo_vertex_count[o] = vertex_offset[o+1] - vertex_offset[o];
+      for (int r = vertex_offset[o]; r < vertex_offset[o+1]; r++) new_index[r] = next++;
     } else {
-      if (a < b) continue; // don't double count edges!
-      if (e->getCrease() > 0) num_crease_edges++;
-      else num_other_edges++;
+      new_index[num_grouped + (o - num_verts)] = next++;
     }
   }
+  // every group has at least one corner, so every vertex is used
+  assert (next == (int)verts.size());
+  vbo_nonmanifold = (num_grouped < (int)verts.size());
+  std::vector<VBOTriVert> ordered(verts.size());
+  for (unsigned int r = 0; r < verts.size(); r++) ordered[new_index[r]] = verts[r];
+  verts.swap(ordered);
+  for (unsigned int i = 0; i < indices.size(); i++) indices[i] = new_index[indices[i]];
+}
+
 
-  // allocate space for the data
-  mesh_verts = new VBOVert[num_verts];
-  if (num_boundary_edges > 0)
-    mesh_boundary_edge_indices = new VBOEdge[num_boundary_edges];
-  if (num_crease_edges > 0)
-    mesh_crease_edge_indices = new VBOEdge[num_crease_edges];
-  if (num_other_edges > 0)
-    mesh_other_edge_indices = new VBOEdge[num_other_edges];
+int Mesh::edgeClass(int h) const {
+  int a = he_vertex[h];
+  if (a < 0) return -1; // removed triangle
+  if (he_opposite[h] < 0) return 0;
+  if (a < endVertex(h)) return -1; // don't double count edges!
+  return (he_crease[h] > 0) ? 1 : 2;
+}
+
+
+void Mesh::setupEdgeVBOs() {
+
+  std::vector<VBOVert> mesh_verts;
+  std::vector<VBOEdge> edge_indices[3];
+
+  unsigned int num_verts = positions.size();
+  int num_half_edges = he_vertex.size();
 
   // write the vertex data
+  mesh_verts.reserve(num_verts);
   for (unsigned int i = 0; i < num_verts; i++) {
-    mesh_verts[i] = VBOVert(vertices[i]->getPos());
+    mesh_verts.push_back(VBOVert(positions[i]));
   }
 
-  // write the edge data
-  int bi = 0;
-  int ci = 0;
-  int oi = 0; 
-  for (edgeshashtype::iterator iter = edges.begin();
-       iter != edges.end(); iter++) {
-    Edge *e = iter->second;
-    int a = e->getStartVertex()->getIndex();
-    int b = e->getEndVertex()->getIndex();
-    if (e->getOpposite() == NULL) {
-      mesh_boundary_edge_indices[bi++] = VBOEdge(a,b);
-    } else {
-      if (a < b) continue; // don't double count edges!
-      if (e->getCrease() > 0) 
-	mesh_crease_edge_indices[ci++] = VBOEdge(a,b);
-      else 
-	mesh_other_edge_indices[oi++] = VBOEdge(a,b);
-    }
+  // write the edge data: boundary, crease & other edges
+  vbo_edge_class.assign(num_half_edges, -1);
+  vbo_edge_slot.assign(num_half_edges, -1);
+  for (int e = 0; e < num_half_edges; e++) {
+    int c = edgeClass(e);
+    if (c < 0) continue;
+    vbo_edge_class[e] = c;
+    vbo_edge_slot[e] = edge_indices[c].size();
+    edge_indices[c].push_back(VBOEdge(he_vertex[e],endVertex(e)));
   }
-  assert (bi == num_boundary_edges);
-  assert (ci == num_crease_edges);
-  assert (oi == num_other_edges);
 
   // cleanup old buffer data (if any)
   glDeleteBuffers(1, &mesh_verts_VBO);
@@ -385,35 +793,30 @@ void Mesh::setupEdgeVBOs() {
   glDeleteBuffers(1, &mesh_other_edge_indices_VBO);
 
   // copy the data to each VBO
+  vbo_verts_capacity = vboCapacity(num_verts);
   glBindBuffer(GL_ARRAY_BUFFER,mesh_verts_VBO); 
   glBufferData(GL_ARRAY_BUFFER,
-	       sizeof(VBOVert) * num_verts,
-	       mesh_verts,
-	       GL_STATIC_DRAW); 
-
-  if (num_boundary_edges > 0) {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh_boundary_edge_indices_VBO); 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		 sizeof(VBOEdge) * num_boundary_edges,
-		 mesh_boundary_edge_indices, GL_STATIC_DRAW);
-  }
-  if (num_crease_edges > 0) {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh_crease_edge_indices_VBO); 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		 sizeof(VBOEdge) * num_crease_edges,
-		 mesh_crease_edge_indices, GL_STATIC_DRAW);
-  }
-  if (num_other_edges > 0) {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh_other_edge_indices_VBO); 
+	       sizeof(VBOVert) * vbo_verts_capacity,
+	       NULL,
+	       GL_DYNAMIC_DRAW); 
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+		  sizeof(VBOVert) * num_verts,
+		  mesh_verts.data());
+
+  GLuint edge_VBOs[3] = { mesh_boundary_edge_indices_VBO, mesh_crease_edge_indices_VBO, mesh_other_edge_indices_VBO };
+  for (int c = 0; c < 3; c++) {
+    int count = edge_indices[c].size();
+    vbo_edge_slots[c].reset(count, vboCapacity(count));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,edge_VBOs[c]); 
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		 sizeof(VBOEdge) * num_other_edges,
-		 mesh_other_edge_indices, GL_STATIC_DRAW);
+		 sizeof(VBOEdge) * vbo_edge_slots[c].capacity,
+		 NULL, GL_DYNAMIC_DRAW);
+    if (count > 0) {
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0,
+		      sizeof(VBOEdge) * count,
+		      edge_indices[c].data());
+    }
   }
-
-  delete [] mesh_verts;
-  delete [] mesh_boundary_edge_indices;
-  delete [] mesh_crease_edge_indices;
-  delete [] mesh_other_edge_indices;
 }
 
 
@@ -446,7 +849,8 @@ void Mesh::drawVBOs() {
 
   // ======================
   // draw all the triangles
-  unsigned int num_tris = triangles.size();
+  // (the triangle slots include the degenerate tombstones left by updateVBOs)
+  unsigned int num_tris = vbo_tri_slots.count;
   glColor3f(1,1,1);
 
   // select the vertex buffer
@@ -489,7 +893,7 @@ void Mesh::drawVBOs() {
     // select the index buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_boundary_edge_indices_VBO);
     // draw this data
-    glDrawElements(GL_LINES, num_boundary_edges*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+    glDrawElements(GL_LINES, vbo_edge_slots[0].count*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
 
     // draw all the interior, crease edges
     glLineWidth(3);
@@ -497,7 +901,7 @@ void Mesh::drawVBOs() {
     // select the index buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_crease_edge_indices_VBO);
     // draw this data
-    glDrawElements(GL_LINES, num_crease_edges*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+    glDrawElements(GL_LINES, vbo_edge_slots[1].count*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
 
     // draw all the interior, non-crease edges
     glLineWidth(1);
@@ -505,7 +909,7 @@ void Mesh::drawVBOs() {
     // select the index buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_other_edge_indices_VBO);
     // draw this data
-    glDrawElements(GL_LINES, num_other_edges*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+    glDrawElements(GL_LINES, vbo_edge_slots[2].count*2, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
 
     glDisableClientState(GL_VERTEX_ARRAY);
   }
@@ -517,388 +921,474 @@ void Mesh::drawVBOs() {
 // SUBDIVISION
 // =================================================================
 
-void Mesh::LoopSubdivision() {
-  printf ("Subdivide the mesh!\n");
-    //strp1:对边进行分类
-    for (edgeshashtype::iterator iterVType = edges.begin(); iterVType != edges.end(); iterVType++) {
-        Edge* eVType = iterVType->second;
-        Vertex* v1 = eVType->getStartVertex();
-        if (v1->getS() == 0) {
-          v1->setVertexType(smooth);
+// 细分规则都写成“顶点编号+权重”的形式（模板Sink），同一套规则既可以
+// 直接算出新位置（PointSink），也可以记录成StencilTable的一行
+struct PointSink {
+  PointSink(const std::vector<Vec3f> &p) : positions(p) {}
+  void add(int i, double w) { sum += positions[i] * w; }
+  const std::vector<Vec3f> &positions;
+  Vec3f sum;
+};
+
+int Mesh::addEdgeChildren(std::vector<int> &edge_child) {
+    //两个方向的半边共用一个新顶点：按半边顺序给每条无向边编号
+    int num_half_edges = he_vertex.size();
+    edge_child.assign(num_half_edges, -1);
+    int num_new_vertices = numVertices();
+    for (int e = 0; e < num_half_edges; e++) {
+        if (he_vertex[e] < 0) continue;
+        int e_op = he_opposite[e];
+        if (e_op >= 0 && e_op < e) {
+            edge_child[e] = edge_child[e_op];
+        } else {
+            edge_child[e] = num_new_vertices++;
         }
-        else if(v1->getS() == 1){ 
-          v1->setVertexType(dart); 
+    }
+    positions.resize(num_new_vertices);
+    quadrics.resize(num_new_vertices);
+    vertex_creases.resize(num_new_vertices, 0);
+    vertex_versions.resize(num_new_vertices, 0);
+    vertex_halfedge.resize(num_new_vertices, -1);
+    return num_new_vertices;
+}
+
+//1.边界边1/2
+//2.crease边查表
+//3.普通边按smooth edge方式计算
+template <class Sink>
+void Mesh::loopEdgeRule(int e, const std::vector<VertexType> &vertex_types, Sink &sink) const {
+    int v1 = he_vertex[e];
+    int v2 = endVertex(e);
+    int e_op = he_opposite[e];
+    if (e_op < 0) {//边界边，新点按1/2计算
+        sink.add(v1, 0.5f);
+        sink.add(v2, 0.5f);
+        return;
+    }
+    //crease边 or 普通边 需要额外用到另外两个顶点
+    int v3 = he_vertex[prevHalfEdge(e)];
+    int v4 = he_vertex[prevHalfEdge(e_op)];
+    VertexType t1 = vertex_types[v1];
+    VertexType t2 = vertex_types[v2];
+
+    if (he_crease[e] > 0) {
+        //crease边,查表
+        //操作3，查表有四种情况 2+2
+        if ((t1 == reg_crease && t2 == non_reg_crease) ||
+            (t1 == reg_crease && t2 == corner)) {
+            sink.add(v1, 0.625f); sink.add(v2, 0.375f);
+            return;
+        }
+        else if ((t1 == non_reg_crease && t2 == reg_crease) ||
+            (t1 == corner && t2 == reg_crease)) {
+            sink.add(v2, 0.625f); sink.add(v1, 0.375f);
+            return;
         }
-        else if (v1->getS() == 2) {
+        //操作2 ，有五种情况
+        else if ((t1 == reg_crease && t2 == reg_crease)
+            || (t1 == non_reg_crease && t2 == non_reg_crease)
+            || (t1 == corner && t2 == corner)
+            || (t1 == non_reg_crease && t2 == corner)
+            || (t1 == corner && t2 == non_reg_crease)) {
+            sink.add(v1, 0.5f); sink.add(v2, 0.5f);
+            return;
+        }
+        //其他均为操作1
+    }
+    //普通边 同操作1 
+    sink.add(v1, 0.375f); sink.add(v2, 0.375f);
+    sink.add(v3, 0.125f); sink.add(v4, 0.125f);
+}
+
+//情况1:顶点为边界点
+//情况2：顶点不为边界点，此时根据顶点的定义可以在分为三类
+template <class Sink>
+void Mesh::loopVertexRule(int v1, const std::vector<VertexType> &vertex_types, std::vector<int> &outgoing, Sink &sink) const {
+    bool boundary = !getOutgoingHalfEdges(v1, outgoing);
+    if (boundary) {//顶点周围有边界的情况
+        //两个边界邻点：没有对边的出半边的终点和没有对边的入半边的起点
+        for (unsigned int i = 0; i < outgoing.size(); i++) {
+            int h = outgoing[i];
+            if (he_opposite[h] < 0) sink.add(endVertex(h), 0.125);
+            if (he_opposite[prevHalfEdge(h)] < 0) sink.add(he_vertex[prevHalfEdge(h)], 0.125);
+        }
+        sink.add(v1, 0.75);
+    }
+    else if (vertex_types[v1] == corner) {//若为corner，不改变
+        sink.add(v1, 1);
+    }
+    else if (vertex_types[v1] == reg_crease || vertex_types[v1] == non_reg_crease) {//若为crease，先找两条crease边，再计算
+        int vertex_crease[2];
+        int num_crease = 0;
+        for (unsigned int i = 0; i < outgoing.size() && num_crease < 2; i++) {
+            if (he_crease[outgoing[i]] > 0)
+                vertex_crease[num_crease++] = endVertex(outgoing[i]);
+        }
+        if (num_crease < 2) {
+            sink.add(v1, 1);
+            return;
+        }
+        sink.add(vertex_crease[0], 0.125);
+        sink.add(vertex_crease[1], 0.125);
+        sink.add(v1, 0.75);
+    }
+    else {//若为其他类型顶点
+        int n = outgoing.size();
+        double beta = (0.625 - pow((0.375 + 0.25 * cos(2 * 3.1415926 / n)), 2)) / n;
+        sink.add(v1, 1 - n * beta);
+        for (int i = 0; i < n; i++) {
+            sink.add(endVertex(outgoing[i]), beta);
+        }
+    }
+}
+
+void Mesh::LoopSubdivision(StencilTable *stencils) {
+  if (print_progress) printf ("Subdivide the mesh!\n");
+    int num_old_vertices = numVertices();
+    int num_half_edges = he_vertex.size();
+    std::vector<VertexType> vertex_types(num_old_vertices, smooth);
+    //strp1:对顶点进行分类，每个顶点只分一次（各线程只写自己范围内的顶点）
+    parallelFor(num_old_vertices, [&](int begin, int end) {
+      std::vector<int> outgoing;
+      for (int v1 = begin; v1 < end; v1++) {
+        if (vertex_halfedge[v1] < 0) continue;
+        if (vertex_creases[v1] == 0) {
+          vertex_types[v1] = smooth;
+        }
+        else if(vertex_creases[v1] == 1){ 
+          vertex_types[v1] = dart; 
+        }
+        else if (vertex_creases[v1] == 2) {
             //是regular还是non-regular
             //regular有两种情况：
             //1.顶点不在边界上，要求顶点共与6条边相连，且两条crease每边有2条smooth边
             //2.顶点在边界上，周围相连边的数量为4
             //剩下的都是non-regular
-          Edge* eTemp = eVType->getNext()->getNext();
-          //计算与这条边相连的边
-          std::vector<Edge*> edgeConnect;
-          edgeConnect.push_back(eVType);
-          bool boundary = false;
-          while (eTemp->getOpposite() != NULL && eTemp->getOpposite() != eVType) {//crease边
-              edgeConnect.push_back(eTemp->getOpposite());
-              eTemp = eTemp->getOpposite()->getNext()->getNext();
-          }
-            if (eTemp->getOpposite() == NULL) {
-                boundary = true;//顶点在边界上
-                eTemp = eVType;
-                while (eTemp->getOpposite() != NULL) {
-                    eTemp = eTemp->getOpposite()->getNext();
-                    edgeConnect.push_back(eTemp);
-                }
-            }
+            //计算与这个顶点相连的边（按环绕顺序）
+            bool boundary = !getOutgoingHalfEdges(v1, outgoing);
             if (boundary) {
               //顶点在边界上
               //如果顶点在边界上，那么只要周围相连边的数量为4即是regular
-              if (edgeConnect.size() == 4) {
-                v1->setVertexType(reg_crease);
+              if (outgoing.size() == 4) {
+                vertex_types[v1] = reg_crease;
               }
               else { 
-                v1->setVertexType(non_reg_crease); 
+                vertex_types[v1] = non_reg_crease; 
               }
             }
             else {
               //不在边界上
-              if(edgeConnect.size() != 6){       
-                v1->setVertexType(non_reg_crease); 
-              }
-              else {
+              vertex_types[v1] = non_reg_crease; 
+              if (outgoing.size() == 6) {
                 //如果顶点不在边界上，要求顶点共与6条边相连，且两条crease一边有2条smooth边
-                if (edgeConnect[0]->getCrease() > 0 && edgeConnect[3]->getCrease() > 0 &&edgeConnect[1]->getCrease() <= 0 && edgeConnect[2]->getCrease() <= 0 && edgeConnect[4]->getCrease() <= 0 && edgeConnect[5]->getCrease() <= 0) {
-                  v1->setVertexType(reg_crease);//情况1
-                }
-                else{ 
-                  v1->setVertexType(non_reg_crease); 
+                //即两条crease在环上正好相对
+                for (int i = 0; i < 3; i++) {
+                  bool regular = he_crease[outgoing[i]] > 0 && he_crease[outgoing[i + 3]] > 0;
+                  for (int k = 1; k < 3; k++) {
+                    if (he_crease[outgoing[i + k]] > 0 || he_crease[outgoing[(i + k + 3) % 6]] > 0) {
+                      regular = false;
+                    }
+                  }
+                  if (regular) {
+                    vertex_types[v1] = reg_crease;//情况1
+                    break;
+                  }
                 }
               }
             }
         }
-        else if (v1->getS() >= 3) {
-            v1->setVertexType(corner);
+        else if (vertex_creases[v1] >= 3) {
+            vertex_types[v1] = corner;
+        }
+      }
+    });
+    if (print_progress) printf("第一步结束\n");
+
+    //需要时把这一步的规则记录下来：先是旧顶点，再按编号顺序是每条边上的新顶点
+    if (stencils != NULL) {
+        stencils->clear(num_old_vertices);
+        std::vector<int> outgoing;
+        for (int v1 = 0; v1 < num_old_vertices; v1++) {
+            if (vertex_halfedge[v1] < 0) stencils->add(v1, 1);
+            else loopVertexRule(v1, vertex_types, outgoing, *stencils);
+            stencils->endRow();
+        }
+        for (int e = 0; e < num_half_edges; e++) {
+            if (he_vertex[e] < 0) continue;
+            if (he_opposite[e] >= 0 && he_opposite[e] < e) continue;
+            loopEdgeRule(e, vertex_types, *stencils);
+            stencils->endRow();
         }
     }
-    printf("第一步结束\n");
+
     //二、为每条边计算一个新的顶点
-    //1.边界边1/2
-    //2.crease边查表
-    //3.普通边按smooth edge方式计算
-    for (edgeshashtype::iterator iterEdges = edges.begin(); iterEdges != edges.end(); iterEdges++) {
-        Edge* e = iterEdges->second;
-        Vertex* v1 = e->getStartVertex();
-        Vertex* v2 = e->getEndVertex();
-        Vec3f new_vertex;
-        if (e->getOpposite() == NULL) {//边界边，新点按1/2计算
-            new_vertex = (v1->getPos() + v2->getPos()) * 0.5f;
-            Vertex* New_Vertex = addVertex(new_vertex);
-            if (e->getCrease() > 0) {
-                New_Vertex->setS(2);
-            }
-            
-            setParentsChild(v1, v2, New_Vertex);
+    std::vector<int> edge_child;
+    int num_new_vertices = addEdgeChildren(edge_child);
+    parallelFor(num_half_edges, [&](int begin, int end) {
+      for (int e = begin; e < end; e++) {
+        if (he_vertex[e] < 0) continue;
+        if (he_opposite[e] >= 0 && he_opposite[e] < e) continue;
+        PointSink sink(positions);
+        loopEdgeRule(e, vertex_types, sink);
+        positions[edge_child[e]] = sink.sum;
+        if (he_crease[e] > 0) {
+            vertex_creases[edge_child[e]] = 2;
         }
-        else {
-            //crease边 or 普通边 需要额外用到另外两个顶点
-            Triangle* t1 = e->getTriangle();
-            Triangle* t2 = e->getOpposite()->getTriangle();
-            Vertex* v3, * v4;
-            if ((*t1)[0]->getIndex() != v1->getIndex() && (*t1)[0]->getIndex() != v2->getIndex()) {
-                v3 = (*t1)[0];
-            }
-            else if ((*t1)[1]->getIndex() !=v1->getIndex() && (*t1)[1]->getIndex() != v2->getIndex()) {
-                v3 = (*t1)[1];
-            }
-            else if ((*t1)[2]->getIndex() != v1->getIndex() && (*t1)[2]->getIndex() != v2->getIndex()) {
-                v3 = (*t1)[2];
-            }
-            else {  v3 = v1; }
+      }
+    });
+    for (int v = num_old_vertices; v < num_new_vertices; v++) {
+        bbox.Extend(positions[v]);
+    }
+    if (print_progress) std::cout << "第二步结束" << std::endl;
 
-            if ((*t2)[0]->getIndex() != e->getOpposite()->getStartVertex()->getIndex() && (*t2)[0]->getIndex() != e->getOpposite()->getEndVertex()->getIndex()) {
-                v4 = (*t2)[0];
-            }
-            else if ((*t2)[1]->getIndex() != e->getOpposite()->getStartVertex()->getIndex() && (*t2)[1]->getIndex() != e->getOpposite()->getEndVertex()->getIndex()) {
-                v4 = (*t2)[1];
-            }
-            else if ((*t2)[2]->getIndex() != e->getOpposite()->getStartVertex()->getIndex() && (*t2)[2]->getIndex() != e->getOpposite()->getEndVertex()->getIndex()) {
-                v4 = (*t2)[2];
-            }
-            else {  v4 = v1; }
-
-            if (e->getCrease() > 0) {
-                //crease边,查表
-                //操作3，查表有四种情况 2+2
-                if ((v1->getVertexType() == reg_crease && v2->getVertexType() == non_reg_crease) ||
-                    (v1->getVertexType() == reg_crease && v2->getVertexType() == corner)) {
-                    new_vertex = 0.625f * v1->getPos() + 0.375f * v2->getPos();
-                }
-                else if ((v1->getVertexType() == non_reg_crease && v2->getVertexType() == reg_crease) ||
-                    (v1->getVertexType() == corner && v2->getVertexType() == reg_crease)) 
-                {new_vertex = 0.625f * v2->getPos() + 0.375f * v1->getPos();}
-                //操作2 ，有五种情况
-                else if ((v1->getVertexType() == reg_crease && v2->getVertexType() == reg_crease)
-                    || (v1->getVertexType() == non_reg_crease && v2->getVertexType() == non_reg_crease)
-                    || (v1->getVertexType() == corner && v2->getVertexType() == corner)
-                    || (v1->getVertexType() == non_reg_crease && v2->getVertexType() == corner)
-                    || (v1->getVertexType() == corner && v2->getVertexType() == non_reg_crease)) 
-                {new_vertex = 0.5f * v1->getPos() + 0.5f * v2->getPos();}
-                //其他均为操作1
-                else { new_vertex = 0.375f * v1->getPos() + 0.375f * v2->getPos() + 0.125f * v3->getPos() + 0.125f * v4->getPos();}
-            }
-            //普通边 同操作1 
-            else {
-                new_vertex = 0.375f * v1->getPos() + 0.375f * v2->getPos() + 0.125f * v3->getPos() + 0.125f * v4->getPos();
-            }
+    //三、根据旧顶点类型，更新旧顶点的位置
+    //新位置先写到new_positions里，全部算完再替换，所以各线程读到的都是旧位置
+    std::vector<Vec3f> new_positions(num_old_vertices);
+    parallelFor(num_old_vertices, [&](int begin, int end) {
+      std::vector<int> outgoing;
+      for (int v1 = begin; v1 < end; v1++) {
+        if (vertex_halfedge[v1] < 0) continue;
+        PointSink sink(positions);
+        loopVertexRule(v1, vertex_types, outgoing, sink);
+        new_positions[v1] = sink.sum;
+      }
+    });
+    //更新
+    for (int v1 = 0; v1 < num_old_vertices; v1++) {                     
+        if (vertex_halfedge[v1] >= 0) positions[v1] = new_positions[v1];
+    }
+    if (print_progress) std::cout << "第三步结束" << std::endl;
 
-            Vertex* New_Vertex = addVertex(new_vertex);
-            if (e->getCrease() > 0) {
-                New_Vertex->setS(2);
-            }
-            setParentsChild(v1, v2, New_Vertex);
-        }
+    //四、更新网格
+    refineTriangles(edge_child);
+    if (print_progress) std::cout << "第四步结束" << std::endl;
+
+}
+
+void Mesh::refineTriangles(const std::vector<int> &edge_child) {
+    //每个旧三角形t（压缩后编号k）变成新三角形4k..4k+3：
+    //  4k   : c12 c23 c13（中间）
+    //  4k+1 : v1  c12 c13
+    //  4k+2 : v2  c23 c12
+    //  4k+3 : v3  c13 c23
+    //旧半边i（v_i -> v_i+1）分成的两条子半边在新三角形中的位置
+    static const int first_child[3] = { 3, 6, 9 };   // v_i -> c
+    static const int second_child[3] = { 8, 11, 5 }; // c -> v_i+1
+    //中间三角形和角上三角形之间的对边
+    static const int inner[3][2] = { { 0, 7 }, { 1, 10 }, { 2, 4 } };
+
+    int num_old_slots = numTriangleSlots();
+    std::vector<int> new_index(num_old_slots);
+    int num_new_triangles = 0;
+    for (int t = 0; t < num_old_slots; t++) {
+        new_index[t] = num_new_triangles;
+        if (isTriangleAlive(t)) num_new_triangles += 4;
     }
-    std::cout << "第二步结束" << std::endl;
 
-    //三、根据旧顶点类型，更新旧顶点的位置
-    //情况1:顶点为边界点
-    //情况2：顶点不为边界点，此时根据顶点的定义可以在分为三类
-    int c = 0;
-    std::vector<Vertex*> vertex_updated;
-    for (edgeshashtype::iterator iterEdges = edges.begin(); iterEdges != edges.end(); ++iterEdges) {
-        Edge* e= iterEdges->second;
-        Vertex* v1 = e->getStartVertex();
-        bool updated = false;
-        for (int i = 0; i < vertex_updated.size(); i++) {
-            if (v1->getIndex() == vertex_updated[i]->getIndex()) { 
-              updated = true; break; 
-            }
+    //旧顶点的出半边换成原来那条出半边的第一条子半边（新顶点这时还是-1）
+    parallelFor(numVertices(), [&](int begin, int end) {
+      for (int v = begin; v < end; v++) {
+        int h = vertex_halfedge[v];
+        if (h < 0) continue;
+        assert (he_vertex[h] == v);
+        vertex_halfedge[v] = 3*new_index[halfEdgeTriangle(h)] + first_child[h%3];
+      }
+    });
+
+    std::vector<int> new_vertex(3*num_new_triangles);
+    std::vector<int> new_opposite(3*num_new_triangles);
+    std::vector<float> new_crease(3*num_new_triangles);
+    parallelFor(num_old_slots, [&](int begin, int end) {
+      for (int t = begin; t < end; t++) {
+        if (!isTriangleAlive(t)) continue;
+        int base = 3*new_index[t];
+        int v[3], c[3];
+        for (int i = 0; i < 3; i++) {
+            v[i] = he_vertex[3*t+i];
+            c[i] = edge_child[3*t+i];
+            assert (c[i] >= 0);
         }
-        if (updated) { continue; }
-
-        //寻找v1周围顶点
-        std::vector<Vertex*> vertex_aroundv1;//存储在v1周围的点
-        Edge* eTemp = e->getNext()->getNext();
-        bool boundary = false;
-        while (1) {
-            if (eTemp->getOpposite() == NULL) {
-                vertex_aroundv1.push_back(eTemp->getStartVertex());
-                eTemp = e;
-                boundary = true;
-                while (eTemp->getOpposite() != NULL) {
-                    eTemp=eTemp->getOpposite()->getNext();
-                }
-                vertex_aroundv1.push_back(eTemp->getEndVertex());
-                break;
-            }
-            else if (eTemp->getOpposite() == e) { vertex_aroundv1.push_back(eTemp->getStartVertex()); break; }
-            else { vertex_aroundv1.push_back(eTemp->getStartVertex()); eTemp = eTemp->getOpposite()->getNext()->getNext(); }
+        int tri[12] = { c[0], c[1], c[2],
+                        v[0], c[0], c[2],
+                        v[1], c[1], c[0],
+                        v[2], c[2], c[1] };
+        for (int i = 0; i < 12; i++) {
+            new_vertex[base+i] = tri[i];
+            new_crease[base+i] = 0;
         }
-        //计算v1的新位置
-        if (boundary) {//顶点周围有边界的情况
-            int n_v = vertex_aroundv1.size();
-            Vec3f new_pos = 0.125 * (vertex_aroundv1[n_v-2]->getPos() + vertex_aroundv1[n_v - 1]->getPos()) + 0.75 * v1->getPos();
-            v1->setNewPos(new_pos);
-            vertex_updated.push_back(v1);
+        for (int i = 0; i < 3; i++) {
+            new_opposite[base+inner[i][0]] = base+inner[i][1];
+            new_opposite[base+inner[i][1]] = base+inner[i][0];
         }
-        else {//没有边界，分三种情况
-            if (v1->getVertexType() == corner) {//若为corner，不改变
-                v1->setNewPos(v1->getPos());
+        //外边：子半边的对边是旧对边的子半边（方向相反），crease传给两条子边
+        for (int i = 0; i < 3; i++) {
+            int h = 3*t+i;
+            int o = he_opposite[h];
+            if (o < 0) {
+                new_opposite[base+first_child[i]] = -1;
+                new_opposite[base+second_child[i]] = -1;
+            } else {
+                int o_base = 3*new_index[halfEdgeTriangle(o)];
+                new_opposite[base+first_child[i]] = o_base+second_child[o%3];
+                new_opposite[base+second_child[i]] = o_base+first_child[o%3];
             }
-            else if (v1->getVertexType() == reg_crease || v1->getVertexType() == non_reg_crease) {//若为crease，先找两条crease边，再计算
-                std::vector<Vertex*> vertex_crease;
-                for (int i = 0; i < vertex_aroundv1.size(); i++) {
-                    if (edges.find(std::make_pair(v1, vertex_aroundv1[i]))->second->getCrease() > 0)
-                        vertex_crease.push_back(vertex_aroundv1[i]);
-                }
-                //std::cout << vertex_crease.size() << std::endl;
-                Vec3f new_pos = 0.125 * (vertex_crease[0]->getPos() + vertex_crease[1]->getPos()) + 0.75 * v1->getPos();
-                v1->setNewPos(new_pos);
-            }
-            else {//若为其他类型顶点
-                int n = vertex_aroundv1.size();
-                double beta = (0.625 - pow((0.375 + 0.25 * cos(2 * 3.1415926 / n)), 2)) / n;
-                Vec3f new_pos = v1->getPos() * (1 - n * beta);
-                for (int i = 0; i < n; i++) {
-                    new_pos+= vertex_aroundv1[i]->getPos()* beta; 
-                }
-                v1->setNewPos(new_pos);
-            }
-            vertex_updated.push_back(v1);
+            new_crease[base+first_child[i]] = he_crease[h];
+            new_crease[base+second_child[i]] = he_crease[h];
+            //新顶点的出半边只由编号较小的那条半边来写
+            if (o < 0 || o > h)
+                vertex_halfedge[c[i]] = base+second_child[i];
         }
-    }
-    //更新
-    for (int i = 0; i < vertex_updated.size(); i++) {                     
-        vertex_updated[i]->updatePos();
-    }
-    std::cout << "第三步结束" << std::endl;
+      }
+    });
+
+
+    he_vertex.swap(new_vertex);
+    he_opposite.swap(new_opposite);
+    he_crease.swap(new_crease);
+    he_ok.assign(he_vertex.size(), 1);
+    //新的三角形是紧密排列的，没有空位
+    free_triangles.clear();
+    num_triangles = num_new_triangles;
+    quadrics_valid = false;
+    clearProgressiveMesh();
+    buildEdgeIndex();
+}
 
-    //四、更新网格
-    //add triangle mesh
-    triangleshashtype tempTriangles = triangles;
-    triangles.clear();//clear old triangle meshes
-    edges.clear();//clear information of old edges
-    triangleshashtype::iterator tIterator = tempTriangles.begin();
-    for (; tIterator != tempTriangles.end(); tIterator++)
-    {
-        Triangle* t = tIterator->second;
-        Vertex* v1, * v2, * v3, * c12, * c23, * c13;
-        v1 = (*t)[0]; v2 = (*t)[1]; v3 = (*t)[2];
-        c12 = getChildVertex(v1, v2);
-        c23 = getChildVertex(v2, v3);
-        c13 = getChildVertex(v1, v3);
-        if (c12 == NULL || c23 == NULL || c13 == NULL) break;
-
-        addTriangle(c12, c23, c13);
-        addTriangle(v1, c12, c13);
-        addTriangle(v2, c23, c12);
-        addTriangle(v3, c13, c23);
+//情况b：v1的度不是6（v1_around不是5条边）时，以v1为中心的权重
+template <class Sink>
+void Mesh::butterflyExtraordinaryRule(int v1, int v2, const std::vector<int> &v1_around, double scale, Sink &sink) const {
+    sink.add(v1, 0.75 * scale);
+    if (v1_around.size() == 2) {//k==3    
+        sink.add(v2, (5 /12) * scale);
+        sink.add(he_vertex[v1_around[0]], (-1 / 12) * scale);
+        sink.add(he_vertex[v1_around[1]], (-1 / 12) * scale);
     }
-
-    //set crease
-    for (edgeshashtype::iterator eIterator3 = edges.begin();
-        eIterator3 != edges.end(); eIterator3++)
-    {
-        Edge* e = eIterator3->second;
-        std::pair<Vertex*, Vertex*> ePair = eIterator3->first;
-
-        if (vertex_parents.find(ePair) == vertex_parents.end()) continue;
-        if (e->getCrease())
-        {
-            Vertex* childVertex = vertex_parents.find(ePair)->second;
-            assert(edges.find(std::make_pair(e->getStartVertex(), childVertex)) != edges.end());
-            edges.find(std::make_pair(e->getStartVertex(), childVertex))->second->setCrease(e->getCrease());
-            assert(edges.find(std::make_pair(childVertex, e->getEndVertex())) != edges.end());
-            edges.find(std::make_pair(childVertex, e->getEndVertex()))->second->setCrease(e->getCrease());
+    else if (v1_around.size() == 3) {//k==4            
+        sink.add(v2, 0.375 * scale);
+        sink.add(he_vertex[v1_around[1]], (-0.125) * scale);
+    }
+    else {
+        double k = (v1_around.size() + 1);
+        sink.add(v2, (1.75 / k) * scale);
+        for (unsigned int i = 0; i < v1_around.size(); i++) {
+            int kk = i + 1;
+            double weight = (0.25 + cos(2 * 3.1415926 * kk / k) + 0.5 * cos(4 * kk * 3.1415926 / k)) / k;
+            sink.add(he_vertex[v1_around[i]], weight * scale);
         }
     }
-    vertex_parents.clear();
-    std::cout << "第四步结束" << std::endl;
-
 }
-void Mesh::ButterflySubdivision(){
-    printf("ButterflySubdivision the mesh!\n");
 
-    for (edgeshashtype::iterator iterEdges = edges.begin(); iterEdges != edges.end(); iterEdges++) {
-        Edge* e = iterEdges->second;
-        Vertex* v1 = e->getStartVertex();
-        Vertex* v2 = e->getEndVertex();
+template <class Sink>
+void Mesh::butterflyEdgeRule(int e, Sink &sink) const {
+        int v1 = he_vertex[e];
+        int v2 = endVertex(e);
 
-        if (getChildVertex(v1, v2) != NULL) {
-            continue;
-        }
-
-        if (e->getOpposite() == NULL) {
+        if (he_opposite[e] < 0) {
             //情况d (1)边界
-            Edge* boundary1;
-            Edge* boundary2;
-            Edge* e_temp = e->getNext()->getNext();
-            while (e_temp->getOpposite() != NULL) {
-                e_temp = e_temp->getOpposite()->getNext()->getNext();
+            int boundary1;
+            int boundary2;
+            int e_temp = prevHalfEdge(e);
+            while (he_opposite[e_temp] >= 0) {
+                e_temp = prevHalfEdge(he_opposite[e_temp]);
             }
             boundary1 = e_temp;
-            e_temp = e->getNext();
-            while (e_temp->getOpposite() != NULL) {
-                e_temp = e_temp->getOpposite()->getNext();
+            e_temp = nextHalfEdge(e);
+            while (he_opposite[e_temp] >= 0) {
+                e_temp = nextHalfEdge(he_opposite[e_temp]);
             }
             boundary2 = e_temp;
 
-            Vec3f new_vertex = 0.5625 * (v1->getPos() + v2->getPos()) - 0.0625 * (boundary1->getStartVertex()->getPos() + boundary2->getEndVertex()->getPos());
-            Vertex* New_Vertex = addVertex(new_vertex);
-            setParentsChild(v1, v2, New_Vertex);
+            sink.add(v1, 0.5625);
+            sink.add(v2, 0.5625);
+            sink.add(he_vertex[boundary1], -0.0625);
+            sink.add(endVertex(boundary2), -0.0625);
         }
-        else if(e->getCrease()>0){
+        else if(he_crease[e]>0){
             //情况d (2)crease
             //找到v1 v2周围的所有crease 并平分-1/16这个权重
-            std::vector<Edge*> v1_crease;
-            std::vector<Edge*> v2_crease;
+            std::vector<int> v1_crease;
+            std::vector<int> v2_crease;
             //v1周围
-            Edge* e_temp = e->getNext()->getNext();
-            while (e_temp->getOpposite() != NULL && e_temp->getOpposite() != e) {
-                if (e_temp->getCrease() > 0) {//crease边
+            int e_temp = prevHalfEdge(e);
+            while (he_opposite[e_temp] >= 0 && he_opposite[e_temp] != e) {
+                if (he_crease[e_temp] > 0) {//crease边
                     v1_crease.push_back(e_temp);
                 }
-                e_temp = e_temp->getOpposite()->getNext()->getNext();
+                e_temp = prevHalfEdge(he_opposite[e_temp]);
             }
-            if (e_temp->getOpposite() == NULL) {
-                e_temp = e->getOpposite()->getNext();
-                while (e_temp->getOpposite() != NULL) {
-                    if (e_temp->getCrease() > 0) {//crease边
+            if (he_opposite[e_temp] < 0) {
+                e_temp = nextHalfEdge(he_opposite[e]);
+                while (he_opposite[e_temp] >= 0) {
+                    if (he_crease[e_temp] > 0) {//crease边
                         v1_crease.push_back(e_temp);
                     }
-                    e_temp = e_temp->getOpposite()->getNext();
+                    e_temp = nextHalfEdge(he_opposite[e_temp]);
                 }
-                if (e_temp->getCrease() > 0) {//crease边
+                if (he_crease[e_temp] > 0) {//crease边
                     v1_crease.push_back(e_temp);
                 }
             }
             //v2周围
-            e = e->getOpposite();
-            e_temp = e->getNext()->getNext();
-            while (e_temp->getOpposite() != NULL && e_temp->getOpposite() != e) {
-                if (e_temp->getCrease() > 0) {//crease边
+            e = he_opposite[e];
+            e_temp = prevHalfEdge(e);
+            while (he_opposite[e_temp] >= 0 && he_opposite[e_temp] != e) {
+                if (he_crease[e_temp] > 0) {//crease边
                     v2_crease.push_back(e_temp);
                 }
-                e_temp = e_temp->getOpposite()->getNext()->getNext();
+                e_temp = prevHalfEdge(he_opposite[e_temp]);
             }
-            if (e_temp->getOpposite() == NULL) {
-                e_temp = e->getOpposite()->getNext();
-                while (e_temp->getOpposite() != NULL) {
-                    if (e_temp->getCrease() > 0) {//crease边
+            if (he_opposite[e_temp] < 0) {
+                e_temp = nextHalfEdge(he_opposite[e]);
+                while (he_opposite[e_temp] >= 0) {
+                    if (he_crease[e_temp] > 0) {//crease边
                         v2_crease.push_back(e_temp);
                     }
-                    e_temp = e_temp->getOpposite()->getNext();
+                    e_temp = nextHalfEdge(he_opposite[e_temp]);
                 }
-                if (e_temp->getCrease() > 0) {//crease边
+                if (he_crease[e_temp] > 0) {//crease边
                     v2_crease.push_back(e_temp);
                 }
             }
-            Vec3f v1_new, v2_new;
             //计算v1相关的边权重
             if (v1_crease.size() == 0) {
-                v1_new = v1->getPos() * 0.5;
+                sink.add(v1, 0.5);
             }
             else {
                 float v1_weight = -0.0625 / v1_crease.size();
-                for (int i = 0; i < v1_crease.size(); i++) {
-                    v1_new += v1_weight * v1_crease[i]->getStartVertex()->getPos();
+                for (unsigned int i = 0; i < v1_crease.size(); i++) {
+                    sink.add(he_vertex[v1_crease[i]], v1_weight);
                 }
-                v1_new+= v1->getPos() * 0.5625;
+                sink.add(v1, 0.5625);
             }
             //计算v2相关边权重
             if (v2_crease.size() == 0) {
-                v2_new = v2->getPos() * 0.5;
+                sink.add(v2, 0.5);
             }
             else {
                 float v2_weight = -0.0625 / v2_crease.size();
-                for (int i = 0; i < v2_crease.size(); i++) {
-                    v2_new += v2_weight * v2_crease[i]->getStartVertex()->getPos();
+                for (unsigned int i = 0; i < v2_crease.size(); i++) {
+                    sink.add(he_vertex[v2_crease[i]], v2_weight);
                 }
-                v2_new += v2->getPos() * 0.5625;
+                sink.add(v2, 0.5625);
             }
-            Vec3f new_pos = v1_new + v2_new;
-            Vertex* New_Vertex = addVertex(new_pos);
-            setParentsChild(v1, v2, New_Vertex);
         }
         else {
             //正常边 情况(a)(b)(c)
             //找v1周围边
-            std::vector<Edge*> v1_around;
-            std::vector<Edge*> v2_around;
-            Edge* e_temp = e->getNext()->getNext();
-            while (e_temp->getOpposite() != NULL && e_temp->getOpposite() != e) {
+            std::vector<int> v1_around;
+            std::vector<int> v2_around;
+            int e_temp = prevHalfEdge(e);
+            while (he_opposite[e_temp] >= 0 && he_opposite[e_temp] != e) {
                 v1_around.push_back(e_temp);
-                e_temp = e_temp->getOpposite()->getNext()->getNext();
+                e_temp = prevHalfEdge(he_opposite[e_temp]);
             }
-            if (e_temp->getOpposite() == NULL) {
+            if (he_opposite[e_temp] < 0) {
                 v1_around.push_back(e_temp);
-                e_temp = e->getOpposite()->getNext();
-                std::vector<Edge*> v1_back;
-                while (e_temp->getOpposite() != NULL) {
+                e_temp = nextHalfEdge(he_opposite[e]);
+                std::vector<int> v1_back;
+                while (he_opposite[e_temp] >= 0) {
                     v1_back.push_back(e_temp);
-                    e_temp = e_temp->getOpposite()->getNext();
+                    e_temp = nextHalfEdge(he_opposite[e_temp]);
                 }
                 v1_back.push_back(e_temp);
                 //倒序存储
@@ -907,19 +1397,19 @@ void Mesh::ButterflySubdivision(){
                 }
             }
             //同理 寻找v2周围的边
-            e = e->getOpposite();
-            e_temp = e->getNext()->getNext();
-            while (e_temp->getOpposite() != NULL && e_temp->getOpposite() != e) {
+            e = he_opposite[e];
+            e_temp = prevHalfEdge(e);
+            while (he_opposite[e_temp] >= 0 && he_opposite[e_temp] != e) {
                 v2_around.push_back(e_temp);
-                e_temp = e_temp->getOpposite()->getNext()->getNext();
+                e_temp = prevHalfEdge(he_opposite[e_temp]);
             }
-            if (e_temp->getOpposite() == NULL) {
+            if (he_opposite[e_temp] < 0) {
                 v2_around.push_back(e_temp);
-                e_temp = e->getOpposite()->getNext();
-                std::vector<Edge*> v2_back;
-                while (e_temp->getOpposite() != NULL) {
+                e_temp = nextHalfEdge(he_opposite[e]);
+                std::vector<int> v2_back;
+                while (he_opposite[e_temp] >= 0) {
                     v2_back.push_back(e_temp);
-                    e_temp = e_temp->getOpposite()->getNext();
+                    e_temp = nextHalfEdge(he_opposite[e_temp]);
                 }
                 v2_back.push_back(e_temp);
                 //倒序存储
@@ -928,537 +1418,383 @@ void Mesh::ButterflySubdivision(){
                 }
             }
             //边找完了  分情况计算新顶点
-            Vec3f new_pos;
             if (v1_around.size() == 5 && v2_around.size() == 5) {
                 //情况a
-                new_pos += (v1->getPos() + v2->getPos()) * 0.5;
-                new_pos += (v1_around[0]->getStartVertex()->getPos() + v1_around[4]->getStartVertex()->getPos()) * 0.125;
-                new_pos += (v1_around[1]->getStartVertex()->getPos() + v1_around[3]->getStartVertex()->getPos()) * (-0.0625);
-                new_pos += (v2_around[1]->getStartVertex()->getPos() + v2_around[3]->getStartVertex()->getPos()) * (-0.0625);
+                sink.add(v1, 0.5);
+                sink.add(v2, 0.5);
+                sink.add(he_vertex[v1_around[0]], 0.125);
+                sink.add(he_vertex[v1_around[4]], 0.125);
+                sink.add(he_vertex[v1_around[1]], -0.0625);
+                sink.add(he_vertex[v1_around[3]], -0.0625);
+                sink.add(he_vertex[v2_around[1]], -0.0625);
+                sink.add(he_vertex[v2_around[3]], -0.0625);
             }
             else if (v1_around.size() != 5 && v2_around.size() == 5) {
                 //情况b(1)
-                new_pos += v1->getPos() * 0.75;
-                if (v1_around.size() == 2) {//k==3    
-                    new_pos += v2->getPos() * (5 /12)+ (v1_around[0]->getStartVertex()->getPos() + v1_around[1]->getStartVertex()->getPos()) * (-1 / 12);
-                }
-                else if (v1_around.size() == 3) {//k==4            
-                    new_pos += v2->getPos() * 0.375+ v1_around[1]->getStartVertex()->getPos() * (-0.125);
-                }
-                else {
-                    double k = (v1_around.size() + 1);
-                    new_pos += v2->getPos() * (1.75 / k);
-                    for (int i = 0; i < v1_around.size(); i++) {
-                        int kk = i + 1;
-                        double weight = (0.25 + cos(2 * 3.1415926 * kk / k) + 0.5 * cos(4 * kk * 3.1415926 / k)) / k;
-                        new_pos += v1_around[i]->getStartVertex()->getPos() * weight;
-                    }
-                }
+                butterflyExtraordinaryRule(v1, v2, v1_around, 1, sink);
             }
             else if (v1_around.size() == 5 && v2_around.size() != 5) {
                 //情况b(2) 正好相反
-                new_pos += v2->getPos() * 0.75;
-                if (v2_around.size() == 2) {//k==3    
-                    new_pos += v1->getPos() * (5 / 12) + (v2_around[0]->getStartVertex()->getPos() + v2_around[1]->getStartVertex()->getPos()) * (-1 / 12);
-                }
-                else if (v2_around.size() == 3) {//k==4            
-                    new_pos += v1->getPos() * 0.375 + v2_around[1]->getStartVertex()->getPos() * (-0.125);
-                }
-                else {
-                    double k = (v2_around.size() + 1);
-                    new_pos += v1->getPos() * (1.75 / k);
-                    for (int i = 0; i < v2_around.size(); i++) {
-                        int kk = i + 1;
-                        double weight = (0.25 + cos(2 * 3.1415926 * kk / k) + 0.5 * cos(4 * kk * 3.1415926 / k)) / k;
-                        new_pos += v2_around[i]->getStartVertex()->getPos() * weight;
-                    }
-                }
+                butterflyExtraordinaryRule(v2, v1, v2_around, 1, sink);
             }
             else {
                 //情况c,对两个点都执行一次b,之后取平均值
-                Vec3f new_pos_v1, new_pos_v2;
-                //v1
-                new_pos_v1 += v1->getPos() * 0.75;
-                if (v1_around.size() == 2) {//k==3    
-                    new_pos_v1 += v2->getPos() * (5 / 12) + (v1_around[0]->getStartVertex()->getPos() + v1_around[1]->getStartVertex()->getPos()) * (-1 / 12);
-                }
-                else if (v1_around.size() == 3) {//k==4            
-                    new_pos_v1 += v2->getPos() * 0.375 + v1_around[1]->getStartVertex()->getPos() * (-0.125);
-                }
-                else {
-                    double k = (v1_around.size() + 1);
-                    new_pos_v1 += v2->getPos() * (1.75 / k);
-                    for (int i = 0; i < v1_around.size(); i++) {
-                        int kk = i + 1;
-                        double weight = (0.25 + cos(2 * 3.1415926 * kk / k) + 0.5 * cos(4 * kk * 3.1415926 / k)) / k;
-                        new_pos_v1 += v1_around[i]->getStartVertex()->getPos() * weight;
-                    }
-                }
-
-                //v2
-                new_pos_v2 += v2->getPos() * 0.75;
-                if (v2_around.size() == 2) {//k==3    
-                    new_pos_v2 += v1->getPos() * (5 / 12) + (v2_around[0]->getStartVertex()->getPos() + v2_around[1]->getStartVertex()->getPos()) * (-1 / 12);
-                }
-                else if (v2_around.size() == 3) {//k==4            
-                    new_pos_v2 += v1->getPos() * 0.375 + v2_around[1]->getStartVertex()->getPos() * (-0.125);
-                }
-                else {
-                    double k = (v2_around.size() + 1);
-                    new_pos_v2 += v1->getPos() * (1.75 / k);
-                    for (int i = 0; i < v2_around.size(); i++) {
-                        int kk = i + 1;
-                        double weight = (0.25 + cos(2 * 3.1415926 * kk / k) + 0.5 * cos(4 * kk * 3.1415926 / k)) / k;
-                        new_pos_v2 += v2_around[i]->getStartVertex()->getPos() * weight;
-                    }
-                }
-                new_pos = (new_pos_v1 + new_pos_v2)*0.5;
+                butterflyExtraordinaryRule(v1, v2, v1_around, 0.5, sink);
+                butterflyExtraordinaryRule(v2, v1, v2_around, 0.5, sink);
             }
-            Vertex* New_Vertex = addVertex(new_pos);
-            setParentsChild(v1, v2, New_Vertex);
+        }
+}
 
+void Mesh::ButterflySubdivision(StencilTable *stencils){
+    if (print_progress) printf("ButterflySubdivision the mesh!\n");
+
+    int num_old_vertices = numVertices();
+    int num_half_edges = he_vertex.size();
+
+    //需要时把这一步的规则记录下来：旧顶点不动，再按编号顺序是每条边上的新顶点
+    if (stencils != NULL) {
+        stencils->clear(num_old_vertices);
+        for (int v = 0; v < num_old_vertices; v++) {
+            stencils->add(v, 1);
+            stencils->endRow();
+        }
+        for (int e = 0; e < num_half_edges; e++) {
+            if (he_vertex[e] < 0) continue;
+            if (he_opposite[e] >= 0 && he_opposite[e] < e) continue;
+            butterflyEdgeRule(e, *stencils);
+            stencils->endRow();
         }
     }
 
-    //更新网格
-    //add triangle mesh
-    triangleshashtype tempTriangles = triangles;
-    triangles.clear();//clear old triangle meshes
-    edges.clear();//clear information of old edges
-    triangleshashtype::iterator tIterator = tempTriangles.begin();
-    for (; tIterator != tempTriangles.end(); tIterator++)
-    {
-        Triangle* t = tIterator->second;
-        Vertex* v1, * v2, * v3, * c12, * c23, * c13;
-        v1 = (*t)[0]; v2 = (*t)[1]; v3 = (*t)[2];
-        c12 = getChildVertex(v1, v2);
-        c23 = getChildVertex(v2, v3);
-        c13 = getChildVertex(v1, v3);
-        if (c12 == NULL || c23 == NULL || c13 == NULL) break;
-
-        addTriangle(c12, c23, c13);
-        addTriangle(v1, c12, c13);
-        addTriangle(v2, c23, c12);
-        addTriangle(v3, c13, c23);
+    //每条边算一个新顶点，旧顶点不动
+    std::vector<int> edge_child;
+    int num_new_vertices = addEdgeChildren(edge_child);
+    parallelFor(num_half_edges, [&](int begin, int end) {
+      for (int e = begin; e < end; e++) {
+        if (he_vertex[e] < 0) continue;
+        if (he_opposite[e] >= 0 && he_opposite[e] < e) continue;
+        PointSink sink(positions);
+        butterflyEdgeRule(e, sink);
+        positions[edge_child[e]] = sink.sum;
+      }
+    });
+    for (int v = num_old_vertices; v < num_new_vertices; v++) {
+        bbox.Extend(positions[v]);
     }
 
-    //set crease
-    for (edgeshashtype::iterator eIterator3 = edges.begin();
-        eIterator3 != edges.end(); eIterator3++)
-    {
-        Edge* e = eIterator3->second;
-        std::pair<Vertex*, Vertex*> ePair = eIterator3->first;
-
-        if (vertex_parents.find(ePair) == vertex_parents.end()) continue;
-        if (e->getCrease())
-        {
-            Vertex* childVertex = vertex_parents.find(ePair)->second;
-            assert(edges.find(std::make_pair(e->getStartVertex(), childVertex)) != edges.end());
-            edges.find(std::make_pair(e->getStartVertex(), childVertex))->second->setCrease(e->getCrease());
-            assert(edges.find(std::make_pair(childVertex, e->getEndVertex())) != edges.end());
-            edges.find(std::make_pair(childVertex, e->getEndVertex()))->second->setCrease(e->getCrease());
-        }
-    }
-    vertex_parents.clear();
+    //更新网格
+    refineTriangles(edge_child);
 }
 
-void Mesh::simply(Edge* e1,Vec3f new_vec) {
-    Vertex* v1=e1->getStartVertex();
-    Vertex* v2=e1->getEndVertex();
-    //需要修改的边所在的三角形（需删除的三角形）
-    Triangle* triangle1 = e1->getTriangle();
-    //另外半边的三角形
-    Triangle* triangle2 = e1->getOpposite()->getTriangle();
-    //寻找需要修改的三角形
-    std::vector<Triangle*> changedTriangles;
-    Edge* tempEdge = e1->getNext()->getOpposite();
-    while (tempEdge != NULL && tempEdge != e1) {
-        changedTriangles.push_back(tempEdge->getTriangle());
-        tempEdge = tempEdge->getNext()->getOpposite();
-    }
-    //去掉最后一个重复的
-    if (tempEdge != NULL) {
-        if (tempEdge->getTriangle()->getID() == e1->getTriangle()->getID() || tempEdge->getTriangle()->getID() == e1->getOpposite()->getTriangle()->getID()) {
-            if (changedTriangles.size() != 0)
-                changedTriangles.pop_back();
-        }
+int Mesh::simply(int e1,Vec3f new_vec,VertexSplit *split) {
+    int e2 = he_opposite[e1];
+    assert (e2 >= 0);
+    int v1 = he_vertex[e1];
+    int v2 = endVertex(e1);
+    //需要删除的两个三角形中的另外四条半边
+    int n1 = nextHalfEdge(e1);
+    int p1 = prevHalfEdge(e1);
+    int n2 = nextHalfEdge(e2);
+    int p2 = prevHalfEdge(e2);
+    int a = he_vertex[p1];
+    int b = he_vertex[p2];
+    //它们的对边，折叠之后两两成为对边
+    int on1 = he_opposite[n1];
+    int op1 = he_opposite[p1];
+    int on2 = he_opposite[n2];
+    int op2 = he_opposite[p2];
+    if (on1 < 0 || op1 < 0 || on2 < 0 || op2 < 0) {
+        he_ok[e1] = 0;
+        removeCandidate(e1);
+        return -1;
     }
-    //选择从对边开始的
-    tempEdge = e1->getOpposite()->getNext()->getOpposite();
-    while (tempEdge != NULL && tempEdge != e1->getOpposite()) {
-        changedTriangles.push_back(tempEdge->getTriangle());
-        tempEdge = tempEdge->getNext()->getOpposite();
+    //两个顶点都不能在边界上：开放网格上把两个边界点合并会产生非流形的点
+    std::vector<int> outgoing;
+    if (!getOutgoingHalfEdges(v1, outgoing) || !getOutgoingHalfEdges(v2, outgoing)) {
+        he_ok[e1] = 0;
+        he_ok[e2] = 0;
+        removeCandidate(e1);
+        removeCandidate(e2);
+        return -1;
     }
-
-    if (tempEdge != NULL) {
-        if (tempEdge->getTriangle()->getID() == e1->getTriangle()->getID() || tempEdge->getTriangle()->getID() == e1->getOpposite()->getTriangle()->getID()) {
-            if (changedTriangles.size() != 0)
-                changedTriangles.pop_back();
+    //判断是否重复：v1和v2的公共邻点只能是a和b，否则折叠后会出现重复的边
+    std::vector<int> ring1, ring2;
+    getOneRing(v1, ring1);
+    getOneRing(v2, ring2);
+    bool duplicate = (a == b);
+    for (unsigned int i = 0; i < ring1.size() && !duplicate; i++) {
+        for (unsigned int j = 0; j < ring2.size(); j++) {
+            if (ring1[i] == ring2[j] && ring1[i] != a && ring1[i] != b) {
+                duplicate = true;
+                break;
+            }
         }
     }
-
-    Vertex* v_new = addVertex(new_vec);
-    //涉及到的点
-    std::vector<Vertex*> changedVertex;
-    tempEdge = e1->getNext();
-    Vertex* tempVertex = tempEdge->getEndVertex();
-    while (1) {
-        if (tempEdge->getOpposite() == NULL) {
-            changedVertex.push_back(tempVertex);
-            break;
-        }
-        if (tempVertex == e1->getOpposite()->getNext()->getEndVertex()) {
-            break;
-        }
-        changedVertex.push_back(tempVertex);
-        tempEdge = tempEdge->getOpposite()->getNext();
-        tempVertex = tempEdge->getEndVertex();
+    if (duplicate){
+      if (print_progress) printf( "存在重复，重新选择边\n") ;
+      he_ok[e1] = 0;
+      removeCandidate(e1);
+      return -1;
     }
 
-    tempEdge = e1->getOpposite()->getNext();
-    tempVertex = tempEdge->getEndVertex();
-    while (1) {
-        if (tempEdge->getOpposite() == NULL) {
-            changedVertex.push_back(tempVertex);
-            break;
-        }
-        //终止条件
-        if (tempVertex == e1->getNext()->getEndVertex()) {
-            break;
+    //记录折叠之前的状态，用于之后把它撤销（顶点分裂）
+    if (split != NULL) {
+        split->v1 = v1; split->v2 = v2;
+        split->e1 = e1; split->e2 = e2;
+        split->on1 = on1; split->op1 = op1;
+        split->on2 = on2; split->op2 = op2;
+        for (int i = 0; i < 3; i++) {
+            split->pos1[i] = positions[v1][i];
+            split->pos2[i] = positions[v2][i];
+            split->collapsed[i] = new_vec[i];
         }
-        changedVertex.push_back(tempVertex);
-        tempEdge = tempEdge->getOpposite()->getNext();
-        tempVertex = tempEdge->getEndVertex();
+        split->crease[0] = he_crease[e1];
+        split->crease[1] = he_crease[on1];
+        split->crease[2] = he_crease[op1];
+        split->crease[3] = he_crease[on2];
+        split->crease[4] = he_crease[op2];
     }
-    //判断是否重复即是否有两个相同元素
-    std::vector<Vertex*>::iterator it1 = changedVertex.begin();
-    std::vector<Vertex*>::iterator it2;
-    for (; it1 < changedVertex.end(); it1++) {
-        int count = 0;
-        for (it2 = changedVertex.begin(); it2 < changedVertex.end(); it2++) {
-            if ((*it1)->getIndex() == (*it2)->getIndex()) {
-                count++;
-            }
-        }
-        if (count > 1){
-          printf( "存在重复，重新选择边\n") ;
-          e1->setIsOK(false);
-          return;
-        }
+    //需要删除的三角形
+    int triangle1 = halfEdgeTriangle(e1);
+    int triangle2 = halfEdgeTriangle(e2);
+    for (int i = 0; i < 3; i++) {
+        edges.erase(std::make_pair(he_vertex[3*triangle1+i], endVertex(3*triangle1+i)));
+        edges.erase(std::make_pair(he_vertex[3*triangle2+i], endVertex(3*triangle2+i)));
     }
-    //去除三角形
-    removeTriangle(triangle1);
-    removeTriangle(triangle2);
-    //更新三角形
-    std::vector<Triangle*>::iterator iter_tri = changedTriangles.begin();
-    for (; iter_tri != changedTriangles.end(); iter_tri++) {
-        Triangle* temp_tri = (*iter_tri);
-        Vertex* a = (*temp_tri)[0];
-        Vertex* b = (*temp_tri)[1];
-        Vertex* c = (*temp_tri)[2];
-        //先删除
-        removeTriangle(temp_tri);
-
-        if (a->getIndex() == v1->getIndex() || a->getIndex() == v2->getIndex()) {
-            a = v_new;
-        }
-        else if (b->getIndex() == v1->getIndex() || b->getIndex() == v2->getIndex()) {
-            b = v_new;
-        }
-        else if (c->getIndex() == v1->getIndex() || c->getIndex() == v2->getIndex()) {
-            c = v_new;
-        }
-
-        //后添加
-        addTriangle(a, b, c);
+    //v2周围剩下的半边都改为从v1出发（或指向v1）
+    getOutgoingHalfEdges(v2, outgoing);
+    for (unsigned int i = 0; i < outgoing.size(); i++) {
+        int h = outgoing[i];
+        if (halfEdgeTriangle(h) == triangle1 || halfEdgeTriangle(h) == triangle2) continue;
+        int w = endVertex(h);
+        int p = prevHalfEdge(h);
+        int u = he_vertex[p];
+        edges.erase(std::make_pair(v2, w));
+        edges.erase(std::make_pair(u, v2));
+        edges[std::make_pair(v1, w)] = h;
+        edges[std::make_pair(u, v1)] = p;
+        he_vertex[h] = v1;
+    }
+    //缝合对边
+    float crease1 = std::max(he_crease[on1], he_crease[op1]);
+    float crease2 = std::max(he_crease[on2], he_crease[op2]);
+    he_opposite[on1] = op1; he_opposite[op1] = on1;
+    he_opposite[on2] = op2; he_opposite[op2] = on2;
+    he_crease[on1] = he_crease[op1] = crease1;
+    he_crease[on2] = he_crease[op2] = crease2;
+    //去除三角形。缝合后其余的半边仍然都有对边，所以只有这6条半边不再能折叠
+    for (int i = 0; i < 3; i++) {
+        removeCandidate(3*triangle1+i);
+        removeCandidate(3*triangle2+i);
+        he_vertex[3*triangle1+i] = he_vertex[3*triangle2+i] = -1;
+        he_opposite[3*triangle1+i] = he_opposite[3*triangle2+i] = -1;
+        he_crease[3*triangle1+i] = he_crease[3*triangle2+i] = 0;
     }
+    num_triangles -= 2;
+    //更新顶点保存的出半边
+    vertex_halfedge[v1] = op1;
+    vertex_halfedge[a] = on1;
+    vertex_halfedge[b] = on2;
+    vertex_halfedge[v2] = -1;
+    //空出来的位置留给之后的addTriangle/addVertex
+    free_triangles.push_back(triangle1);
+    free_triangles.push_back(triangle2);
+    free_vertices.push_back(v2);
+    positions[v1] = new_vec;
+    markTriangleDirty(triangle1);
+    markTriangleDirty(triangle2);
+    markVertexDirty(v1);
+    markVertexDirty(v2);
+    //v2被折叠掉，v1的位置改变，堆中所有含有它们的点对失效
+    vertex_versions[v1]++;
+    vertex_versions[v2]++;
+    return v1;
 }
 
 int Mesh::getGoodEdge(){
-  int size=0;
-  for (edgeshashtype::iterator iter = edges.begin(); iter != edges.end(); iter++) {
-        Edge* e = iter->second;
-        if (!(e->getIsOK())) {
-            continue;
-        }
-        if (e->getOpposite() == NULL) {
-            e->setIsOK(false);
-            continue;
+  int num_half_edges = he_vertex.size();
+  collapse_candidates.clear();
+  candidate_slot.assign(num_half_edges, -1);
+  for (int e = 0; e < num_half_edges; e++) {
+        if (he_vertex[e] >= 0 && isCollapsible(e)) {
+            candidate_slot[e] = collapse_candidates.size();
+            collapse_candidates.push_back(e);
         }
-        else {
-            Triangle* t1 = e->getTriangle();
-            Triangle* t2 = e->getOpposite()->getTriangle();
-            //此边所在的三角形位于边界
-            if (t1->getEdge()->getOpposite() == NULL || t1->getEdge()->getNext()->getOpposite() == NULL || t1->getEdge()->getNext()->getNext()->getOpposite() == NULL||
-                t2->getEdge()->getOpposite() == NULL || t2->getEdge()->getNext()->getOpposite() == NULL || t2->getEdge()->getNext()->getNext()->getOpposite() == NULL) {
-                e->setIsOK(false);
-                continue;
-            }
+    }
+    return collapse_candidates.size();
+}
+
+void Mesh::removeCandidate(int h){
+    if (h >= (int)candidate_slot.size() || candidate_slot[h] < 0) return;
+    //最后一个元素移到h的位置上
+    int last = collapse_candidates.back();
+    collapse_candidates[candidate_slot[h]] = last;
+    candidate_slot[last] = candidate_slot[h];
+    collapse_candidates.pop_back();
+    candidate_slot[h] = -1;
+}
+
+bool Mesh::isCollapsible(int e){
+    if (!he_ok[e]) {
+        return false;
+    }
+    if (he_opposite[e] < 0) {
+        he_ok[e] = 0;
+        return false;
+    }
+    int t1 = halfEdgeTriangle(e);
+    int t2 = halfEdgeTriangle(he_opposite[e]);
+    //此边所在的三角形位于边界
+    for (int i = 0; i < 3; i++) {
+        if (he_opposite[3*t1+i] < 0 || he_opposite[3*t2+i] < 0) {
+            he_ok[e] = 0;
+            return false;
         }
-        size++;        
     }
-    return size;
+    return true;
 }
 
 void Mesh::getAllQ() {
     //计算每个顶点的Q
-    //对面进行迭代，并计算Kp,给Vertex设置Q变量
-    for (triangleshashtype::iterator iter = triangles.begin(); iter != triangles.end(); iter++) {
-        Triangle* t = iter->second;
-        Vec3f p1 = (*t)[0]->getPos();
-        Vec3f p2 = (*t)[1]->getPos();
-        Vec3f p3 = (*t)[2]->getPos();
-        Vec3f normal = ComputeNormal(p1, p2, p3);//计算法向量
-        float d = -normal.Dot3(p1);
+    //对面进行迭代，并计算Kp,给顶点设置Q变量
+    for (unsigned int i = 0; i < quadrics.size(); i++) {
+        quadrics[i].clear();
+    }
+    int num_slots = numTriangleSlots();
+    for (int t = 0; t < num_slots; t++) {
+        if (!isTriangleAlive(t)) continue;
+        Vec3f p1 = positions[he_vertex[3*t]];
+        Vec3f p2 = positions[he_vertex[3*t+1]];
+        Vec3f p3 = positions[he_vertex[3*t+2]];
         //计算每个平面的Kp
-        Matrix Kp;
         //p[a,b,c,d]ax+by+cz+d=0
-        float plane[4] = { normal.x(),normal.y(),normal.z(),d };
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                Kp.set(i, j, (double)(plane[i] * plane[j]));
-            }
-        }
+        Quadric Kp = Quadric::plane(p1, p2, p3);
         //对该平面上的每个顶点操作，对Kp进行累积
-        (*t)[0]->addQ(Kp);
-        (*t)[1]->addQ(Kp);
-        (*t)[2]->addQ(Kp);
+        quadrics[he_vertex[3*t]] += Kp;
+        quadrics[he_vertex[3*t+1]] += Kp;
+        quadrics[he_vertex[3*t+2]] += Kp;
     }
+    quadrics_valid = true;
 }
 void Mesh::getAllDistance(){
-  for (int i = 0; i < allPairs.size(); i++) {
-        allPairs[i].computeDistance(MaxDis);
-        if (allPairs[i].getDistance() >= MaxDis) {
-            allPairs[i].getEdge()->setIsOK(false);
+  //每个点对只写自己和自己的边，可以并行
+  parallelFor(allPairs.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        Pair &p = allPairs[i];
+        p.computeDistance(quadrics[p.getP1()] + quadrics[p.getP2()], positions[p.getP1()], positions[p.getP2()], MaxDis);
+        if (p.getDistance() >= MaxDis) {
+            he_ok[p.getEdge()] = 0;
         }
     }
+  });
 }
-bool cmp(Pair a, Pair b) { return a.getDistance() < b.getDistance(); }
 
 void Mesh::getAllPairs(){
-  for (edgeshashtype::iterator iter = edges.begin(); iter != edges.end(); iter++) {
-        Edge* e_ab = iter->second;
-        Vertex* a, * b;
-       
-        a = e_ab->getStartVertex();
-        b = e_ab->getEndVertex();
-        if (!(e_ab->getIsOK())) {
+  int num_half_edges = he_vertex.size();
+  for (int e_ab = 0; e_ab < num_half_edges; e_ab++) {
+        int a = he_vertex[e_ab];
+        if (a < 0) continue;
+        int b = endVertex(e_ab);
+        //两个方向的半边是同一个点对，只取一次
+        if (a > b) {
             continue;
         }
-        if (e_ab->getOpposite() == NULL) {
-            e_ab->setIsOK(false);
+        if (!isCollapsible(e_ab)) {
             continue;
         }
-        else {
-            Triangle* t1 = e_ab->getTriangle();
-            Triangle* t2 = e_ab->getOpposite()->getTriangle();
-            if (t1->getEdge()->getOpposite() == NULL || t1->getEdge()->getNext()->getOpposite() == NULL || t1->getEdge()->getNext()->getNext()->getOpposite() == NULL||
-                t2->getEdge()->getOpposite() == NULL || t2->getEdge()->getNext()->getOpposite() == NULL || t2->getEdge()->getNext()->getNext()->getOpposite() == NULL) {//此边所在的三角形位于边界
-                e_ab->setIsOK(false);
-                continue;
-            }
-        }
-        Pair pair(a, b, e_ab);
+        Pair pair(a, b, e_ab, vertex_versions[a], vertex_versions[b]);
         allPairs.push_back(pair);      
-        
     }
 }
 void Mesh::Simplification(int target_tri_count) {
-  vertex_parents.clear();
+  clearProgressiveMesh();
 
-  printf ("Simplify the mesh! %d -> %d\n", numTriangles(), target_tri_count);
+  if (print_progress) printf ("Simplify the mesh! %d -> %d\n", numTriangles(), target_tri_count);
 
-  // 随机挑选
+  // 随机挑选：先找出所有的好边，之后由simply()维护，每次只需O(1)
   MTRand rand;
-  int reChoose=0;
-  while(numTriangles()>target_tri_count){
-    //没有可以选择的边
-    if(getGoodEdge()==0)
-    {
-      printf("不存在可以选择的边了，无法优化！\n");
-      break;
-    }
-    //重选的次数过多
-    if(reChoose>15)break;
-    int edge_id = rand.randInt(numEdges() - 1);//随机挑选一个边
-    //找到这个三角形
-    edgeshashtype::iterator iter = edges.begin();
-    for (int i = 0; i < edge_id; i++) {
-        if (iter != edges.end()) {
-            iter++;
-        }
-    }
-    //要删除的边
-    Edge* e1=iter->second;
-    if (e1->getIsOK()) {//选择这个边，不会存在相同的
-        Vertex* v1 = e1->getStartVertex();
-        Vertex* v2 = e1->getEndVertex();
-        //计算新点位置
-        Vec3f new_vec = (v1->getPos() + v2->getPos()) * 0.5;
-        simply(e1,new_vec);
-        reChoose = 0;
-    }
-    else {
-      reChoose++;
-    }
+  if (getGoodEdge() == 0) {
+    printf("不存在可以选择的边了，无法优化！\n");
+  }
+  while(numTriangles()>target_tri_count && !collapse_candidates.empty()){
+    int edge_id = collapse_candidates[rand.randInt(collapse_candidates.size() - 1)];//随机挑选一个边
+    int v1 = he_vertex[edge_id];
+    int v2 = endVertex(edge_id);
+    //计算新点位置
+    Vec3f new_vec = (positions[v1] + positions[v2]) * 0.5;
+    //失败时simply()会把这条边从候选中去掉
+    simply(edge_id,new_vec);
   }
-  
+  collapse_candidates.clear();
+  candidate_slot.clear();
 }
-void Mesh::simply(Pair p){
-    Edge* e1 = p.getEdge();//需要修改的边
-    Edge* e2 = e1->getOpposite();
-    Edge* e_temp = e1->getNext()->getNext();
-    while (e_temp->getOpposite() != e1) {
-        if (e_temp->getOpposite() == NULL)//此边的顶点在边界上
-        {
-            e1->setIsOK(false);
-            e2->setIsOK(false);
-            return;
-        }
-        e_temp = e_temp->getOpposite()->getNext()->getNext();
-    }
-    //另一个顶点
-    e_temp = e2->getNext()->getNext();
-    while (e_temp->getOpposite() != e2) {
-        if (e_temp->getOpposite() == NULL)//此边的顶点在边界上
-        {
-            e1->setIsOK(false);
-            e2->setIsOK(false);
-            return;
-        }
-        e_temp = e_temp->getOpposite()->getNext()->getNext();
-    }
-
-    //需要修改的边所在的三角形（需删除的三角形）
-    Triangle* triangle1 = e1->getTriangle();
-    //另外半边的三角形
-    Triangle* triangle2 = e1->getOpposite()->getTriangle();
-    //寻找需要修改的三角形
-    std::vector<Triangle*> changedTriangles;
-    Edge* tempEdge = e1->getNext()->getOpposite();
-    while (tempEdge != NULL && tempEdge != e1) {
-        changedTriangles.push_back(tempEdge->getTriangle());
-        tempEdge = tempEdge->getNext()->getOpposite();
-    }
-    //去掉最后一个重复的
-    if (tempEdge != NULL) {
-        if (tempEdge->getTriangle()->getID() == e1->getTriangle()->getID() || tempEdge->getTriangle()->getID() == e1->getOpposite()->getTriangle()->getID()) {
-            if (changedTriangles.size() != 0)
-                changedTriangles.pop_back();
-        }
-    }
-    //选择从对边开始的
-    tempEdge = e1->getOpposite()->getNext()->getOpposite();
-    while (tempEdge != NULL && tempEdge != e1->getOpposite()) {
-        changedTriangles.push_back(tempEdge->getTriangle());
-        tempEdge = tempEdge->getNext()->getOpposite();
-    }
-
-    if (tempEdge != NULL) {
-        if (tempEdge->getTriangle()->getID() == e1->getTriangle()->getID() || tempEdge->getTriangle()->getID() == e1->getOpposite()->getTriangle()->getID()) {
-            if (changedTriangles.size() != 0)
-                changedTriangles.pop_back();
-        }
-    }
-    //添加顶点
-    Vertex* v_new = addVertex(p.getResult());
-    v_new->setQ(p.getP1()->getQ() + p.getP2()->getQ());
-
-    //涉及到的点
-    std::vector<Vertex*> changedVertex;
-    tempEdge = e1->getNext();
-    Vertex* tempVertex = tempEdge->getEndVertex();
-    while (1) {
-        if (tempEdge->getOpposite() == NULL) {
-            changedVertex.push_back(tempVertex);
-            break;
-        }
-        if (tempVertex == e1->getOpposite()->getNext()->getEndVertex()) {
-            break;
-        }
-        changedVertex.push_back(tempVertex);
-        tempEdge = tempEdge->getOpposite()->getNext();
-        tempVertex = tempEdge->getEndVertex();
-    }
-
-    tempEdge = e1->getOpposite()->getNext();
-    tempVertex = tempEdge->getEndVertex();
-    while (1) {
-        if (tempEdge->getOpposite() == NULL) {
-            changedVertex.push_back(tempVertex);
-            break;
-        }
-        //终止条件
-        if (tempVertex == e1->getNext()->getEndVertex()) {
-            break;
-        }
-        changedVertex.push_back(tempVertex);
-        tempEdge = tempEdge->getOpposite()->getNext();
-        tempVertex = tempEdge->getEndVertex();
-    }
-    // 判断是否重复即是否有两个相同元素
-    std::vector<Vertex*>::iterator it1 = changedVertex.begin();
-    std::vector<Vertex*>::iterator it2;
-    for (; it1 < changedVertex.end(); it1++) {
-        int count = 0;
-        for (it2 = changedVertex.begin(); it2 < changedVertex.end(); it2++) {
-            if ((*it1)->getIndex() == (*it2)->getIndex()) {
-                count++;
-            }
-        }
-        if (count > 1){
-          printf( "存在重复，重新选择边\n") ;
-          e1->setIsOK(false);
-          return;
-        }
-    }
-
-
-    //去除三角形
-    removeTriangle(triangle1);
-    removeTriangle(triangle2);
-    //更新三角形
-    std::vector<Triangle*>::iterator iter_tri = changedTriangles.begin();
-    for (; iter_tri != changedTriangles.end(); iter_tri++) {
-        Triangle* temp_tri = (*iter_tri);
-        Vertex* a = (*temp_tri)[0];
-        Vertex* b = (*temp_tri)[1];
-        Vertex* c = (*temp_tri)[2];
-        //先删除
-        removeTriangle(temp_tri);
-        if (a->getIndex() == p.getP1()->getIndex() || a->getIndex() == p.getP2()->getIndex()) {
-            a = v_new;
-        }
-        else if (b->getIndex() == p.getP1()->getIndex() || b->getIndex() == p.getP2()->getIndex()) {
-            b = v_new;
-        }
-        else if (c->getIndex() == p.getP1()->getIndex() || c->getIndex() == p.getP2()->getIndex()) {
-            c = v_new;
-        }
-        //后添加
-        addTriangle(a, b, c);
-    }
+int Mesh::simply(Pair p, std::vector<int> &ring, VertexSplit *split){
+    int e1 = p.getEdge();//需要修改的边
+    Quadric Q = quadrics[p.getP1()] + quadrics[p.getP2()];
+    int v_new = simply(e1, p.getResult(), split);
+    if (v_new < 0) return -1;
+    quadrics[v_new] = Q;
+    getOneRing(v_new, ring);
+    return v_new;
 }
-void Mesh::Simplification_QEM(int target_tri_count) {
-    vertex_parents.clear();
+void Mesh::Simplification_QEM(int target_tri_count, std::vector<VertexSplit> *record, double max_cost) {
+    //之前记录的折叠对改变后的网格不再适用
+    clearProgressiveMesh();
+    //细分之后新顶点还没有Q，旧顶点的Q也对不上新的面了
+    if (!quadrics_valid) getAllQ();
+
+    if (print_progress) printf("Simplification_QEM the mesh! %d -> %d\n", numTriangles(), target_tri_count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    printf("Simplification_QEM the mesh! %d -> %d\n", numTriangles(), target_tri_count);
-    
+    //每个点对的代价只在这里计算一次，之后建成最小堆
+    allPairs.clear();
     getAllPairs();
     getAllDistance();
-    while (numTriangles() > target_tri_count) {
-        if (allPairs.size() == 0) break;
-        if (allPairs[0].getDistance() >= MaxDis) break;
-        sort(allPairs.begin(), allPairs.end(), cmp);
-        Pair p = allPairs[0];
-        simply(p);
-
-        allPairs.clear();
-        //重新选择
-        getAllPairs();
-        getAllDistance();
+    std::make_heap(allPairs.begin(), allPairs.end(), PairGreater());
+    noteMemoryUse();
+
+    int collapses = 0;
+    std::vector<int> ring;
+    while (numTriangles() > target_tri_count && !allPairs.empty()) {
+        std::pop_heap(allPairs.begin(), allPairs.end(), PairGreater());
+        Pair p = allPairs.back();
+        allPairs.pop_back();
+        if (p.getDistance() >= MaxDis) break;
+        if (max_cost >= 0 && p.getDistance() > max_cost) break;
+        //端点在入堆后被修改过，点对已过期（惰性删除）
+        if (!p.isValid(vertex_versions)) continue;
+        int e = getMeshEdge(p.getP1(), p.getP2());
+        if (e < 0 || !isCollapsible(e)) continue;
+        Pair current(p.getP1(), p.getP2(), e, vertex_versions[p.getP1()], vertex_versions[p.getP2()]);
+        current.setDistance(p.getDistance());
+        current.setResult(p.getResult());
+        VertexSplit split;
+        int v_new = simply(current, ring, record != NULL ? &split : NULL);
+        if (v_new < 0) continue;
+        if (record != NULL) record->push_back(split);
+        collapses++;
+
+        //只有新顶点一环邻域内的点对需要重新计算代价
+        for (unsigned int i = 0; i < ring.size(); i++) {
+            int e_new = getMeshEdge(v_new, ring[i]);
+            if (e_new < 0) e_new = getMeshEdge(ring[i], v_new);
+            if (e_new < 0) continue;
+            int a = he_vertex[e_new];
+            int b = endVertex(e_new);
+            Pair pair(a, b, e_new, vertex_versions[a], vertex_versions[b]);
+            pair.computeDistance(quadrics[a] + quadrics[b], positions[a], positions[b], MaxDis);
+            if (pair.getDistance() >= MaxDis) continue;
+            allPairs.push_back(pair);
+            std::push_heap(allPairs.begin(), allPairs.end(), PairGreater());
+        }
     }
+    allPairs.clear();
 
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (print_progress)
+      printf("QEM: %d collapses in %.3f s (%.0f collapses/sec), %d triangles left\n",
+             collapses, seconds, seconds > 0 ? collapses / seconds : 0.0, numTriangles());
 }
 // =================================================================
 
+
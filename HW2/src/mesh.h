@@ -3,24 +3,52 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include "vectors.h"
 #include "hash.h"
 #include "boundingbox.h"
 #include "argparser.h"
-#include "matrix.h"
+#include "quadric.h"
 #include "Pair.h"
+#include "stencil.h"
+#include "progressivemesh.h"
+#include "morton.h"
 
-class Vertex;
-class Edge;
-class Triangle;
 class Pair;
+class MeshWriter;
+
+// ==========================================================
+// vertex classification used by Loop subdivision
+enum VertexType{
+  smooth,//s为0
+  dart,//s=1
+  reg_crease,//s=2valence 是6，crese两边都是smooth；边界的valence是4
+  non_reg_crease,//s=2,非reg的
+  corner//s>2
+};
+
+
+// ==========================================================
+// what Mesh::getMemoryStats reports; removed vertices & triangles leave
+// free slots that are reused before the arrays grow
+struct MeshMemoryStats {
+  int live_vertices;
+  int vertex_slots;
+  int live_triangles;
+  int triangle_slots;
+  size_t bytes;        // all the arrays & hash tables, as allocated
+  size_t peak_bytes;   // the most bytes seen so far
+  // the edge table (flathash.h)
+  int edge_entries, edge_slots;
+  double edge_probe_length;
+};
 
 
 // ======================================================================
 // ======================================================================
 
 // helper structures for VBOs, for rendering
-// (note, the data stored in each of these is application specific, 
+// (note, the data stored in each of these is application specific,
 // adjust as needed!)
 
 struct VBOVert {
@@ -60,9 +88,41 @@ struct VBOTri {
   unsigned int verts[3];
 };
 
+// the unit normal of triangle p1 p2 p3 (mesh.cpp)
+Vec3f ComputeNormal(const Vec3f &p1, const Vec3f &p2, const Vec3f &p3);
+
+// fixed size records in a VBO that keep their slot between uploads: a
+// removed record becomes a degenerate tombstone and its slot goes to
+// the next new one; count (including the tombstones) is what is drawn
+struct VBOSlots {
+  VBOSlots() { count = 0; capacity = 0; }
+  void reset(int used, int cap) { count = used; capacity = cap; free_slots.clear(); }
+  // -1 if the buffer is full
+  int allocate() {
+    if (!free_slots.empty()) {
+      int s = free_slots.back();
+      free_slots.pop_back();
+      return s;
+    }
+    if (count == capacity) return -1;
+    return count++;
+  }
+  void release(int s) { free_slots.push_back(s); }
+  int count;
+  int capacity;
+  std::vector<int> free_slots;
+};
+
 // ======================================================================
 // ======================================================================
 // Stores and renders all the vertices, triangles, and edges for a 3D model
+//
+// The adjacency is an index based half-edge structure kept as parallel
+// arrays.  Triangle f owns half-edges 3f, 3f+1 and 3f+2 (in order), so
+// the next/prev half-edge and the owning triangle are index arithmetic;
+// only the start vertex, the opposite half-edge and the crease weight
+// are stored per half-edge.  Removed triangles leave a hole whose
+// half-edges have a start vertex of -1.
 
 class Mesh {
 
@@ -70,75 +130,157 @@ public:
 
   // ========================
   // CONSTRUCTOR & DESTRUCTOR
-  Mesh(ArgParser *a) { args = a; }
+  Mesh(ArgParser *a) {
+    args = a; num_triangles = 0; quadrics_valid = false;
+    print_progress = true; vbos_initialized = false; pm_level = 0;
+    peak_bytes = 0; vbos_dirty_all = true; vbo_gouraud = vbo_nonmanifold = false;
+    vbo_render_verts = vbo_render_capacity = vbo_render_garbage = 0;
+    vbo_verts_capacity = 0; }
   ~Mesh();
   void Load(const std::string &input_file);
-  
+  // builds the mesh from 3 vertex indices per triangle (e.g. the output
+  // of ClusterSimplify, see clustersimplify.h)
+  void LoadTriangles(const std::vector<Vec3f> &verts, const std::vector<int> &tris);
+  // writes the live vertices & triangles (renumbered in order)
+  bool Save(MeshWriter &writer, const std::string &output_file) const;
+  // the processing operations report what they do unless this is off
+  void setPrintProgress(bool p) { print_progress = p; }
+
+  // =================
+  // BINARY MESH CACHE (see meshcache.cpp)
+  // bunny.obj is cached as bunny.meshbin in the same directory
+  static std::string cacheFileName(const std::string &input_file);
+  // returns false if the cache is missing, damaged or older than the source
+  bool LoadCache(const std::string &cache_file, const std::string &source_file);
+  bool SaveCache(const std::string &cache_file, const std::string &source_file) const;
+
+  // ================
+  // PROGRESSIVE MESH (see progressivemesh.cpp)
+  // bunny.obj is saved as bunny.pm in the same directory
+  static std::string progressiveFileName(const std::string &input_file);
+  // simplify with QEM as far as it goes, recording every collapse, then
+  // split back to the full mesh; any level of detail is then a replay
+  void BuildProgressiveMesh();
+  bool hasProgressiveMesh() const { return !pm_splits.empty(); }
+  // replay collapses / splits until there are at most target_tri_count
+  // triangles (and no more than that after one more split)
+  // returns the number of triangles
+  int SetLevelOfDetail(int target_tri_count);
+  // the coarsest mesh & the splits back to the full mesh in one file,
+  // which can then be used directly as the -input
+  bool LoadProgressiveMesh(const std::string &pm_file);
+  bool SaveProgressiveMesh(const std::string &pm_file);
+
+  // ==========
+  // REORDERING (see meshreorder.cpp)
+  // renumbers the vertices & triangles in the order of the curve (by
+  // position & centroid), so neighbours are mostly close in memory;
+  // removed & unused slots are dropped
+  void ReorderAlongCurve(SpaceCurve curve);
+
   // ========
   // VERTICES
-  int numVertices() const { return vertices.size(); }
-  Vertex* addVertex(const Vec3f &pos);
-  // look up vertex by index from original .obj file
-  Vertex* getVertex(int i) const {
+  int numVertices() const { return positions.size(); }
+  int addVertex(const Vec3f &pos);
+  // look up vertex position by index from original .obj file
+  const Vec3f& getPos(int i) const {
     assert (i >= 0 && i < numVertices());
-    Vertex *v = vertices[i];
-    assert (v != NULL);
-    return v; }
-
-  // ==================================================
-  // PARENT VERTEX RELATIONSHIPS (used for subdivision)
-  // this creates a relationship between 3 vertices (2 parents, 1 child)
-  void setParentsChild(Vertex *p1, Vertex *p2, Vertex *child);
-  // this accessor will find a child vertex (if it exists) when given
-  // two parent vertices
-  Vertex* getChildVertex(Vertex *p1, Vertex *p2) const;
-
-  // =====
-  // EDGES
-  int numEdges() const { return edges.size(); }
-  // this efficiently looks for an edge with the given vertices, using a hash table
-  Edge* getMeshEdge(Vertex *a, Vertex *b) const;
+    return positions[i]; }
+  // a vertex that was collapsed away (or never used) has no half-edge
+  bool isVertexAlive(int i) const { return vertex_halfedge[i] >= 0; }
+
+  // ==========
+  // HALF-EDGES
+  int numEdges() const { return 3*num_triangles; }
+  static int nextHalfEdge(int h) { return (h % 3 == 2) ? h - 2 : h + 1; }
+  static int prevHalfEdge(int h) { return (h % 3 == 0) ? h + 2 : h - 1; }
+  static int halfEdgeTriangle(int h) { return h / 3; }
+  int startVertex(int h) const { return he_vertex[h]; }
+  int endVertex(int h) const { return he_vertex[nextHalfEdge(h)]; }
+  // warning!  the opposite half-edge is -1 on the boundary
+  int oppositeHalfEdge(int h) const { return he_opposite[h]; }
+  float getCrease(int h) const { return he_crease[h]; }
+  // this efficiently looks for the half-edge from a to b, using a hash table
+  // (returns -1 if there is none)
+  int getMeshEdge(int a, int b) const;
 
   // =========
   // TRIANGLES
-  int numTriangles() const { return triangles.size(); }
-  void addTriangle(Vertex *a, Vertex *b, Vertex *c);
-  void removeTriangle(Triangle *t);
+  int numTriangles() const { return num_triangles; }
+  // number of triangle slots, including the holes left by removed triangles
+  int numTriangleSlots() const { return he_vertex.size() / 3; }
+  bool isTriangleAlive(int t) const { return he_vertex[3*t] >= 0; }
+  int getTriangleVertex(int t, int i) const { return he_vertex[3*t+i]; }
+  int addTriangle(int a, int b, int c);
+  void removeTriangle(int t);
+
+  // ===========
+  // ONE-RING CIRCULATION
+  /// @brief 从顶点保存的出半边开始绕一圈，取出所有以v为起点的半边
+  /// @return 顶点周围是封闭的（不在边界上）时返回true
+  bool getOutgoingHalfEdges(int v, std::vector<int> &outgoing) const;
+  /// @brief 取出顶点一环邻域上的所有顶点
+  void getOneRing(int v, std::vector<int> &ring) const;
 
   // ===============
   // OTHER ACCESSORS
   const BoundingBox& getBoundingBox() const { return bbox; }
-  
+  MeshMemoryStats getMemoryStats() const;
+  void printMemoryStats() const;
+
   // ===+=====
   // RENDERING
   void initializeVBOs();
+  // rebuilds all the buffers (and compacts them)
   void setupVBOs();
+  // uploads only what changed since the last setupVBOs / updateVBOs,
+  // in place; falls back to setupVBOs after a change of the whole mesh
+  // (see vboupdate.cpp)
+  void updateVBOs();
   void drawVBOs();
   void cleanupVBOs();
 
   // ==========================
   // MESH PROCESSING OPERATIONS
-  void LoopSubdivision();
+  // if stencils is given, the weights used for every new vertex
+  // position are recorded there (see stencil.h)
+  void LoopSubdivision(StencilTable *stencils = NULL);
   void Simplification(int target_tri_count);
 
-  void ButterflySubdivision();
-  void Simplification_QEM(int target_tri_count);
-  
+  void ButterflySubdivision(StencilTable *stencils = NULL);
+  // subdivides patch by patch and streams the triangles to the writer,
+  // without ever building the whole refined mesh (streamsubdivision.cpp)
+  bool StreamSubdivision(int levels, bool butterfly, MeshWriter &writer, const std::string &output_file);
+  // if record is given, every collapse is appended to it (see progressivemesh.h)
+  // pairs that cost more than max_cost (if it is >= 0) are not collapsed
+  void Simplification_QEM(int target_tri_count, std::vector<VertexSplit> *record = NULL, double max_cost = -1);
+  // the same, with the interiors of spatial clusters simplified in
+  // parallel first (see parallelqem.cpp)
+  void ParallelSimplification_QEM(int target_tri_count, double tolerance);
+  /// @brief 从所有的面重新计算每个顶点的Q
+  void getAllQ();
+
 //==============
 //简化所增加函数
 //==============
-  /// @brief 简化
-  /// @param e1 被选择的边
-  /// @param new_vec 新位置
-  void simply(Edge* e1,Vec3f new_vec);
+  /// @brief 简化：把半边h折叠掉，终点合并到起点上
+  /// @param h 被选择的半边
+  /// @param new_vec 合并后顶点的新位置
+  /// @param split 不为NULL时记录下撤销这次折叠所需的信息
+  /// @return 保留下来的顶点，折叠失败时返回-1
+  int simply(int h,Vec3f new_vec,VertexSplit *split = NULL);
   /// @brief 简化
   /// @param p 点对
-  void simply(Pair p);
-  /// @brief 排除边界边并获得当前好边的个数
+  /// @param ring 折叠成功时返回新顶点一环邻域上的顶点
+  /// @param split 不为NULL时记录下这次折叠
+  /// @return 新顶点，折叠失败时返回-1
+  int simply(Pair p, std::vector<int> &ring, VertexSplit *split = NULL);
+  /// @brief 排除边界边，把当前所有的好边放进collapse_candidates
   /// @return 当前好边的个数
   int getGoodEdge();
-  void getAllQ();
-  /// @brief 获取所有的好点对
+  /// @brief 判断一条边是否可以被折叠（不是边界边，两侧三角形也不在边界上）
+  bool isCollapsible(int h);
+  /// @brief 获取所有的好点对，每条无向边只取一次
   void getAllPairs();
   /// @brief 获取所有的distance
   void getAllDistance();
@@ -156,23 +298,123 @@ private:
   // helper functions
   void setupTriVBOs();
   void setupEdgeVBOs();
-  
+  // shared vertices with smooth normals, split at creases (gouraud
+  // mode); also records the vbo_ layout of triangles & vertices
+  void buildSmoothTriangleVertices(std::vector<VBOTriVert> &verts, std::vector<unsigned int> &indices);
+  // the corners (outgoing half-edges) around v in order and the
+  // smoothing group of each; returns the number of groups
+  int getSmoothingGroups(int v, std::vector<int> &corners, std::vector<int> &groups) const;
+  // uploads the records that depend on the dirty triangles & vertices;
+  // false if a buffer ran out of room or the edit is too large to pay
+  // off (then nothing was uploaded)
+  bool patchVBOs();
+  // what an edit changed, for updateVBOs
+  void markTriangleDirty(int t) { if (vbos_initialized && !vbos_dirty_all) dirty_triangles.push_back(t); }
+  void markVertexDirty(int v) { if (vbos_initialized && !vbos_dirty_all) dirty_vertices.push_back(v); }
+  void markAllDirty() { vbos_dirty_all = true; dirty_triangles.clear(); dirty_vertices.clear(); }
+  // the class of edge a half-edge is drawn as (0 boundary, 1 crease,
+  // 2 other), -1 if it is not drawn
+  int edgeClass(int h) const;
+  /// @brief 把每个三角形分成4个，直接由旧的半边算出新的对边，并把crease传给子边
+  /// @param edge_child 每条半边上新加的顶点（两个方向相同）
+  void refineTriangles(const std::vector<int> &edge_child);
+  // pair up the half-edges of all triangles in he_vertex at once and
+  // rebuild the vertex half-edges & the edge hash table
+  void buildConnectivity();
+  void buildEdgeIndex();
+  /// @brief 给每条无向边编号一个新顶点，并把顶点数组扩大
+  /// @param edge_child 返回每条半边上的新顶点（两个方向相同）
+  /// @return 新的顶点总数
+  int addEdgeChildren(std::vector<int> &edge_child);
+  // 细分规则，对sink调用add(顶点, 权重)，见mesh.cpp
+  template <class Sink>
+  void loopEdgeRule(int e, const std::vector<VertexType> &vertex_types, Sink &sink) const;
+  template <class Sink>
+  void loopVertexRule(int v, const std::vector<VertexType> &vertex_types, std::vector<int> &outgoing, Sink &sink) const;
+  template <class Sink>
+  void butterflyEdgeRule(int e, Sink &sink) const;
+  template <class Sink>
+  void butterflyExtraordinaryRule(int v1, int v2, const std::vector<int> &v1_around, double scale, Sink &sink) const;
+  /// @brief 把半边h从collapse_candidates中去掉（和最后一个交换后删除）
+  void removeCandidate(int h);
+  // undo / redo one recorded collapse (progressivemesh.cpp)
+  void applyVertexSplit(const VertexSplit &split);
+  void applyCollapse(const VertexSplit &split);
+  void clearProgressiveMesh() { pm_splits.clear(); pm_level = 0; }
+  // ReorderAlongCurve with the curve of the -reorder option, if any
+  void applyReorderOption();
+  // bytes used by all the arrays & tables right now
+  size_t memoryBytes() const;
+  // called wherever the arrays reallocate, to keep track of the peak
+  void noteMemoryUse() { peak_bytes = std::max(peak_bytes, memoryBytes()); }
+
   // ==============
   // REPRESENTATION
   ArgParser *args;
-  std::vector<Vertex*> vertices;
+
+  // per-vertex attributes
+  std::vector<Vec3f> positions;
+  std::vector<Quadric> quadrics;     // Q矩阵（对称，只存10个数）
+  std::vector<int> vertex_creases;   // 该顶点连接的crease边的数量(s)
+  std::vector<int> vertex_versions;  // 版本号，用于Simplification_QEM中堆的惰性删除
+  std::vector<int> vertex_halfedge;  // one outgoing half-edge, -1 if unused
+
+  // per-half-edge attributes (3 per triangle slot)
+  std::vector<int> he_vertex;        // start vertex, -1 for a removed triangle
+  std::vector<int> he_opposite;      // -1 on the boundary
+  std::vector<float> he_crease;      // extra field used during subdivision
+  std::vector<char> he_ok;           // 表示删除这条边是不是可以的
+
+  // 细分会让quadrics失效，Simplification_QEM之前重新计算
+  bool quadrics_valid;
+
+  // slots of removed triangles & vertices, reused by addTriangle and
+  // addVertex (last freed first, which a vertex split relies on)
+  std::vector<int> free_triangles;
+  std::vector<int> free_vertices;
+  size_t peak_bytes;
+
+  int num_triangles;
   edgeshashtype edges;
-  triangleshashtype triangles;
   BoundingBox bbox;
-  vphashtype vertex_parents;
 
-  //存放所有的Pair
-  std::vector<Pair> allPairs;
+  //随机简化时可以折叠的半边，candidate_slot是每条半边在其中的位置（不在时为-1），
+  //由simply()维护，这样随机取边和删除都是O(1)
+  std::vector<int> collapse_candidates;
+  std::vector<int> candidate_slot;
 
-  int num_boundary_edges;
-  int num_crease_edges;
-  int num_other_edges;
+  //记录下的所有折叠，前pm_level个当前是折叠的状态
+  std::vector<VertexSplit> pm_splits;
+  int pm_level;
+
+  //存放所有的Pair，Simplification_QEM中作为最小堆使用
+  std::vector<Pair> allPairs;
 
+  // where everything is in the VBOs, so that updateVBOs can patch it
+  bool vbo_gouraud;                     // which shading the triangle VBOs have
+  bool vbo_nonmanifold;                 // gouraud: some corners got vertices of their own
+  VBOSlots vbo_tri_slots;
+  std::vector<int> vbo_tri_slot;        // per triangle slot, -1 if not in the VBO
+  // gouraud: the smoothing groups of a vertex are the render vertices
+  // vbo_vertex_first[v] .. + vbo_vertex_count[v]-1
+  std::vector<int> vbo_vertex_first;
+  std::vector<int> vbo_vertex_count;
+  int vbo_render_verts;                 // used, including the garbage
+  int vbo_render_capacity;
+  int vbo_render_garbage;               // left behind by vertices that moved
+  VBOSlots vbo_edge_slots[3];           // boundary, crease, other edges
+  std::vector<char> vbo_edge_class;     // per half-edge, see edgeClass
+  std::vector<int> vbo_edge_slot;
+  int vbo_verts_capacity;               // edge vertices, 1 per vertex slot
+  std::vector<int> dirty_triangles;
+  std::vector<int> dirty_vertices;
+  bool vbos_dirty_all;
+
+  // turned off for the small meshes used by StreamSubdivision & in
+  // batch mode
+  bool print_progress;
+
+  bool vbos_initialized;
   GLuint mesh_tri_verts_VBO;
   GLuint mesh_tri_indices_VBO;
   GLuint mesh_verts_VBO;
@@ -0,0 +1,392 @@
+// =======================================================================
+// mesh_bench: times the mesh operations on every model & writes the
+// results as JSON, so runs of different versions can be compared.
+//
+//   ./mesh_bench ../../model > bench.json
+//   ./mesh_bench -levels 2 -o bench.json ../../model/bunny_40k.obj
+//   ./mesh_bench -reorder hilbert ../../model > bench_hilbert.json
+//
+// For each model (a directory stands for all its .obj files):
+//   load                     parse the .obj (the .meshbin cache is not used)
+//   reorder                  with -reorder morton|hilbert only: renumber the
+//                            loaded mesh along the curve; the other
+//                            operations then start from the reordered mesh
+//   getAllQ                  the vertex quadrics of the loaded mesh
+//   vertex_cache             Forsyth ordering of its triangles
+//                            (vertexcache.h); acmr_before / acmr_after
+//                            are the average cache miss ratios of the
+//                            loaded & the optimized order
+//   loop_N / butterfly_N     subdivision, level N timed on its own
+//   loop_stencils /          the stencil tables of all those levels,
+//   butterfly_stencils       composed & applied to the loaded positions
+//                            (stencil.h); max_deviation is the largest
+//                            distance to the subdivided mesh
+//   loop_stencils_sse /      the same with the float SSE apply, which must
+//   butterfly_stencils_sse   stay within STENCIL_FLOAT_TOLERANCE
+//   random_P / qem_P /       simplification of the loaded mesh to P% of
+//   parallel_qem_P           its triangles (50, 10 & 1); the parallel
+//                            QEM's error bound is only a heuristic, so
+//                            compare its hausdorff & rms with qem_P's
+// Every entry has the wall time, triangles per second (of the larger of
+// the input & output meshes), the peak resident set size during the
+// operation, and the size & probe length of the edge table afterwards.
+// The simplifications also get their Hausdorff & rms distance to the
+// loaded mesh (meshdistance.h, as fractions of its bounding box
+// diagonal) and the time it took to measure them.
+// Progress goes to stderr.
+// =======================================================================
+
+#include "glCanvas.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <sys/resource.h>
+
+#include "argparser.h"
+#include "mesh.h"
+#include "meshdistance.h"
+#include "parallel.h"
+#include "vertexcache.h"
+
+// levels that would have more triangles than this are skipped
+#define BENCH_MAX_TRIANGLES 4000000
+// the float stencil apply may be this far off the subdivided mesh,
+// relative to the largest control point coordinate
+#define STENCIL_FLOAT_TOLERANCE 1e-5
+
+static double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ===================================================================
+// PEAK RSS
+
+// Linux keeps the peak (VmHWM) per process, but writing 5 to clear_refs
+// resets it to the current size, so every operation gets its own peak.
+// Elsewhere this is the peak of the whole run so far.
+static void resetPeakRSS() {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (f == NULL) return;
+  fputs("5", f);
+  fclose(f);
+}
+
+static long peakRSSKB() {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f != NULL) {
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+      if (strncmp(line, "VmHWM:", 6) == 0) kb = atol(line+6);
+    }
+    fclose(f);
+    if (kb >= 0) return kb;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// ===================================================================
+// JSON OUTPUT
+
+static std::string jsonString(const std::string &s) {
+  std::string result = "\"";
+  for (unsigned int i = 0; i < s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\') result += '\\';
+    result += s[i];
+  }
+  return result + "\"";
+}
+
+class BenchOutput {
+public:
+  BenchOutput(FILE *f, const std::string &r) : file(f), reorder(r), first_model(true), first_op(true) {}
+
+  void begin() {
+    fprintf(file, "{\n  \"threads\": %d,\n  \"reorder\": %s,\n  \"models\": [",
+            numWorkerThreads(), jsonString(reorder).c_str());
+  }
+  void beginModel(const std::string &name, const Mesh &mesh) {
+    fprintf(file, "%s\n    {\n      \"model\": %s,\n      \"vertices\": %d,\n      \"triangles\": %d,\n      \"operations\": [",
+            first_model ? "" : ",", jsonString(name).c_str(), mesh.numVertices(), mesh.numTriangles());
+    first_model = false;
+    first_op = true;
+  }
+  void operation(const std::string &name, double seconds, int tris_in, const Mesh &mesh, long rss_kb,
+                 double max_deviation = -1, const ApproximationError *error = NULL,
+                 double error_seconds = 0, double acmr_before = -1, double acmr_after = -1) {
+    MeshMemoryStats stats = mesh.getMemoryStats();
+    int tris = std::max(tris_in, mesh.numTriangles());
+    fprintf(file, "%s\n        { \"op\": %s, \"seconds\": %.6f, \"triangles_in\": %d, \"triangles_out\": %d, "
+            "\"triangles_per_second\": %.0f, \"peak_rss_kb\": %ld, \"mesh_bytes\": %zu,\n"
+            "          \"edge_table\": { \"entries\": %d, \"slots\": %d, \"probe_length\": %.3f }",
+            first_op ? "" : ",", jsonString(name).c_str(), seconds, tris_in, mesh.numTriangles(),
+            seconds > 0 ? tris / seconds : 0.0, rss_kb, stats.bytes,
+            stats.edge_entries, stats.edge_slots, stats.edge_probe_length);
+    if (max_deviation >= 0) {
+      fprintf(file, ",\n          \"max_deviation\": %.6g", max_deviation);
+    }
+    if (error != NULL) {
+      double scale = (error->diagonal > 0) ? 1 / error->diagonal : 0;
+      fprintf(file, ",\n          \"hausdorff\": %.6g, \"rms\": %.6g, \"error_seconds\": %.6f",
+              error->hausdorff() * scale, error->rms() * scale, error_seconds);
+    }
+    if (acmr_before >= 0) {
+      fprintf(file, ",\n          \"acmr_before\": %.4f, \"acmr_after\": %.4f", acmr_before, acmr_after);
+    }
+    fprintf(file, " }");
+    first_op = false;
+  }
+  void endModel() { fprintf(file, "\n      ]\n    }"); }
+  void end() { fprintf(file, "\n  ]\n}\n"); }
+
+private:
+  FILE *file;
+  std::string reorder;
+  bool first_model, first_op;
+};
+
+// ===================================================================
+// THE OPERATIONS
+
+// returns false if the model has no triangles
+static bool loadMesh(Mesh &mesh, const std::string &filename) {
+  mesh.setPrintProgress(false);
+  mesh.Load(filename);
+  return mesh.numTriangles() > 0;
+}
+
+static void benchSubdivision(ArgParser &args, const std::string &filename, bool butterfly,
+                             int levels, BenchOutput &out) {
+  Mesh mesh(&args);
+  loadMesh(mesh, filename);
+  for (int level = 1; level <= levels; level++) {
+    int tris_in = mesh.numTriangles();
+    if (4LL * tris_in > BENCH_MAX_TRIANGLES) break;
+    fprintf(stderr, "  %s %d\n", butterfly ? "butterfly" : "loop", level);
+    resetPeakRSS();
+    double start = now();
+    if (butterfly) mesh.ButterflySubdivision();
+    else mesh.LoopSubdivision();
+    double seconds = now() - start;
+    out.operation((butterfly ? "butterfly_" : "loop_") + std::to_string(level), seconds, tris_in, mesh, peakRSSKB());
+  }
+}
+
+// subdivides once recording the stencils, then times re-evaluating the
+// finest level from the loaded positions with the composed tables, in
+// double precision & with the 4-float SSE kernel
+static void benchStencils(ArgParser &args, const std::string &filename, bool butterfly,
+                          int levels, BenchOutput &out) {
+  Mesh mesh(&args);
+  loadMesh(mesh, filename);
+  int tris_in = mesh.numTriangles();
+  std::vector<Vec3f> control(mesh.numVertices());
+  for (int i = 0; i < mesh.numVertices(); i++) control[i] = mesh.getPos(i);
+  std::vector<StencilTable> tables;
+  for (int level = 1; level <= levels; level++) {
+    if (4LL * mesh.numTriangles() > BENCH_MAX_TRIANGLES) break;
+    tables.push_back(StencilTable());
+    if (butterfly) mesh.ButterflySubdivision(&tables.back());
+    else mesh.LoopSubdivision(&tables.back());
+  }
+  if (tables.empty()) return;
+  fprintf(stderr, "  %s stencils %d\n", butterfly ? "butterfly" : "loop", (int)tables.size());
+  StencilTable::composeLevels(tables);
+  const StencilTable &table = tables.back();
+  if (table.numOutputs() != mesh.numVertices()) {
+    fprintf(stderr, "ERROR! %d STENCIL ROWS FOR %d VERTICES\n", table.numOutputs(), mesh.numVertices());
+    return;
+  }
+  std::string name = butterfly ? "butterfly_stencils" : "loop_stencils";
+
+  std::vector<Vec3f> refined;
+  resetPeakRSS();
+  double start = now();
+  table.apply(control, refined);
+  double seconds = now() - start;
+  double max_deviation = 0;
+  for (int i = 0; i < mesh.numVertices(); i++) {
+    max_deviation = std::max(max_deviation, (refined[i] - mesh.getPos(i)).Length());
+  }
+  out.operation(name, seconds, tris_in, mesh, peakRSSKB(), max_deviation);
+
+  // x,y,z,unused per vertex
+  std::vector<float> src(4 * control.size(), 0.0f), dst(4 * (size_t)mesh.numVertices());
+  double magnitude = 0;
+  for (unsigned int i = 0; i < control.size(); i++) {
+    for (int c = 0; c < 3; c++) {
+      src[4*i+c] = (float)control[i][c];
+      magnitude = std::max(magnitude, fabs(control[i][c]));
+    }
+  }
+  resetPeakRSS();
+  start = now();
+  table.apply(src.data(), dst.data());
+  seconds = now() - start;
+  max_deviation = 0;
+  for (int i = 0; i < mesh.numVertices(); i++) {
+    Vec3f p(dst[4*i], dst[4*i+1], dst[4*i+2]);
+    max_deviation = std::max(max_deviation, (p - mesh.getPos(i)).Length());
+  }
+  if (max_deviation > STENCIL_FLOAT_TOLERANCE * magnitude) {
+    fprintf(stderr, "ERROR! SSE STENCILS %g OFF THE SUBDIVIDED MESH\n", max_deviation);
+  }
+  out.operation(name + "_sse", seconds, tris_in, mesh, peakRSSKB(), max_deviation);
+}
+
+// method is random, qem or parallel_qem (with -qem_tolerance's default)
+static void benchSimplification(ArgParser &args, const std::string &filename, const std::string &method,
+                                int percent, BenchOutput &out) {
+  Mesh mesh(&args);
+  loadMesh(mesh, filename);
+  int tris_in = mesh.numTriangles();
+  TriangleBVH original;
+  original.build(mesh);
+  fprintf(stderr, "  %s %d%%\n", method.c_str(), percent);
+  int target = (long long)tris_in * percent / 100;
+  resetPeakRSS();
+  double start = now();
+  if (method == "qem") mesh.Simplification_QEM(target);
+  else if (method == "parallel_qem") mesh.ParallelSimplification_QEM(target, args.qem_tolerance);
+  else mesh.Simplification(target);
+  double seconds = now() - start;
+  long rss_kb = peakRSSKB();
+  start = now();
+  TriangleBVH approximation;
+  approximation.build(mesh);
+  ApproximationError error = MeasureApproximationError(original, approximation);
+  double error_seconds = now() - start;
+  out.operation(method + "_" + std::to_string(percent), seconds, tris_in, mesh, rss_kb, -1,
+                &error, error_seconds);
+}
+
+// the triangle order the mesh has after loading, then after Forsyth's
+// reordering (what the smooth-shaded VBO gets, without its split
+// vertices)
+static void benchVertexCache(const Mesh &mesh, BenchOutput &out) {
+  std::vector<unsigned int> indices;
+  indices.reserve(3 * mesh.numTriangles());
+  for (int t = 0; t < mesh.numTriangleSlots(); t++) {
+    if (!mesh.isTriangleAlive(t)) continue;
+    for (int k = 0; k < 3; k++) indices.push_back(mesh.getTriangleVertex(t,k));
+  }
+  double before = averageCacheMissRatio(indices, mesh.numVertices());
+  resetPeakRSS();
+  double start = now();
+  optimizeVertexCache(indices, mesh.numVertices());
+  double seconds = now() - start;
+  long rss_kb = peakRSSKB();
+  double after = averageCacheMissRatio(indices, mesh.numVertices());
+  out.operation("vertex_cache", seconds, mesh.numTriangles(), mesh, rss_kb, -1, NULL, 0, before, after);
+}
+
+static void benchModel(ArgParser &args, const std::string &filename, int levels, BenchOutput &out) {
+  std::string name = std::filesystem::path(filename).filename().string();
+  fprintf(stderr, "%s\n", name.c_str());
+
+  // the load on its own, the reordering is timed separately
+  ArgParser load_args = args;
+  load_args.reorder = "none";
+  Mesh mesh(&load_args);
+  resetPeakRSS();
+  double start = now();
+  if (!loadMesh(mesh, filename)) {
+    fprintf(stderr, "ERROR! NO TRIANGLES IN: %s\n", filename.c_str());
+    return;
+  }
+  double seconds = now() - start;
+  out.beginModel(name, mesh);
+  out.operation("load", seconds, 0, mesh, peakRSSKB());
+
+  if (args.reorder != "none") {
+    resetPeakRSS();
+    start = now();
+    mesh.ReorderAlongCurve(args.reorder == "hilbert" ? HILBERT_CURVE : MORTON_CURVE);
+    seconds = now() - start;
+    out.operation("reorder", seconds, mesh.numTriangles(), mesh, peakRSSKB());
+  }
+
+  resetPeakRSS();
+  start = now();
+  mesh.getAllQ();
+  seconds = now() - start;
+  out.operation("getAllQ", seconds, mesh.numTriangles(), mesh, peakRSSKB());
+  benchVertexCache(mesh, out);
+
+  benchSubdivision(args, filename, false, levels, out);
+  benchSubdivision(args, filename, true, levels, out);
+  benchStencils(args, filename, false, levels, out);
+  benchStencils(args, filename, true, levels, out);
+  // 1% takes open meshes (distcap) down to where most collapses touch
+  // the boundary
+  const int percents[3] = { 50, 10, 1 };
+  const char *methods[3] = { "random", "qem", "parallel_qem" };
+  for (int m = 0; m < 3; m++) {
+    for (int i = 0; i < 3; i++) benchSimplification(args, filename, methods[m], percents[i], out);
+  }
+  out.endModel();
+}
+
+// ===================================================================
+
+int main(int argc, char *argv[]) {
+  int levels = 3;
+  const char *output_file = NULL;
+  std::string reorder = "none";
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-levels") && i+1 < argc) {
+      levels = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+      output_file = argv[++i];
+    } else if (!strcmp(argv[i], "-reorder") && i+1 < argc) {
+      reorder = argv[++i];
+      if (reorder != "none" && reorder != "morton" && reorder != "hilbert") {
+        printf("ERROR! UNKNOWN CURVE: %s\n", reorder.c_str());
+        return 1;
+      }
+    } else if (std::filesystem::is_directory(argv[i])) {
+      std::vector<std::string> found;
+      for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(argv[i])) {
+        if (entry.path().extension() == ".obj") found.push_back(entry.path().string());
+      }
+      std::sort(found.begin(), found.end());
+      files.insert(files.end(), found.begin(), found.end());
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    printf("usage: %s [-levels N] [-reorder none|morton|hilbert] [-o results.json] model.obj|directory ...\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = stdout;
+  if (output_file != NULL && (file = fopen(output_file, "w")) == NULL) {
+    printf("ERROR! CANNOT OPEN: %s\n", output_file);
+    return 1;
+  }
+  // time parsing the .obj, not reading the cache
+  ArgParser args;
+  args.use_cache = false;
+  args.reorder = reorder;
+  BenchOutput out(file, reorder);
+  out.begin();
+  for (unsigned int i = 0; i < files.size(); i++) {
+    benchModel(args, files[i], levels, out);
+  }
+  out.end();
+  if (file != stdout) fclose(file);
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include "glCanvas.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "mesh.h"
+#include "mappedfile.h"
+
+// =======================================================================
+// .meshbin layout (native byte order):
+//
+//   MeshBinHeader
+//   double  positions       [3  * num_vertices]
+//   double  quadrics        [10 * num_vertices]  (a..j, as in Quadric)
+//   int32   vertex_creases  [num_vertices]
+//   int32   vertex_halfedge [num_vertices]
+//   int32   he_vertex       [num_half_edges]
+//   int32   he_opposite     [num_half_edges]
+//   float   he_crease       [num_half_edges]
+//
+// Bump MESHBIN_VERSION whenever the layout or the meaning of any of
+// the arrays changes; old caches are then simply rebuilt.
+// =======================================================================
+
+#define MESHBIN_VERSION 2
+
+struct MeshBinHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_vertices;
+  uint32_t num_half_edges;
+  uint32_t num_triangles;
+  // the source .obj this cache was made from
+  uint64_t source_size;
+  int64_t source_mtime;
+};
+
+static const char MESHBIN_MAGIC[8] = { 'M','E','S','H','B','I','N','\0' };
+
+static bool statSource(const std::string &source_file, uint64_t &size, int64_t &mtime) {
+  struct stat st;
+  if (stat(source_file.c_str(), &st) != 0) return false;
+  size = st.st_size;
+  mtime = st.st_mtime;
+  return true;
+}
+
+static size_t cacheSize(const MeshBinHeader &h) {
+  return sizeof(MeshBinHeader)
+    + size_t(h.num_vertices) * (13*sizeof(double) + 2*sizeof(int32_t))
+    + size_t(h.num_half_edges) * (2*sizeof(int32_t) + sizeof(float));
+}
+
+// copy the next n items out of the mapped file
+template <class T>
+static const char* readArray(const char *p, T *out, size_t n) {
+  memcpy(out, p, n*sizeof(T));
+  return p + n*sizeof(T);
+}
+
+template <class T>
+static void writeArray(std::ofstream &ostr, const T *in, size_t n) {
+  ostr.write((const char*)in, n*sizeof(T));
+}
+
+// =======================================================================
+
+std::string Mesh::cacheFileName(const std::string &input_file) {
+  std::string::size_type dot = input_file.rfind('.');
+  std::string::size_type slash = input_file.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return input_file + ".meshbin";
+  return input_file.substr(0,dot) + ".meshbin";
+}
+
+
+bool Mesh::LoadCache(const std::string &cache_file, const std::string &source_file) {
+  assert (numVertices() == 0);
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!statSource(source_file,source_size,source_mtime)) return false;
+
+  MappedFile file;
+  if (!file.open(cache_file)) return false;
+  if (file.size() < sizeof(MeshBinHeader)) return false;
+  MeshBinHeader header;
+  const char *p = readArray(file.data(), &header, 1);
+  if (memcmp(header.magic,MESHBIN_MAGIC,8) != 0 ||
+      header.version != MESHBIN_VERSION ||
+      header.source_size != source_size ||
+      header.source_mtime != source_mtime ||
+      file.size() != cacheSize(header)) {
+    std::cout << "ignoring stale or damaged cache " << cache_file << std::endl;
+    return false;
+  }
+
+  int nv = header.num_vertices;
+  int nh = header.num_half_edges;
+
+  std::vector<double> doubles(13*size_t(nv));
+  p = readArray(p, doubles.data(), doubles.size());
+  positions.resize(nv);
+  quadrics.resize(nv);
+  for (int i = 0; i < nv; i++) {
+    const double *d = &doubles[3*i];
+    positions[i] = Vec3f(d[0],d[1],d[2]);
+    if (i == 0)
+      bbox = BoundingBox(positions[i],positions[i]);
+    else
+      bbox.Extend(positions[i]);
+    d = &doubles[3*size_t(nv) + 10*i];
+    for (int j = 0; j < 10; j++) {
+      quadrics[i][j] = d[j];
+    }
+  }
+  vertex_creases.resize(nv);
+  vertex_halfedge.resize(nv);
+  vertex_versions.assign(nv,0);
+  he_vertex.resize(nh);
+  he_opposite.resize(nh);
+  he_crease.resize(nh);
+  he_ok.assign(nh,1);
+  if (nv > 0) {
+    p = readArray(p, &vertex_creases[0], nv);
+    p = readArray(p, &vertex_halfedge[0], nv);
+  }
+  if (nh > 0) {
+    p = readArray(p, &he_vertex[0], nh);
+    p = readArray(p, &he_opposite[0], nh);
+    p = readArray(p, &he_crease[0], nh);
+  }
+  assert (p == file.data() + file.size());
+  num_triangles = header.num_triangles;
+  quadrics_valid = true;
+
+  buildEdgeIndex();
+  return true;
+}
+
+
+bool Mesh::SaveCache(const std::string &cache_file, const std::string &source_file) const {
+  MeshBinHeader header;
+  memcpy(header.magic,MESHBIN_MAGIC,8);
+  header.version = MESHBIN_VERSION;
+  header.num_vertices = numVertices();
+  header.num_half_edges = he_vertex.size();
+  header.num_triangles = num_triangles;
+  if (!statSource(source_file,header.source_size,header.source_mtime)) return false;
+
+  int nv = numVertices();
+  std::vector<double> doubles(13*size_t(nv));
+  for (int i = 0; i < nv; i++) {
+    for (int j = 0; j < 3; j++) {
+      doubles[3*i+j] = positions[i][j];
+    }
+    double *d = &doubles[3*size_t(nv) + 10*i];
+    for (int j = 0; j < 10; j++) {
+      d[j] = quadrics[i][j];
+    }
+  }
+
+  // write to a temporary file first so a partly written cache is never read
+  std::string tmp_file = cache_file + ".tmp";
+  std::ofstream ostr(tmp_file.c_str(), std::ios::binary);
+  if (!ostr.good()) {
+    std::cout << "cannot write cache " << cache_file << std::endl;
+    return false;
+  }
+  writeArray(ostr, &header, 1);
+  writeArray(ostr, doubles.data(), doubles.size());
+  writeArray(ostr, vertex_creases.data(), vertex_creases.size());
+  writeArray(ostr, vertex_halfedge.data(), vertex_halfedge.size());
+  writeArray(ostr, he_vertex.data(), he_vertex.size());
+  writeArray(ostr, he_opposite.data(), he_opposite.size());
+  writeArray(ostr, he_crease.data(), he_crease.size());
+  ostr.close();
+  if (ostr.fail()) {
+    remove(tmp_file.c_str());
+    return false;
+  }
+  remove(cache_file.c_str());
+  if (rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    remove(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+// =======================================================================
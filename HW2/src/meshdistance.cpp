@@ -0,0 +1,152 @@
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+
+#include "meshdistance.h"
+#include "parallel.h"
+
+// a triangle is cut into at most this many pieces along each side
+#define MAX_SAMPLE_SPLITS 1024
+
+static double triangleArea(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+  Vec3f ab = b;
+  ab -= a;
+  Vec3f ac = c;
+  ac -= a;
+  Vec3f cross;
+  Vec3f::Cross3(cross, ab, ac);
+  return 0.5 * cross.Length();
+}
+
+static double surfaceArea(const TriangleBVH &bvh) {
+  double area = 0;
+  for (int t = 0; t < bvh.numTriangles(); t++) {
+    Vec3f a, b, c;
+    bvh.getTriangle(t, a, b, c);
+    area += triangleArea(a, b, c);
+  }
+  return area;
+}
+
+// ====================================================================
+
+// the samples of one range of vertices / triangles
+struct DistanceSum {
+  DistanceSum() { max = weighted = weighted_sq = weight = 0; samples = 0; }
+  void add(double d, double w) {
+    max = std::max(max, d);
+    weighted += w * d;
+    weighted_sq += w * d*d;
+    weight += w;
+    samples++;
+  }
+  void add(const DistanceSum &s) {
+    max = std::max(max, s.max);
+    weighted += s.weighted;
+    weighted_sq += s.weighted_sq;
+    weight += s.weight;
+    samples += s.samples;
+  }
+  double max, weighted, weighted_sq, weight;
+  long long samples;
+};
+
+// the distance from p to the surface of bvh; neighboring samples are
+// close to the same spot, so the closest point of the last sample
+// (hint) limits the search
+static double distanceTo(const TriangleBVH &bvh, const Vec3f &p, Vec3f &hint, bool &have_hint) {
+  double distance_sq = DBL_MAX;
+  if (have_hint) {
+    Vec3f d = p;
+    d -= hint;
+    // a little more, so the triangle of the hint is still found
+    distance_sq = d.Dot3(d) * (1 + 1e-6) + 1e-30;
+  }
+  Vec3f closest;
+  // (only an empty surface has no closest point)
+  if (bvh.closestPoint(p, closest, distance_sq) < 0) return INFINITY;
+  hint = closest;
+  have_hint = true;
+  return sqrt(distance_sq);
+}
+
+
+SurfaceDistance MeasureDistance(const TriangleBVH &from, const TriangleBVH &to, double sample_area) {
+  std::mutex lock;
+  DistanceSum total;
+
+  // the vertices (for the max only)
+  parallelFor(from.numVertices(), [&](int begin, int end) {
+    DistanceSum sum;
+    Vec3f hint;
+    bool have_hint = false;
+    for (int v = begin; v < end; v++) {
+      sum.add(distanceTo(to, from.getVertex(v), hint, have_hint), 0);
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    total.add(sum);
+  });
+
+  // the centroids of the k x k pieces of every triangle: k(k+1)/2 of
+  // them point the same way as the triangle, the other k(k-1)/2 are
+  // upside down
+  parallelFor(from.numTriangles(), [&](int begin, int end) {
+    DistanceSum sum;
+    Vec3f hint;
+    bool have_hint = false;
+    for (int t = begin; t < end; t++) {
+      Vec3f a, b, c;
+      from.getTriangle(t, a, b, c);
+      double area = triangleArea(a, b, c);
+      int k = 1;
+      if (sample_area > 0) k = std::max(1, (int)std::min<double>(MAX_SAMPLE_SPLITS, ceil(sqrt(area / sample_area))));
+      double weight = area / (k*k);
+      Vec3f ab = b;
+      ab -= a;
+      ab.Scale(1.0 / k);
+      Vec3f ac = c;
+      ac -= a;
+      ac.Scale(1.0 / k);
+      for (int i = 0; i < k; i++) {
+        for (int j = 0; i+j < k; j++) {
+          double s = i + 1.0/3, u = j + 1.0/3;
+          Vec3f p(a.x() + s*ab.x() + u*ac.x(), a.y() + s*ab.y() + u*ac.y(), a.z() + s*ab.z() + u*ac.z());
+          sum.add(distanceTo(to, p, hint, have_hint), weight);
+          if (i+j+1 < k) {
+            s = i + 2.0/3, u = j + 2.0/3;
+            Vec3f q(a.x() + s*ab.x() + u*ac.x(), a.y() + s*ab.y() + u*ac.y(), a.z() + s*ab.z() + u*ac.z());
+            sum.add(distanceTo(to, q, hint, have_hint), weight);
+          }
+        }
+      }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    total.add(sum);
+  });
+
+  SurfaceDistance result;
+  result.max = total.max;
+  result.mean = (total.weight > 0) ? total.weighted / total.weight : 0;
+  result.rms = (total.weight > 0) ? sqrt(total.weighted_sq / total.weight) : 0;
+  result.samples = total.samples;
+  return result;
+}
+
+
+ApproximationError MeasureApproximationError(const TriangleBVH &original, const TriangleBVH &approximation,
+                                             double samples_per_triangle) {
+  int num_triangles = std::max(1, std::max(original.numTriangles(), approximation.numTriangles()));
+  double area = std::max(surfaceArea(original), surfaceArea(approximation));
+  double sample_area = area / (samples_per_triangle * num_triangles);
+
+  ApproximationError error;
+  error.forward = MeasureDistance(original, approximation, sample_area);
+  error.backward = MeasureDistance(approximation, original, sample_area);
+  Vec3f min, max;
+  original.getBounds().Get(min, max);
+  max -= min;
+  error.diagonal = max.Length();
+  return error;
+}
+
+// ====================================================================
@@ -0,0 +1,48 @@
+#ifndef _MESH_DISTANCE_H_
+#define _MESH_DISTANCE_H_
+
+#include <algorithm>
+#include "bvh.h"
+
+// ====================================================================
+// How far one surface is from another, measured like Metro (Cignoni
+// et al. 1998): points are sampled on the first surface and the
+// distance of each to the closest point of the second one is found
+// with its BVH.  Every vertex is a sample, and every triangle is cut
+// into k x k smaller ones (k grows with the square root of its area)
+// whose centroids are samples too, weighted by their area.
+//
+// The max is the one-sided Hausdorff distance (from -> to); the mean
+// & rms are area weighted and use the triangle samples only.
+// ====================================================================
+
+struct SurfaceDistance {
+  double max;
+  double mean;
+  double rms;
+  long long samples;
+};
+
+// the two one-sided distances between an original & an approximation
+// of it (e.g. the result of Simplification_QEM)
+struct ApproximationError {
+  SurfaceDistance forward;    // original -> approximation
+  SurfaceDistance backward;   // approximation -> original
+  double diagonal;            // of the original's bounding box
+
+  // the two-sided numbers are the worse of the two directions
+  double hausdorff() const { return std::max(forward.max, backward.max); }
+  double rms() const { return std::max(forward.rms, backward.rms); }
+};
+
+// sample_area is the area of a surface piece that gets one sample
+SurfaceDistance MeasureDistance(const TriangleBVH &from, const TriangleBVH &to, double sample_area);
+
+// samples both surfaces about as densely as the one with the more
+// triangles (samples_per_triangle per triangle of that one)
+ApproximationError MeasureApproximationError(const TriangleBVH &original, const TriangleBVH &approximation,
+                                             double samples_per_triangle = 1);
+
+// ====================================================================
+
+#endif
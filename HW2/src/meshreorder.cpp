@@ -0,0 +1,133 @@
+#include "glCanvas.h"
+#include <algorithm>
+#include <limits>
+
+#include "mesh.h"
+#include "morton.h"
+#include "parallel.h"
+
+// =======================================================================
+// Space-filling curve reordering: an .obj lists its vertices & faces in
+// whatever order the tool that wrote it liked, and subdivision appends
+// the edge vertices & child triangles at the end, so the neighbours of
+// a vertex can be anywhere in the arrays.  Sorting the vertices by the
+// Morton / Hilbert code of their position and the triangles by that of
+// their centroid puts neighbours close in memory, which the one ring
+// walks of subdivision, getAllQ & simplification like.
+//
+// All per-vertex & per-half-edge arrays are permuted (a triangle keeps
+// its 3 half-edges in order) and the indices in them renumbered; the
+// edge table is rebuilt.  Removed triangles and vertices without a
+// triangle are dropped on the way, so the free lists end up empty.
+//
+// The -reorder option only reorders after loading: subdivision puts the
+// 4 children of a triangle next to each other and numbers the new edge
+// vertices in the order of the half-edges, so a reordered mesh stays
+// coherent enough that reordering every level costs more than it saves.
+// =======================================================================
+
+// out[i] = v[old_index[i]]
+template <class T>
+static void permute(std::vector<T> &v, const std::vector<int> &old_index) {
+  std::vector<T> out(old_index.size());
+  parallelFor(old_index.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) out[i] = v[old_index[i]];
+  });
+  v.swap(out);
+}
+
+// the live items in the order of their codes; dead ones get the largest
+// code (never a real one, those have 63 bits) and are cut off
+static void sortByCode(std::vector<std::pair<uint64_t,int> > &keys, std::vector<int> &old_index) {
+  std::sort(keys.begin(), keys.end());
+  old_index.clear();
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    if (keys[i].first == std::numeric_limits<uint64_t>::max()) break;
+    old_index.push_back(keys[i].second);
+  }
+}
+
+
+void Mesh::ReorderAlongCurve(SpaceCurve curve) {
+  if (hasProgressiveMesh()) {
+    // the recorded splits refer to the vertex & triangle slots
+    printf ("ERROR! CANNOT REORDER A PROGRESSIVE MESH\n");
+    return;
+  }
+  int num_vertex_slots = numVertices();
+  int num_triangle_slots = numTriangleSlots();
+  const uint64_t dead = std::numeric_limits<uint64_t>::max();
+
+  // the new order of the vertices
+  std::vector<std::pair<uint64_t,int> > keys(num_vertex_slots);
+  parallelFor(num_vertex_slots, [&](int begin, int end) {
+    for (int v = begin; v < end; v++) {
+      uint64_t code = (vertex_halfedge[v] >= 0) ? curveCode(curve, positions[v], bbox) : dead;
+      keys[v] = std::make_pair(code, v);
+    }
+  });
+  std::vector<int> old_vertex;
+  sortByCode(keys, old_vertex);
+  std::vector<int> new_vertex(num_vertex_slots, -1);
+  for (unsigned int i = 0; i < old_vertex.size(); i++) new_vertex[old_vertex[i]] = i;
+
+  // the new order of the triangles
+  keys.resize(num_triangle_slots);
+  parallelFor(num_triangle_slots, [&](int begin, int end) {
+    for (int t = begin; t < end; t++) {
+      uint64_t code = dead;
+      if (isTriangleAlive(t)) {
+        Vec3f centroid = positions[he_vertex[3*t]] + positions[he_vertex[3*t+1]] + positions[he_vertex[3*t+2]];
+        code = curveCode(curve, centroid * (1/3.0), bbox);
+      }
+      keys[t] = std::make_pair(code, t);
+    }
+  });
+  std::vector<int> old_triangle;
+  sortByCode(keys, old_triangle);
+  std::vector<int> new_triangle(num_triangle_slots, -1);
+  for (unsigned int i = 0; i < old_triangle.size(); i++) new_triangle[old_triangle[i]] = i;
+  std::vector<std::pair<uint64_t,int> >().swap(keys);
+
+  // the half-edges move with their triangle
+  std::vector<int> old_halfedge(3*old_triangle.size());
+  for (unsigned int i = 0; i < old_triangle.size(); i++) {
+    for (int k = 0; k < 3; k++) old_halfedge[3*i+k] = 3*old_triangle[i]+k;
+  }
+  std::vector<int> new_halfedge(3*num_triangle_slots, -1);
+  for (unsigned int h = 0; h < old_halfedge.size(); h++) new_halfedge[old_halfedge[h]] = h;
+
+  // move everything, then renumber the references
+  permute(positions, old_vertex);
+  permute(quadrics, old_vertex);
+  permute(vertex_creases, old_vertex);
+  permute(vertex_versions, old_vertex);
+  permute(vertex_halfedge, old_vertex);
+  permute(he_vertex, old_halfedge);
+  permute(he_opposite, old_halfedge);
+  permute(he_crease, old_halfedge);
+  permute(he_ok, old_halfedge);
+  parallelFor(numVertices(), [&](int begin, int end) {
+    for (int v = begin; v < end; v++) vertex_halfedge[v] = new_halfedge[vertex_halfedge[v]];
+  });
+  parallelFor(he_vertex.size(), [&](int begin, int end) {
+    for (int h = begin; h < end; h++) {
+      he_vertex[h] = new_vertex[he_vertex[h]];
+      if (he_opposite[h] >= 0) he_opposite[h] = new_halfedge[he_opposite[h]];
+    }
+  });
+
+  // everything that held old numbers
+  free_triangles.clear();
+  free_vertices.clear();
+  collapse_candidates.clear();
+  candidate_slot.clear();
+  allPairs.clear();
+  buildEdgeIndex();
+}
+
+
+void Mesh::applyReorderOption() {
+  if (args->reorder == "none" || hasProgressiveMesh()) return;
+  ReorderAlongCurve(args->reorder == "hilbert" ? HILBERT_CURVE : MORTON_CURVE);
+}
@@ -0,0 +1,136 @@
+#include <cstring>
+#include <stdint.h>
+#include "meshwriter.h"
+
+// ====================================================================
+
+MeshWriter* MeshWriter::create(const std::string &filename, bool ascii_ply) {
+  std::string::size_type dot = filename.rfind('.');
+  if (dot == std::string::npos) return NULL;
+  std::string ext = filename.substr(dot);
+  if (ext == ".obj") return new ObjWriter();
+  if (ext == ".ply") return new PlyWriter(!ascii_ply);
+  return NULL;
+}
+
+bool MeshWriter::write(const std::string &filename, const std::vector<Vec3f> &verts, const std::vector<int> &tris) {
+  if (!begin(filename, verts.size(), tris.size() / 3)) return false;
+  for (unsigned int i = 0; i < verts.size(); i++) addVertex(verts[i]);
+  for (unsigned int i = 0; i+2 < tris.size(); i += 3) addTriangle(tris[i], tris[i+1], tris[i+2]);
+  return end();
+}
+
+static FILE* openBuffered(const std::string &filename) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file != NULL) setvbuf(file, NULL, _IOFBF, WRITER_BUFFER_SIZE);
+  return file;
+}
+
+// little endian, whatever the machine is
+static char* putUint32(char *p, uint32_t x) {
+  for (int i = 0; i < 4; i++) p[i] = (char)((x >> (8*i)) & 0xff);
+  return p + 4;
+}
+
+static char* putFloat(char *p, float f) {
+  uint32_t x;
+  memcpy(&x, &f, 4);
+  return putUint32(p, x);
+}
+
+// ====================================================================
+
+bool ObjWriter::begin(const std::string &filename, int num_vertices, int num_triangles) {
+  file = openBuffered(filename);
+  if (file == NULL) return false;
+  fprintf (file, "# %d vertices, %d triangles\n", num_vertices, num_triangles);
+  return true;
+}
+
+void ObjWriter::addVertex(const Vec3f &pos) {
+  fprintf (file, "v %.7g %.7g %.7g\n", pos.x(), pos.y(), pos.z());
+}
+
+void ObjWriter::addTriangle(int a, int b, int c) {
+  fprintf (file, "f %d %d %d\n", a+1, b+1, c+1);
+}
+
+bool ObjWriter::end() {
+  bool ok = !ferror(file);
+  if (fclose(file) != 0) ok = false;
+  file = NULL;
+  return ok;
+}
+
+// ====================================================================
+
+PlyWriter::~PlyWriter() {
+  if (file != NULL) fclose(file);
+  if (faces != NULL) fclose(faces);
+}
+
+bool PlyWriter::begin(const std::string &filename, int nv, int nt) {
+  file = openBuffered(filename);
+  faces = tmpfile();
+  if (file == NULL || faces == NULL) return false;
+  setvbuf(faces, NULL, _IOFBF, WRITER_BUFFER_SIZE);
+  expected_vertices = nv;
+  expected_triangles = nt;
+  num_vertices = 0;
+  num_triangles = 0;
+  fprintf (file, "ply\nformat %s 1.0\n", binary ? "binary_little_endian" : "ascii");
+  fprintf (file, "element vertex %d\n", nv);
+  fprintf (file, "property float x\nproperty float y\nproperty float z\n");
+  fprintf (file, "element face %d\n", nt);
+  fprintf (file, "property list uchar int vertex_indices\nend_header\n");
+  return true;
+}
+
+void PlyWriter::addVertex(const Vec3f &pos) {
+  if (binary) {
+    char record[12];
+    char *p = putFloat(record, pos.x());
+    p = putFloat(p, pos.y());
+    putFloat(p, pos.z());
+    fwrite(record, 1, sizeof(record), file);
+  } else {
+    fprintf (file, "%.7g %.7g %.7g\n", pos.x(), pos.y(), pos.z());
+  }
+  num_vertices++;
+}
+
+void PlyWriter::addTriangle(int a, int b, int c) {
+  if (binary) {
+    // the uchar count & 3 ints
+    char record[13];
+    record[0] = 3;
+    char *p = putUint32(record+1, a);
+    p = putUint32(p, b);
+    putUint32(p, c);
+    fwrite(record, 1, sizeof(record), faces);
+  } else {
+    fprintf (faces, "3 %d %d %d\n", a, b, c);
+  }
+  num_triangles++;
+}
+
+bool PlyWriter::end() {
+  // the header promised these counts
+  assert (num_vertices == expected_vertices);
+  assert (num_triangles == expected_triangles);
+  // append the faces
+  rewind(faces);
+  char buffer[1<<16];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), faces)) > 0) {
+    fwrite(buffer, 1, n, file);
+  }
+  bool ok = !ferror(file) && !ferror(faces);
+  fclose(faces);
+  faces = NULL;
+  if (fclose(file) != 0) ok = false;
+  file = NULL;
+  return ok;
+}
+
+// ====================================================================
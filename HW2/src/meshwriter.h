@@ -0,0 +1,98 @@
+#ifndef _MESH_WRITER_H_
+#define _MESH_WRITER_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+#include "vectors.h"
+
+// ====================================================================
+// Writes a triangle mesh to disk one vertex / triangle at a time, so
+// the whole mesh never has to be in memory.  Vertices are numbered in
+// the order they are added (from 0) and a triangle may only use
+// vertices that were already added.  The files are written through
+// large stdio buffers (WRITER_BUFFER_SIZE).
+// ====================================================================
+
+#define WRITER_BUFFER_SIZE (1<<20)
+
+class MeshWriter {
+
+public:
+
+  virtual ~MeshWriter() {}
+
+  // picks the format from the extension (.obj or .ply), NULL otherwise;
+  // .ply is binary (little endian) unless ascii_ply is set
+  static MeshWriter* create(const std::string &filename, bool ascii_ply = false);
+
+  // the counts must be known up front (the .ply header needs them)
+  virtual bool begin(const std::string &filename, int num_vertices, int num_triangles) = 0;
+  virtual void addVertex(const Vec3f &pos) = 0;
+  virtual void addTriangle(int a, int b, int c) = 0;
+  // returns false if anything could not be written
+  virtual bool end() = 0;
+
+  // a whole mesh at once (3 vertex indices per triangle)
+  bool write(const std::string &filename, const std::vector<Vec3f> &verts, const std::vector<int> &tris);
+};
+
+// ====================================================================
+
+class ObjWriter : public MeshWriter {
+
+public:
+
+  ObjWriter() { file = NULL; }
+  ~ObjWriter() { if (file != NULL) fclose(file); }
+
+  bool begin(const std::string &filename, int num_vertices, int num_triangles);
+  void addVertex(const Vec3f &pos);
+  void addTriangle(int a, int b, int c);
+  bool end();
+
+private:
+
+  // don't use these constructors
+  ObjWriter(const ObjWriter&) { assert(0); exit(0); }
+  ObjWriter& operator=(const ObjWriter&) { assert(0); exit(0); }
+
+  FILE *file;
+};
+
+// ====================================================================
+// binary or ascii .ply; all vertices have to come before all faces, so
+// the faces are kept in a temporary file until end()
+
+class PlyWriter : public MeshWriter {
+
+public:
+
+  PlyWriter(bool b) { binary = b; file = NULL; faces = NULL; }
+  ~PlyWriter();
+
+  bool begin(const std::string &filename, int num_vertices, int num_triangles);
+  void addVertex(const Vec3f &pos);
+  void addTriangle(int a, int b, int c);
+  bool end();
+
+private:
+
+  // don't use these constructors
+  PlyWriter(const PlyWriter&) { assert(0); exit(0); }
+  PlyWriter& operator=(const PlyWriter&) { assert(0); exit(0); }
+
+  bool binary;
+  FILE *file;
+  FILE *faces;
+  int expected_vertices;
+  int expected_triangles;
+  int num_vertices;
+  int num_triangles;
+};
+
+// ====================================================================
+
+#endif
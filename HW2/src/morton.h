@@ -0,0 +1,90 @@
+#ifndef _MORTON_H_
+#define _MORTON_H_
+
+#include <stdint.h>
+#include "vectors.h"
+#include "boundingbox.h"
+
+// ====================================================================
+// Morton (Z-order) codes: the bits of the 3 quantized coordinates are
+// interleaved, so points that are close in space mostly get close
+// codes and sorting by the code gives spatially coherent runs.
+//
+// Hilbert codes do the same along the Hilbert curve, which never jumps:
+// consecutive cells always share a face, so runs of the order stay
+// more compact (at the price of a few more bit operations per code).
+// ====================================================================
+
+#define MORTON_BITS 21
+
+// spread the lowest 21 bits of x out to every third bit
+inline uint64_t mortonSpreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+  x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2)  & 0x1249249249249249ULL;
+  return x;
+}
+
+// the coordinates of p within the box, as MORTON_BITS bit integers
+inline void quantizeInBox(const Vec3f &p, const BoundingBox &bbox, uint32_t q[3]) {
+  Vec3f min = bbox.getMin();
+  Vec3f max = bbox.getMax();
+  for (int i = 0; i < 3; i++) {
+    double extent = max[i] - min[i];
+    double t = (extent > 0) ? (p[i] - min[i]) / extent : 0;
+    t = std::min(std::max(t,0.0),1.0);
+    q[i] = (uint32_t)(t * ((1 << MORTON_BITS) - 1));
+  }
+}
+
+// the 63 bit code of p, quantized within the box
+inline uint64_t mortonCode(const Vec3f &p, const BoundingBox &bbox) {
+  uint32_t q[3];
+  quantizeInBox(p, bbox, q);
+  uint64_t code = 0;
+  for (int i = 0; i < 3; i++) {
+    code |= mortonSpreadBits(q[i]) << i;
+  }
+  return code;
+}
+
+// the 63 bit Hilbert code of p, quantized within the box: the
+// coordinates are turned into the "transposed" Hilbert index (Skilling,
+// "Programming the Hilbert curve", 2004), whose bits are then
+// interleaved like a Morton code
+inline uint64_t hilbertCode(const Vec3f &p, const BoundingBox &bbox) {
+  uint32_t x[3];
+  quantizeInBox(p, bbox, x);
+  // undo the excess work of the plain interleaving: per bit from the
+  // top, invert the lower bits of x[0] where x[i] has a 1, else swap
+  // them with x[i] (without branches, they would be unpredictable)
+  for (int b = MORTON_BITS-1; b > 0; b--) {
+    uint32_t mask = (1u << b) - 1;
+    for (int i = 0; i < 3; i++) {
+      uint32_t set = 0u - ((x[i] >> b) & 1);
+      uint32_t t = (x[0] ^ x[i]) & mask & ~set;
+      x[0] ^= t | (mask & set);
+      x[i] ^= t;
+    }
+  }
+  // Gray encode
+  x[1] ^= x[0];
+  x[2] ^= x[1];
+  uint32_t t = 0;
+  for (int b = MORTON_BITS-1; b > 0; b--) {
+    t ^= ((1u << b) - 1) & (0u - ((x[2] >> b) & 1));
+  }
+  for (int i = 0; i < 3; i++) x[i] ^= t;
+  return (mortonSpreadBits(x[0]) << 2) | (mortonSpreadBits(x[1]) << 1) | mortonSpreadBits(x[2]);
+}
+
+enum SpaceCurve { MORTON_CURVE, HILBERT_CURVE };
+
+inline uint64_t curveCode(SpaceCurve curve, const Vec3f &p, const BoundingBox &bbox) {
+  return (curve == HILBERT_CURVE) ? hilbertCode(p, bbox) : mortonCode(p, bbox);
+}
+
+#endif
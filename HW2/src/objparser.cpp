@@ -0,0 +1,144 @@
+#include "objparser.h"
+
+#include <charconv>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#include "parallel.h"
+
+// files smaller than this are not worth starting threads for
+#define MIN_BYTES_PER_CHUNK (1<<20)
+
+// ====================================================================
+// small helpers to walk through a line
+
+static inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static inline const char* skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) p++;
+  return p;
+}
+
+static inline const char* skipToken(const char *p, const char *end) {
+  while (p < end && !isBlank(*p)) p++;
+  return p;
+}
+
+static inline bool tokenIs(const char *p, const char *q, const char *word) {
+  size_t n = strlen(word);
+  return (size_t)(q-p) == n && strncmp(p,word,n) == 0;
+}
+
+static const char* parseFloat(const char *p, const char *end, float &f) {
+  p = skipBlanks(p,end);
+  if (p < end && *p == '+') p++;
+  f = 0;
+  std::from_chars_result r = std::from_chars(p,end,f);
+  if (r.ec != std::errc()) return skipToken(p,end);
+  return r.ptr;
+}
+
+// ====================================================================
+
+void parseObjChunk(const char *begin, const char *end, ObjChunk &chunk) {
+  std::vector<int> polygon;
+  int num_verts = 0;
+  const char *p = begin;
+  while (p < end) {
+    const char *line_end = (const char*)memchr(p,'\n',end-p);
+    if (line_end == NULL) line_end = end;
+
+    const char *token = skipBlanks(p,line_end);
+    const char *token_end = skipToken(token,line_end);
+    const char *q = token_end;
+
+    if (token == token_end || *token == '#') {
+      // blank line or comment
+    } else if (tokenIs(token,token_end,"v")) {
+      float x,y,z;
+      q = parseFloat(q,line_end,x);
+      q = parseFloat(q,line_end,y);
+      q = parseFloat(q,line_end,z);
+      chunk.verts.push_back(x);
+      chunk.verts.push_back(y);
+      chunk.verts.push_back(z);
+      num_verts++;
+    } else if (tokenIs(token,token_end,"f")) {
+      // each corner is "v", "v/vt", "v//vn" or "v/vt/vn", only v is used
+      polygon.clear();
+      while (1) {
+        q = skipBlanks(q,line_end);
+        if (q >= line_end) break;
+        int index = 0;
+        std::from_chars_result r = std::from_chars(q,line_end,index);
+        if (r.ec == std::errc() && index != 0) {
+          polygon.push_back(index);
+        }
+        q = skipToken(q,line_end);
+      }
+      // fan triangulation of polygons
+      for (int i = 1; i+1 < (int)polygon.size(); i++) {
+        int corners[3] = { polygon[0], polygon[i], polygon[i+1] };
+        for (int k = 0; k < 3; k++) {
+          if (corners[k] > 0) {
+            chunk.tris.push_back(corners[k]-1);
+          } else {
+            // -1 is the last vertex read so far
+            chunk.relative_indices.push_back(chunk.tris.size());
+            chunk.tris.push_back(num_verts+corners[k]);
+          }
+        }
+      }
+    } else if (tokenIs(token,token_end,"e")) {
+      ObjCrease c;
+      c.a = c.b = -1;
+      q = skipBlanks(q,line_end);
+      std::from_chars_result r = std::from_chars(q,line_end,c.a);
+      q = skipBlanks(r.ptr,line_end);
+      r = std::from_chars(q,line_end,c.b);
+      parseFloat(r.ptr,line_end,c.crease);
+      chunk.creases.push_back(c);
+    } else if (tokenIs(token,token_end,"vt") || tokenIs(token,token_end,"vn") ||
+               tokenIs(token,token_end,"g") || tokenIs(token,token_end,"usemtl") ||
+               tokenIs(token,token_end,"o") || tokenIs(token,token_end,"s") ||
+               tokenIs(token,token_end,"mtllib")) {
+      // not used
+    } else {
+      chunk.num_unknown_lines++;
+    }
+    p = line_end+1;
+  }
+}
+
+
+void parseObj(const char *data, size_t size, std::vector<ObjChunk> &chunks) {
+  size_t num_chunks = numWorkerThreads();
+  num_chunks = std::max((size_t)1,std::min(num_chunks,size/MIN_BYTES_PER_CHUNK));
+  chunks.clear();
+  chunks.resize(num_chunks);
+
+  // chunk boundaries are moved forward to the next line break
+  std::vector<const char*> bounds(num_chunks+1);
+  bounds[0] = data;
+  bounds[num_chunks] = data+size;
+  for (size_t i = 1; i < num_chunks; i++) {
+    const char *p = data + i*(size/num_chunks);
+    if (p < bounds[i-1]) p = bounds[i-1];
+    const char *nl = (const char*)memchr(p,'\n',data+size-p);
+    bounds[i] = (nl == NULL) ? data+size : nl+1;
+  }
+
+  if (num_chunks == 1) {
+    parseObjChunk(bounds[0],bounds[1],chunks[0]);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < num_chunks; i++) {
+    workers.push_back(std::thread(parseObjChunk,bounds[i],bounds[i+1],std::ref(chunks[i])));
+  }
+  for (size_t i = 0; i < num_chunks; i++) {
+    workers[i].join();
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef _OBJ_PARSER_H_
+#define _OBJ_PARSER_H_
+
+#include <cstddef>
+#include <vector>
+
+// ====================================================================
+// Parsing of the .obj subset read by Mesh::Load.  The file is cut
+// into chunks at line boundaries and every chunk is parsed on its own
+// thread; Mesh::Load then merges the chunks in file order.
+// ====================================================================
+
+// an "e a b crease" record (vertex indices start at 0 in these!)
+struct ObjCrease {
+  int a, b;
+  float crease;
+};
+
+struct ObjChunk {
+  ObjChunk() { num_unknown_lines = 0; }
+  // x y z of each "v" line
+  std::vector<float> verts;
+  // 3 vertex indices per triangle, polygons are split into fans.
+  // positive .obj indices are already 0 based & absolute; negative
+  // (relative) ones are relative to the first vertex of this chunk
+  // and listed in relative_indices until the chunk offset is known
+  std::vector<int> tris;
+  std::vector<int> relative_indices;
+  std::vector<ObjCrease> creases;
+  int num_unknown_lines;
+};
+
+// parse the lines in [begin,end) into chunk
+void parseObjChunk(const char *begin, const char *end, ObjChunk &chunk);
+
+// split data into (at most) num_chunks pieces that end on a line break,
+// and parse them in parallel
+void parseObj(const char *data, size_t size, std::vector<ObjChunk> &chunks);
+
+// ====================================================================
+
+#endif
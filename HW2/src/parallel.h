@@ -0,0 +1,79 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// ====================================================================
+// Splits [0,n) into one contiguous range per hardware thread and calls
+// f(begin,end) for each range in parallel.  f must only write to data
+// owned by its own range.  Small loops are run on the calling thread.
+// ====================================================================
+
+#define PARALLEL_MIN_ITEMS 4096
+
+// true on the threads of a parallelTasks with more than one thread: the
+// loops inside a task then run on that thread, instead of every task
+// starting threads of its own
+inline bool& insideParallelTasks() {
+  static thread_local bool inside = false;
+  return inside;
+}
+
+inline int numWorkerThreads() {
+  if (insideParallelTasks()) return 1;
+  int n = std::thread::hardware_concurrency();
+  return std::max(n,1);
+}
+
+template <class F>
+void parallelFor(int n, F f) {
+  int num_threads = std::min(numWorkerThreads(), std::max(n/PARALLEL_MIN_ITEMS,1));
+  if (num_threads <= 1) {
+    f(0,n);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_threads; i++) {
+    int begin = (long long)n * i / num_threads;
+    int end = (long long)n * (i+1) / num_threads;
+    workers.push_back(std::thread(f,begin,end));
+  }
+  // the calling thread does the first range itself
+  f(0,(int)((long long)n / num_threads));
+  for (unsigned int i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+// ====================================================================
+// Calls f(i) for every i in [0,n), each on whichever thread is free
+// next.  Meant for a few big tasks of uneven size, where parallelFor
+// would give one thread all the work (or run everything in one thread).
+// ====================================================================
+
+template <class F>
+void parallelTasks(int n, F f) {
+  std::atomic<int> next(0);
+  int num_threads = std::min(numWorkerThreads(), n);
+  auto worker = [&]() {
+    bool was_inside = insideParallelTasks();
+    insideParallelTasks() = was_inside || num_threads > 1;
+    for (int i = next++; i < n; i = next++) f(i);
+    insideParallelTasks() = was_inside;
+  };
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_threads; i++) {
+    workers.push_back(std::thread(worker));
+  }
+  worker();
+  for (unsigned int i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+// ====================================================================
+
+#endif
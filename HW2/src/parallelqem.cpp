@@ -0,0 +1,177 @@
+#include "glCanvas.h"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "morton.h"
+#include "parallel.h"
+
+// =======================================================================
+// Cluster-parallel QEM: the triangles are sorted along a Morton curve
+// (by their centroids) and cut into runs of the same size, which gives
+// spatially coherent clusters.  Every cluster is copied into a small
+// mesh of its own and simplified there with the ordinary QEM, all
+// clusters at the same time.  A vertex on the edge of its cluster is on
+// the boundary of the small mesh, which simply() never collapses, so
+// the seams stay locked.  The clusters are then put back together and
+// a last serial QEM pass, with the seams unlocked, finishes the job.
+//
+// Only pairs whose cost is below a cap are collapsed in parallel.  The
+// cap is the initial cost of the pair the serial run would collapse
+// last (the needed-th cheapest), times (1 + tolerance).  This is a
+// heuristic, not an error bound: the cap applies to each collapse on
+// its own, costs change as the mesh is simplified, and the clusters
+// collapse in a different order than the serial run would.  Nothing
+// limits how far the result is from the serial one.  Larger tolerances
+// move more of the work into the clusters; mesh_bench reports the
+// Hausdorff & rms error of qem_P & parallel_qem_P side by side.
+// =======================================================================
+
+#define CLUSTERS_PER_THREAD 4
+#define MIN_CLUSTER_TRIANGLES 2048
+
+// what one cluster gives back
+struct ClusterResult {
+  std::vector<int> corners;    // 3 global vertices per triangle
+  std::vector<float> creases;  // 1 per half-edge
+  std::vector<int> removed;    // global vertices collapsed away
+};
+
+
+void Mesh::ParallelSimplification_QEM(int target_tri_count, double tolerance) {
+  clearProgressiveMesh();
+  if (!quadrics_valid) getAllQ();
+
+  std::vector<int> alive;
+  for (int t = 0; t < numTriangleSlots(); t++) {
+    if (isTriangleAlive(t)) alive.push_back(t);
+  }
+  int num_clusters = std::min(numWorkerThreads() * CLUSTERS_PER_THREAD,
+                              (int)alive.size() / MIN_CLUSTER_TRIANGLES);
+  if (num_clusters < 2 || numTriangles() <= target_tri_count) {
+    Simplification_QEM(target_tri_count);
+    return;
+  }
+
+  if (print_progress)
+    printf("ParallelSimplification_QEM the mesh! %d -> %d\n", numTriangles(), target_tri_count);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // the cost bound for the parallel phase, from the initial pair costs
+  allPairs.clear();
+  getAllPairs();
+  getAllDistance();
+  std::vector<double> costs;
+  costs.reserve(allPairs.size());
+  for (unsigned int i = 0; i < allPairs.size(); i++) {
+    costs.push_back(allPairs[i].getDistance());
+  }
+  allPairs.clear();
+  unsigned int needed = (numTriangles() - target_tri_count) / 2;
+  double max_cost = -1;
+  if (needed < costs.size()) {
+    std::nth_element(costs.begin(), costs.begin() + needed, costs.end());
+    max_cost = costs[needed] * (1 + tolerance);
+  }
+
+  // Morton order of the triangle centroids
+  std::vector<std::pair<uint64_t,int> > keys(alive.size());
+  parallelFor(alive.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      int t = alive[i];
+      Vec3f centroid = (positions[he_vertex[3*t]] + positions[he_vertex[3*t+1]] + positions[he_vertex[3*t+2]]) * (1/3.0);
+      keys[i] = std::make_pair(mortonCode(centroid, bbox), t);
+    }
+  });
+  std::sort(keys.begin(), keys.end());
+
+  // simplify the clusters; a vertex that is inside its cluster belongs
+  // to that cluster alone, so its position & quadric can be written
+  // back directly
+  int total = keys.size();
+  std::vector<ClusterResult> results(num_clusters);
+  parallelTasks(num_clusters, [&](int c) {
+    int begin = (long long)total * c / num_clusters;
+    int end = (long long)total * (c+1) / num_clusters;
+    Mesh patch(args);
+    patch.print_progress = false;
+    std::unordered_map<int,int> local_vertex;
+    local_vertex.reserve(end - begin);
+    std::vector<int> global_vertex;
+    // the triangles go in all at once, the same way Load builds them
+    for (int i = begin; i < end; i++) {
+      int t = keys[i].second;
+      for (int k = 0; k < 3; k++) {
+        int v = he_vertex[3*t+k];
+        std::unordered_map<int,int>::iterator itr = local_vertex.find(v);
+        if (itr == local_vertex.end()) {
+          int l = patch.addVertex(positions[v]);
+          patch.quadrics[l] = quadrics[v];
+          patch.vertex_creases[l] = vertex_creases[v];
+          global_vertex.push_back(v);
+          itr = local_vertex.insert(std::make_pair(v, l)).first;
+        }
+        patch.he_vertex.push_back(itr->second);
+      }
+    }
+    patch.buildConnectivity();
+    for (int i = begin; i < end; i++) {
+      int t = keys[i].second;
+      for (int k = 0; k < 3; k++) {
+        patch.he_crease[3*(i-begin)+k] = he_crease[3*t+k];
+      }
+    }
+    patch.quadrics_valid = true;
+
+    std::vector<char> inside(patch.numVertices());
+    std::vector<int> outgoing;
+    for (int v = 0; v < patch.numVertices(); v++) {
+      inside[v] = patch.getOutgoingHalfEdges(v, outgoing);
+    }
+
+    int patch_target = (long long)patch.numTriangles() * target_tri_count / numTriangles();
+    patch.Simplification_QEM(patch_target, NULL, max_cost);
+
+    ClusterResult &result = results[c];
+    for (int v = 0; v < patch.numVertices(); v++) {
+      if (!inside[v]) continue;
+      if (!patch.isVertexAlive(v)) {
+        result.removed.push_back(global_vertex[v]);
+        continue;
+      }
+      positions[global_vertex[v]] = patch.positions[v];
+      quadrics[global_vertex[v]] = patch.quadrics[v];
+    }
+    for (int t = 0; t < patch.numTriangleSlots(); t++) {
+      if (!patch.isTriangleAlive(t)) continue;
+      for (int k = 0; k < 3; k++) {
+        result.corners.push_back(global_vertex[patch.he_vertex[3*t+k]]);
+        result.creases.push_back(patch.he_crease[3*t+k]);
+      }
+    }
+  });
+
+  // put the clusters back together
+  he_vertex.clear();
+  std::vector<float> creases;
+  for (int c = 0; c < num_clusters; c++) {
+    he_vertex.insert(he_vertex.end(), results[c].corners.begin(), results[c].corners.end());
+    creases.insert(creases.end(), results[c].creases.begin(), results[c].creases.end());
+    free_vertices.insert(free_vertices.end(), results[c].removed.begin(), results[c].removed.end());
+    std::vector<int>().swap(results[c].corners);
+    std::vector<float>().swap(results[c].creases);
+  }
+  buildConnectivity();
+  he_crease.swap(creases);
+  std::fill(vertex_versions.begin(), vertex_versions.end(), 0);
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (print_progress)
+    printf("parallel QEM: %d clusters in %.3f s, %d triangles left\n", num_clusters, seconds, numTriangles());
+
+  // the seams
+  Simplification_QEM(target_tri_count);
+}
+
+// =======================================================================
@@ -0,0 +1,251 @@
+#include "glCanvas.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+#include "mesh.h"
+#include "mappedfile.h"
+
+// =======================================================================
+// Progressive mesh: the QEM collapse sequence is recorded once, then
+// any level of detail is reached by replaying collapses (coarser) or
+// undoing them as vertex splits (finer), with no simplification work.
+//
+// .pm layout (native byte order):
+//
+//   PMHeader
+//   float        positions      [3 * num_vertices]   (at the coarsest level)
+//   int32        vertex_creases [num_vertices]
+//   int32        he_vertex      [num_half_edges]     (-1 for removed triangles)
+//   float        he_crease      [num_half_edges]
+//   VertexSplit  splits         [num_splits]         (in collapse order)
+//
+// The coarsest mesh is stored, so loading it gives the base mesh and
+// the splits are applied in reverse order to get back the full mesh.
+// =======================================================================
+
+#define PM_VERSION 1
+
+struct PMHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_vertices;
+  uint32_t num_half_edges;
+  uint32_t num_splits;
+};
+
+static const char PM_MAGIC[8] = { 'P','R','O','G','M','E','S','H' };
+
+static size_t progressiveSize(const PMHeader &h) {
+  return sizeof(PMHeader)
+    + size_t(h.num_vertices) * (3*sizeof(float) + sizeof(int32_t))
+    + size_t(h.num_half_edges) * (sizeof(int32_t) + sizeof(float))
+    + size_t(h.num_splits) * sizeof(VertexSplit);
+}
+
+// =======================================================================
+
+std::string Mesh::progressiveFileName(const std::string &input_file) {
+  // same directory & base name as the cache
+  std::string cache_file = cacheFileName(input_file);
+  return cache_file.substr(0, cache_file.size() - std::string(".meshbin").size()) + ".pm";
+}
+
+
+// the inverse of simply(): bring back v2 and the two triangles of e1/e2
+void Mesh::applyVertexSplit(const VertexSplit &split) {
+  int v1 = split.v1;
+  int v2 = split.v2;
+  int e1 = split.e1;
+  int e2 = split.e2;
+  int n1 = nextHalfEdge(e1);
+  int p1 = prevHalfEdge(e1);
+  int n2 = nextHalfEdge(e2);
+  int p2 = prevHalfEdge(e2);
+  int a = he_vertex[split.on1];
+  int b = he_vertex[split.on2];
+  assert (!isTriangleAlive(halfEdgeTriangle(e1)) && !isTriangleAlive(halfEdgeTriangle(e2)));
+  assert (he_opposite[split.on1] == split.op1 && he_opposite[split.on2] == split.op2);
+  // the collapse freed these slots last
+  assert (free_vertices.back() == v2);
+  free_vertices.pop_back();
+  assert (free_triangles.back() == halfEdgeTriangle(e2));
+  free_triangles.pop_back();
+  assert (free_triangles.back() == halfEdgeTriangle(e1));
+  free_triangles.pop_back();
+
+  // the half-edges that left v2 are the ones met going around v1 from
+  // the one after on1 up to op2
+  std::vector<int> moved;
+  int h = nextHalfEdge(split.on1);
+  while (true) {
+    assert (he_vertex[h] == v1);
+    moved.push_back(h);
+    if (h == split.op2) break;
+    h = nextHalfEdge(he_opposite[h]);
+  }
+  for (unsigned int i = 0; i < moved.size(); i++) {
+    int h = moved[i];
+    int w = endVertex(h);
+    int p = prevHalfEdge(h);
+    int u = he_vertex[p];
+    edges.erase(std::make_pair(v1, w));
+    edges.erase(std::make_pair(u, v1));
+    edges[std::make_pair(v2, w)] = h;
+    edges[std::make_pair(u, v2)] = p;
+    he_vertex[h] = v2;
+  }
+
+  // the two triangles, (v1 v2 a) and (v2 v1 b)
+  he_vertex[e1] = v1; he_vertex[n1] = v2; he_vertex[p1] = a;
+  he_vertex[e2] = v2; he_vertex[n2] = v1; he_vertex[p2] = b;
+  int twins[5][2] = { { e1, e2 }, { n1, split.on1 }, { p1, split.op1 }, { n2, split.on2 }, { p2, split.op2 } };
+  for (int i = 0; i < 5; i++) {
+    he_opposite[twins[i][0]] = twins[i][1];
+    he_opposite[twins[i][1]] = twins[i][0];
+    he_crease[twins[i][0]] = he_crease[twins[i][1]] = split.crease[i];
+  }
+  int triangle_edges[6] = { e1, n1, p1, e2, n2, p2 };
+  for (int i = 0; i < 6; i++) {
+    edges[std::make_pair(he_vertex[triangle_edges[i]], endVertex(triangle_edges[i]))] = triangle_edges[i];
+  }
+  num_triangles += 2;
+
+  vertex_halfedge[v1] = e1;
+  vertex_halfedge[v2] = e2;
+  positions[v1] = Vec3f(split.pos1[0], split.pos1[1], split.pos1[2]);
+  positions[v2] = Vec3f(split.pos2[0], split.pos2[1], split.pos2[2]);
+  markTriangleDirty(halfEdgeTriangle(e1));
+  markTriangleDirty(halfEdgeTriangle(e2));
+  markVertexDirty(v1);
+  markVertexDirty(v2);
+  vertex_versions[v1]++;
+  vertex_versions[v2]++;
+}
+
+
+void Mesh::applyCollapse(const VertexSplit &split) {
+  assert (he_vertex[split.e1] == split.v1 && endVertex(split.e1) == split.v2);
+  int v = simply(split.e1, Vec3f(split.collapsed[0], split.collapsed[1], split.collapsed[2]));
+  assert (v == split.v1);
+  (void)v;
+}
+
+// =======================================================================
+
+void Mesh::BuildProgressiveMesh() {
+  std::vector<VertexSplit> record;
+  Simplification_QEM(0, &record);
+  pm_splits.swap(record);
+  pm_level = pm_splits.size();
+  printf("progressive mesh: %d triangles at the coarsest level, %d vertex splits\n",
+         numTriangles(), (int)pm_splits.size());
+  SetLevelOfDetail(3*numTriangleSlots());
+}
+
+
+int Mesh::SetLevelOfDetail(int target_tri_count) {
+  int start = pm_level;
+  while (pm_level < (int)pm_splits.size() && numTriangles() > target_tri_count) {
+    applyCollapse(pm_splits[pm_level]);
+    pm_level++;
+  }
+  while (pm_level > 0 && numTriangles() + 2 <= target_tri_count) {
+    pm_level--;
+    applyVertexSplit(pm_splits[pm_level]);
+  }
+  //顶点的位置变了，Q需要重新计算
+  if (pm_level != start) quadrics_valid = false;
+  return numTriangles();
+}
+
+// =======================================================================
+
+bool Mesh::LoadProgressiveMesh(const std::string &pm_file) {
+  assert (numVertices() == 0);
+  MappedFile file;
+  if (!file.open(pm_file)) return false;
+  if (file.size() < sizeof(PMHeader)) return false;
+  PMHeader header;
+  memcpy(&header, file.data(), sizeof(PMHeader));
+  if (memcmp(header.magic,PM_MAGIC,8) != 0 ||
+      header.version != PM_VERSION ||
+      file.size() != progressiveSize(header)) {
+    std::cout << "not a progressive mesh file " << pm_file << std::endl;
+    return false;
+  }
+
+  int nv = header.num_vertices;
+  int nh = header.num_half_edges;
+  const char *p = file.data() + sizeof(PMHeader);
+  std::vector<float> floats(3*size_t(nv));
+  memcpy(floats.data(), p, floats.size()*sizeof(float));
+  p += floats.size()*sizeof(float);
+  for (int i = 0; i < nv; i++) {
+    addVertex(Vec3f(floats[3*i],floats[3*i+1],floats[3*i+2]));
+  }
+  memcpy(vertex_creases.data(), p, nv*sizeof(int32_t));
+  p += nv*sizeof(int32_t);
+  he_vertex.resize(nh);
+  memcpy(he_vertex.data(), p, nh*sizeof(int32_t));
+  p += nh*sizeof(int32_t);
+  buildConnectivity();
+  memcpy(he_crease.data(), p, nh*sizeof(float));
+  p += nh*sizeof(float);
+  pm_splits.resize(header.num_splits);
+  memcpy(pm_splits.data(), p, pm_splits.size()*sizeof(VertexSplit));
+  p += pm_splits.size()*sizeof(VertexSplit);
+  assert (p == file.data() + file.size());
+  // the slots as the collapses freed them
+  free_triangles.clear();
+  free_vertices.clear();
+  for (unsigned int i = 0; i < pm_splits.size(); i++) {
+    free_triangles.push_back(halfEdgeTriangle(pm_splits[i].e1));
+    free_triangles.push_back(halfEdgeTriangle(pm_splits[i].e2));
+    free_vertices.push_back(pm_splits[i].v2);
+  }
+
+  // start from the full mesh
+  pm_level = pm_splits.size();
+  SetLevelOfDetail(3*numTriangleSlots());
+  return true;
+}
+
+
+bool Mesh::SaveProgressiveMesh(const std::string &pm_file) {
+  // the file holds the coarsest level
+  int level = numTriangles();
+  SetLevelOfDetail(0);
+
+  PMHeader header;
+  memcpy(header.magic,PM_MAGIC,8);
+  header.version = PM_VERSION;
+  header.num_vertices = numVertices();
+  header.num_half_edges = he_vertex.size();
+  header.num_splits = pm_splits.size();
+
+  std::vector<float> floats(3*size_t(numVertices()));
+  for (int i = 0; i < numVertices(); i++) {
+    for (int j = 0; j < 3; j++) {
+      floats[3*i+j] = positions[i][j];
+    }
+  }
+  std::ofstream ostr(pm_file.c_str(), std::ios::binary);
+  if (ostr.good()) {
+    ostr.write((const char*)&header, sizeof(PMHeader));
+    ostr.write((const char*)floats.data(), floats.size()*sizeof(float));
+    ostr.write((const char*)vertex_creases.data(), vertex_creases.size()*sizeof(int32_t));
+    ostr.write((const char*)he_vertex.data(), he_vertex.size()*sizeof(int32_t));
+    ostr.write((const char*)he_crease.data(), he_crease.size()*sizeof(float));
+    ostr.write((const char*)pm_splits.data(), pm_splits.size()*sizeof(VertexSplit));
+    ostr.close();
+  }
+  bool ok = !ostr.fail();
+  if (!ok) std::cout << "ERROR! CANNOT WRITE: " << pm_file << std::endl;
+
+  SetLevelOfDetail(level);
+  return ok;
+}
+
+// =======================================================================
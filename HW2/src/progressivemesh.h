@@ -0,0 +1,30 @@
+#ifndef _PROGRESSIVE_MESH_H_
+#define _PROGRESSIVE_MESH_H_
+
+// ====================================================================
+// One edge collapse recorded by Simplification_QEM, stored so it can be
+// undone as a vertex split (or replayed again) without any of the QEM
+// work.  The collapse of half-edge e1 (v1 -> v2) removes the triangles
+// of e1 and of its opposite e2, moves every other half-edge of v2 over
+// to v1 and stitches the outer half-edges on1/op1 and on2/op2 together
+// (see Mesh::simply).  The triangle slots & half-edge indices never
+// move, so the indices recorded here stay valid as long as the records
+// are applied in order.
+//
+// The record is plain data so the progressive mesh file (see
+// progressivemesh.cpp) can store it directly.
+// ====================================================================
+
+struct VertexSplit {
+  int v1, v2;          // the kept vertex & the one that is collapsed away
+  int e1, e2;          // the collapsed half-edge (v1 -> v2) & its opposite
+  // outer opposites of the half-edges after / before e1 and e2
+  int on1, op1, on2, op2;
+  float pos1[3];       // positions before the collapse
+  float pos2[3];
+  float collapsed[3];  // position of v1 after the collapse
+  // creases of e1, on1, op1, on2, op2 before the collapse
+  float crease[5];
+};
+
+#endif
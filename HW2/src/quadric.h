@@ -0,0 +1,132 @@
+#ifndef _QUADRIC_H_
+#define _QUADRIC_H_
+
+#include <cmath>
+#include <cassert>
+#include "vectors.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define QUADRIC_SSE2
+#include <emmintrin.h>
+#endif
+
+// ====================================================================
+// Error quadric for QEM simplification: the symmetric 4x4 matrix
+//
+//      | a b c d |
+//      | b e f g |
+//      | c f h i |
+//      | d g i j |
+//
+// stored as its 10 distinct entries.  The error of position v is
+// [v 1] Q [v 1]^T.
+// ====================================================================
+
+class Quadric {
+
+public:
+
+  // ------------
+  // CONSTRUCTORS
+  Quadric() { clear(); }
+  // the squared distance to the plane ax + by + cz + d = 0 (unit normal)
+  Quadric(double a, double b, double c, double d) {
+    q[0] = a*a; q[1] = a*b; q[2] = a*c; q[3] = a*d;
+    q[4] = b*b; q[5] = b*c; q[6] = b*d;
+    q[7] = c*c; q[8] = c*d;
+    q[9] = d*d;
+  }
+  void clear() { for (int i = 0; i < 10; i++) q[i] = 0; }
+  // the plane of the triangle p1 p2 p3, with the normal of
+  // ComputeNormal (all zero for a degenerate triangle)
+  static Quadric plane(const Vec3f &p1, const Vec3f &p2, const Vec3f &p3) {
+    Vec3f v12 = p2;
+    v12 -= p1;
+    Vec3f v23 = p3;
+    v23 -= p2;
+    Vec3f normal;
+    Vec3f::Cross3(normal,v12,v23);
+    normal.Normalize();
+    return Quadric(normal.x(), normal.y(), normal.z(), -normal.Dot3(p1));
+  }
+
+  // ---------
+  // ACCESSORS
+  // the 10 coefficients in the order a b c d e f g h i j
+  double operator[](int i) const { assert (i >= 0 && i < 10); return q[i]; }
+  double& operator[](int i) { assert (i >= 0 && i < 10); return q[i]; }
+
+  // ---------
+  // OPERATORS
+  Quadric& operator+=(const Quadric &other) {
+#ifdef QUADRIC_SSE2
+    for (int i = 0; i < 10; i += 2) {
+      _mm_storeu_pd(q+i, _mm_add_pd(_mm_loadu_pd(q+i), _mm_loadu_pd(other.q+i)));
+    }
+#else
+    for (int i = 0; i < 10; i++) q[i] += other.q[i];
+#endif
+    return *this;
+  }
+  friend Quadric operator+(const Quadric &q1, const Quadric &q2) {
+    Quadric answer = q1;
+    answer += q2;
+    return answer;
+  }
+
+  // ----------
+  // EVALUATION
+  // [v 1] Q [v 1]^T
+  double evaluate(const Vec3f &v) const {
+    double x = v.x(), y = v.y(), z = v.z();
+    // the monomials that go with a b c d e f g h i j
+    double m[10] = { x*x, 2*x*y, 2*x*z, 2*x, y*y, 2*y*z, 2*y, z*z, 2*z, 1 };
+#ifdef QUADRIC_SSE2
+    __m128d sum = _mm_setzero_pd();
+    for (int i = 0; i < 10; i += 2) {
+      sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(q+i), _mm_loadu_pd(m+i)));
+    }
+    double s[2];
+    _mm_storeu_pd(s, sum);
+    return s[0] + s[1];
+#else
+    double sum = 0;
+    for (int i = 0; i < 10; i++) sum += q[i]*m[i];
+    return sum;
+#endif
+  }
+
+  // the position with the smallest error, from the 3x3 system
+  //   | a b c |       | d |
+  //   | b e f | v = - | g |
+  //   | c f h |       | i |
+  // solved with Cramer's rule; returns false if it is (nearly) singular
+  bool optimize(Vec3f &v) const {
+    double a = q[0], b = q[1], c = q[2], e = q[4], f = q[5], h = q[7];
+    double A = e*h - f*f;
+    double B = c*f - b*h;
+    double C = b*f - c*e;
+    double det = a*A + b*B + c*C;
+    double scale = fabs(a) + fabs(e) + fabs(h);
+    if (fabs(det) <= 1e-10 * scale*scale*scale || scale == 0) return false;
+    // inverse = adjugate / det (symmetric)
+    double D = a*h - c*c;
+    double E = b*c - a*f;
+    double F = a*e - b*b;
+    double rx = -q[3], ry = -q[6], rz = -q[8];
+    v = Vec3f((A*rx + B*ry + C*rz) / det,
+              (B*rx + D*ry + E*rz) / det,
+              (C*rx + E*ry + F*rz) / det);
+    return true;
+  }
+
+private:
+
+  // --------------
+  // REPRESENTATION
+  double q[10];
+};
+
+// ====================================================================
+
+#endif
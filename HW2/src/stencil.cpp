@@ -0,0 +1,102 @@
+#include <cassert>
+#include "stencil.h"
+#include "parallel.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// ====================================================================
+
+void StencilTable::clear(int n) {
+  num_inputs = n;
+  row_offsets.clear();
+  indices.clear();
+  weights.clear();
+  row_offsets.push_back(0);
+}
+
+void StencilTable::add(int input, double weight) {
+  assert (input >= 0 && input < num_inputs);
+  if (weight == 0) return;
+  indices.push_back(input);
+  weights.push_back(weight);
+}
+
+// ====================================================================
+
+void StencilTable::compose(const StencilTable &previous, StencilTable &result) const {
+  assert (numInputs() == previous.numOutputs());
+  result.clear(previous.numInputs());
+  // sparse accumulator: dense weights plus the list of touched inputs
+  std::vector<double> accum(previous.numInputs(), 0);
+  std::vector<char> touched(previous.numInputs(), 0);
+  std::vector<int> row;
+  for (int i = 0; i < numOutputs(); i++) {
+    row.clear();
+    for (int k = row_offsets[i]; k < row_offsets[i+1]; k++) {
+      int j = indices[k];
+      double w = weights[k];
+      for (int m = previous.row_offsets[j]; m < previous.row_offsets[j+1]; m++) {
+        int c = previous.indices[m];
+        if (!touched[c]) { touched[c] = 1; row.push_back(c); }
+        accum[c] += w * previous.weights[m];
+      }
+    }
+    for (unsigned int k = 0; k < row.size(); k++) {
+      result.add(row[k], accum[row[k]]);
+      accum[row[k]] = 0;
+      touched[row[k]] = 0;
+    }
+    result.endRow();
+  }
+}
+
+void StencilTable::composeLevels(std::vector<StencilTable> &levels) {
+  for (unsigned int i = 1; i < levels.size(); i++) {
+    StencilTable composed;
+    levels[i].compose(levels[i-1], composed);
+    levels[i] = composed;
+  }
+}
+
+// ====================================================================
+
+void StencilTable::apply(const float *src, float *dst) const {
+  parallelFor(numOutputs(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+#ifdef USE_SSE
+      __m128 sum = _mm_setzero_ps();
+      for (int k = row_offsets[i]; k < row_offsets[i+1]; k++) {
+        __m128 p = _mm_loadu_ps(src + 4*indices[k]);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps((float)weights[k]), p));
+      }
+      _mm_storeu_ps(dst + 4*i, sum);
+#else
+      float sum[4] = { 0, 0, 0, 0 };
+      for (int k = row_offsets[i]; k < row_offsets[i+1]; k++) {
+        const float *p = src + 4*indices[k];
+        for (int c = 0; c < 4; c++) sum[c] += (float)weights[k] * p[c];
+      }
+      for (int c = 0; c < 4; c++) dst[4*i+c] = sum[c];
+#endif
+    }
+  });
+}
+
+void StencilTable::apply(const std::vector<Vec3f> &src, std::vector<Vec3f> &dst) const {
+  assert ((int)src.size() >= numInputs());
+  dst.resize(numOutputs());
+  parallelFor(numOutputs(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      Vec3f sum;
+      for (int k = row_offsets[i]; k < row_offsets[i+1]; k++) {
+        sum += src[indices[k]] * weights[k];
+      }
+      dst[i] = sum;
+    }
+  });
+}
+
+// ====================================================================
@@ -0,0 +1,73 @@
+#ifndef _STENCIL_H_
+#define _STENCIL_H_
+
+#include <vector>
+#include "vectors.h"
+
+// ====================================================================
+// A subdivision stencil table is a sparse matrix (compressed rows):
+// row i gives output vertex i as a weighted sum of input vertices.
+//
+// The subdivision operations can record the table of the step they
+// perform, so the same topology can later be re-evaluated for new
+// control positions without any topology work:
+//
+//   std::vector<StencilTable> levels(2);
+//   mesh.LoopSubdivision(&levels[0]);
+//   mesh.LoopSubdivision(&levels[1]);
+//   StencilTable::composeLevels(levels);  // all levels over the control vertices
+//   ...
+//   levels[1].apply(control_xyzw, refined_xyzw);  // every frame
+// ====================================================================
+
+class StencilTable {
+
+public:
+
+  // ========================
+  // CONSTRUCTOR
+  StencilTable() { clear(0); }
+
+  // ===========================
+  // BUILDING (one row at a time)
+  void clear(int num_inputs);
+  // add a term to the row that is being built (zero weights are dropped)
+  void add(int input, double weight);
+  void endRow() { row_offsets.push_back(indices.size()); }
+
+  // =========
+  // ACCESSORS
+  int numInputs() const { return num_inputs; }
+  int numOutputs() const { return row_offsets.size()-1; }
+  int numEntries() const { return indices.size(); }
+
+  // ===========
+  // COMPOSITION
+  // result = this * previous, i.e. the rows are rewritten over the
+  // inputs of previous
+  void compose(const StencilTable &previous, StencilTable &result) const;
+  // levels[i] (level i -> level i+1) becomes control -> level i+1
+  static void composeLevels(std::vector<StencilTable> &levels);
+
+  // ==========
+  // EVALUATION
+  // src & dst hold 4 floats (x,y,z,unused) per vertex, so each term is a
+  // single SIMD multiply-add (with the weight rounded to float); dst
+  // must have room for numOutputs() vertices
+  void apply(const float *src, float *dst) const;
+  // double precision version
+  void apply(const std::vector<Vec3f> &src, std::vector<Vec3f> &dst) const;
+
+private:
+
+  // ==============
+  // REPRESENTATION
+  int num_inputs;
+  std::vector<int> row_offsets;   // numOutputs()+1 entries
+  std::vector<int> indices;
+  std::vector<double> weights;
+};
+
+// ====================================================================
+
+#endif
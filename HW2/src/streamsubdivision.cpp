@@ -0,0 +1,231 @@
+#include "glCanvas.h"
+#include "mesh.h"
+#include "meshwriter.h"
+
+// =======================================================================
+// Streaming subdivision: every base triangle is subdivided on its own,
+// together with enough of its neighborhood (a few rings of triangles)
+// for the subdivision rules to give the same positions inside the
+// triangle as subdividing the whole mesh.  Only one patch is alive at a
+// time, so the memory use depends on the patch size, not the output.
+//
+// Refining triangle k always gives triangles 4k..4k+3 (see
+// refineTriangles), so with the base triangle as triangle 0 of the
+// patch, its descendants after N levels are triangles 0..4^N-1, and the
+// base-4 digits of the index give the path down the refinement.  That
+// path gives the barycentric lattice coordinates of every corner, which
+// are used to weld the vertices shared with neighboring patches (those
+// on the base vertices & edges).
+// =======================================================================
+
+// rings of triangles around the base triangle that a patch needs.  The
+// Loop rules read the 1-ring of a vertex, but a crease edge point also
+// depends on the type (regular or not) of its far end point, which needs
+// that vertex's 1-ring too.  Butterfly reads the 1-rings of both ends.
+#define LOOP_PATCH_RINGS 1
+#define LOOP_CREASE_PATCH_RINGS 2
+#define BUTTERFLY_PATCH_RINGS 2
+
+struct Lattice {
+  int b[3];
+};
+
+static Lattice midpoint(const Lattice &p, const Lattice &q) {
+  Lattice m;
+  for (int i = 0; i < 3; i++) m.b[i] = (p.b[i] + q.b[i]) / 2;
+  return m;
+}
+
+// the lattice coordinates of the corners of descendant q after the given
+// number of levels, S = 2^levels
+static void descendantCorners(int q, int levels, int S, Lattice corners[3]) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) corners[i].b[j] = (i == j) ? S : 0;
+  }
+  for (int level = levels-1; level >= 0; level--) {
+    int child = (q >> (2*level)) & 3;
+    Lattice m0 = midpoint(corners[0],corners[1]);
+    Lattice m1 = midpoint(corners[1],corners[2]);
+    Lattice m2 = midpoint(corners[2],corners[0]);
+    Lattice next[4][3] = { { m0, m1, m2 },
+                           { corners[0], m0, m2 },
+                           { corners[1], m1, m0 },
+                           { corners[2], m2, m1 } };
+    for (int i = 0; i < 3; i++) corners[i] = next[child][i];
+  }
+}
+
+// add the given number of rings of triangles (through the vertices)
+// around the triangles already in the list
+static void growPatch(const Mesh &mesh, int rings, std::vector<int> &triangles, std::vector<char> &in_patch) {
+  std::vector<int> outgoing;
+  unsigned int ring_begin = 0;
+  for (int r = 0; r < rings; r++) {
+    unsigned int ring_end = triangles.size();
+    for (unsigned int i = ring_begin; i < ring_end; i++) {
+      for (int k = 0; k < 3; k++) {
+        mesh.getOutgoingHalfEdges(mesh.getTriangleVertex(triangles[i],k), outgoing);
+        for (unsigned int j = 0; j < outgoing.size(); j++) {
+          int tri = Mesh::halfEdgeTriangle(outgoing[j]);
+          if (in_patch[tri]) continue;
+          in_patch[tri] = 1;
+          triangles.push_back(tri);
+        }
+      }
+    }
+    ring_begin = ring_end;
+  }
+}
+
+
+bool Mesh::StreamSubdivision(int levels, bool butterfly, MeshWriter &writer, const std::string &output_file) {
+  assert (levels >= 0 && levels <= 12);
+  int S = 1 << levels;
+  int num_half_edges = he_vertex.size();
+  bool has_creases = false;
+  for (int v = 0; v < numVertices(); v++) {
+    if (vertex_creases[v] > 0) has_creases = true;
+  }
+  int rings = butterfly ? BUTTERFLY_PATCH_RINGS :
+    has_creases ? LOOP_CREASE_PATCH_RINGS : LOOP_PATCH_RINGS;
+
+  // the output size is known before anything is subdivided
+  long long num_used_vertices = 0;
+  long long num_undirected_edges = 0;
+  for (int v = 0; v < numVertices(); v++) {
+    if (vertex_halfedge[v] >= 0) num_used_vertices++;
+  }
+  for (int h = 0; h < num_half_edges; h++) {
+    if (he_vertex[h] >= 0 && (he_opposite[h] < 0 || he_opposite[h] > h)) num_undirected_edges++;
+  }
+  long long out_vertices = num_used_vertices + num_undirected_edges*(S-1)
+    + (long long)num_triangles*(S-1)*(S-2)/2;
+  long long out_triangles = (long long)num_triangles*S*S;
+  if (out_vertices > 0x7fffffff || out_triangles > 0x7fffffff) {
+    std::cout << "ERROR! too many triangles for " << levels << " levels" << std::endl;
+    return false;
+  }
+  if (!writer.begin(output_file, out_vertices, out_triangles)) {
+    std::cout << "ERROR! CANNOT WRITE: " << output_file << std::endl;
+    return false;
+  }
+
+  // output index of the vertices shared between patches: the base
+  // vertices, and the S-1 new vertices on every base edge (kept only
+  // until both triangles of the edge are done)
+  std::vector<int> vertex_index(numVertices(), -1);
+  std::vector<std::vector<int> > edge_index(num_half_edges);
+  std::vector<char> edge_users(num_half_edges, 0);
+  // output index of the vertices inside the current base triangle
+  std::vector<int> interior_index((S+1)*(S+1));
+  int next_index = 0;
+
+  std::vector<int> local_vertex(numVertices(), -1);
+  std::vector<char> in_patch(numTriangleSlots(), 0);
+  std::vector<int> patch_triangles;
+  std::vector<int> patch_vertices;
+  std::vector<int> keep;
+  std::vector<char> in_keep;
+
+  for (int t = 0; t < numTriangleSlots(); t++) {
+    if (!isTriangleAlive(t)) continue;
+
+    // collect the patch, the base triangle first
+    patch_triangles.clear();
+    patch_triangles.push_back(t);
+    in_patch[t] = 1;
+    growPatch(*this, rings, patch_triangles, in_patch);
+
+    // copy it into a small mesh of its own
+    Mesh patch(args);
+    patch.print_progress = false;
+    patch_vertices.clear();
+    for (unsigned int i = 0; i < patch_triangles.size(); i++) {
+      int tri = patch_triangles[i];
+      int corners[3];
+      for (int k = 0; k < 3; k++) {
+        int v = he_vertex[3*tri+k];
+        if (local_vertex[v] < 0) {
+          local_vertex[v] = patch.addVertex(positions[v]);
+          patch.vertex_creases[local_vertex[v]] = vertex_creases[v];
+          patch_vertices.push_back(v);
+        }
+        corners[k] = local_vertex[v];
+      }
+      int patch_tri = patch.addTriangle(corners[0],corners[1],corners[2]);
+      for (int k = 0; k < 3; k++) {
+        patch.he_crease[3*patch_tri+k] = he_crease[3*tri+k];
+      }
+    }
+    for (unsigned int i = 0; i < patch_vertices.size(); i++) local_vertex[patch_vertices[i]] = -1;
+    for (unsigned int i = 0; i < patch_triangles.size(); i++) in_patch[patch_triangles[i]] = 0;
+
+    for (int level = 0; level < levels; level++) {
+      if (butterfly) patch.ButterflySubdivision();
+      else patch.LoopSubdivision();
+      if (level+1 == levels) break;
+      // the next level only needs the same number of (now finer) rings
+      // around the descendants of the base triangle, which stay first
+      int num_descendants = 1 << (2*(level+1));
+      keep.clear();
+      in_keep.assign(patch.numTriangleSlots(), 0);
+      for (int q = 0; q < num_descendants; q++) {
+        keep.push_back(q);
+        in_keep[q] = 1;
+      }
+      growPatch(patch, rings, keep, in_keep);
+      for (int q = num_descendants; q < patch.numTriangleSlots(); q++) {
+        if (!in_keep[q]) patch.removeTriangle(q);
+      }
+    }
+
+    // write the descendants of the base triangle
+    std::fill(interior_index.begin(), interior_index.end(), -1);
+    for (int q = 0; q < S*S; q++) {
+      Lattice corners[3];
+      descendantCorners(q, levels, S, corners);
+      int out[3];
+      for (int k = 0; k < 3; k++) {
+        const int *b = corners[k].b;
+        int *index;
+        if (b[0] == S || b[1] == S || b[2] == S) {
+          // a base vertex
+          int i = (b[0] == S) ? 0 : (b[1] == S) ? 1 : 2;
+          index = &vertex_index[he_vertex[3*t+i]];
+        } else if (b[0] == 0 || b[1] == 0 || b[2] == 0) {
+          // on the base edge from corner i to corner i+1, counted from
+          // the start of the half-edge that stands for both directions
+          int i = (b[2] == 0) ? 0 : (b[0] == 0) ? 1 : 2;
+          int h = 3*t+i;
+          int o = he_opposite[h];
+          int offset = b[(i+1)%3];
+          if (o >= 0 && o < h) { h = o; offset = S - offset; }
+          if (edge_index[h].empty()) {
+            edge_index[h].assign(S-1, -1);
+            edge_users[h] = (o < 0) ? 1 : 2;
+          }
+          index = &edge_index[h][offset-1];
+        } else {
+          index = &interior_index[b[0]*(S+1)+b[1]];
+        }
+        if (*index < 0) {
+          *index = next_index++;
+          writer.addVertex(patch.getPos(patch.getTriangleVertex(q,k)));
+        }
+        out[k] = *index;
+      }
+      writer.addTriangle(out[0],out[1],out[2]);
+    }
+
+    // forget the edges that no other patch will use
+    for (int i = 0; i < 3 && levels > 0; i++) {
+      int h = 3*t+i;
+      int o = he_opposite[h];
+      if (o >= 0 && o < h) h = o;
+      if (--edge_users[h] == 0) std::vector<int>().swap(edge_index[h]);
+    }
+  }
+
+  assert (next_index == out_vertices);
+  return writer.end();
+}
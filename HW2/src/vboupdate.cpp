@@ -0,0 +1,260 @@
+#include "glCanvas.h"
+#include <algorithm>
+
+#include "mesh.h"
+
+// =======================================================================
+// Incremental VBO updates.  setupVBOs remembers where every triangle,
+// render vertex & edge went (the vbo_ members) and leaves some room at
+// the end of every buffer.  An edit marks the triangles & vertices it
+// touched (markTriangleDirty / markVertexDirty), and updateVBOs then
+// rewrites only the records that depend on them, in place:
+//
+//  - a removed triangle or edge becomes a degenerate tombstone and its
+//    slot is handed to the next new one (VBOSlots);
+//  - gouraud: a vertex that needs more smoothing groups than it has room
+//    for moves to the end of the vertex buffer, the old ones become
+//    garbage;
+//  - the changed records are sorted by slot and every run of
+//    consecutive slots is one glBufferSubData.
+//
+// The walks around the vertices have to reach all their corners, so a
+// mesh with non-manifold vertices is always rebuilt.
+//
+// So the upload is about the size of the edit (for a collapse: the
+// triangles, vertices & edges around the 2 vertices).  When the garbage
+// gets too large, the buffers run out of room, or the whole mesh was
+// rebuilt (subdivision, loading...) it is setupVBOs again, which also
+// compacts everything.
+// =======================================================================
+
+// rebuild (& compact) when more than this part of the records is garbage
+#define VBO_MAX_GARBAGE 0.33
+// or when more than this part of the triangles has to be rewritten
+// anyway (the flat rebuild is cheap, so it pays off sooner); measured
+// on a subdivided bunny, the incremental update is ~400x faster for a
+// few collapses and breaks even at about these fractions
+#define VBO_MAX_REWRITE_FLAT 0.15
+#define VBO_MAX_REWRITE_GOURAUD 0.5
+
+// uploads (slot, record) pairs, one glBufferSubData per run of
+// consecutive slots; of several records for one slot the last one wins
+template <class T>
+static void uploadRecords(GLenum target, GLuint buffer, std::vector<std::pair<int,T> > &records) {
+  if (records.empty()) return;
+  std::stable_sort(records.begin(), records.end(),
+                   [](const std::pair<int,T> &a, const std::pair<int,T> &b) { return a.first < b.first; });
+  glBindBuffer(target, buffer);
+  std::vector<T> run;
+  int run_start = 0;
+  for (unsigned int i = 0; i < records.size(); i++) {
+    if (i+1 < records.size() && records[i+1].first == records[i].first) continue;
+    int slot = records[i].first;
+    if (!run.empty() && slot != run_start + (int)run.size()) {
+      glBufferSubData(target, sizeof(T) * run_start, sizeof(T) * run.size(), run.data());
+      run.clear();
+    }
+    if (run.empty()) run_start = slot;
+    run.push_back(records[i].second);
+  }
+  glBufferSubData(target, sizeof(T) * run_start, sizeof(T) * run.size(), run.data());
+}
+
+static void sortUnique(std::vector<int> &v) {
+  std::sort(v.begin(), v.end());
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+
+void Mesh::updateVBOs() {
+  assert (vbos_initialized);
+  HandleGLError("in update mesh VBOs");
+  double num_dirty = dirty_triangles.size() + dirty_vertices.size();
+  if (vbos_dirty_all || vbo_gouraud != args->gouraud || vbo_nonmanifold
+      || num_dirty > numTriangles()
+      || vbo_tri_slots.free_slots.size() > VBO_MAX_GARBAGE * vbo_tri_slots.count
+      || vbo_render_garbage > VBO_MAX_GARBAGE * vbo_render_verts
+      || numVertices() > vbo_verts_capacity
+      || !patchVBOs()) {
+    setupVBOs();
+    return;
+  }
+  dirty_triangles.clear();
+  dirty_vertices.clear();
+  HandleGLError("leaving update mesh VBOs");
+}
+
+
+// works out all the changed records first and uploads them at the end,
+// so when it gives up (returns false) nothing was uploaded yet
+bool Mesh::patchVBOs() {
+  sortUnique(dirty_triangles);
+  sortUnique(dirty_vertices);
+  if ((int)vbo_tri_slot.size() < numTriangleSlots()) vbo_tri_slot.resize(numTriangleSlots(), -1);
+  if (vbo_edge_class.size() < he_vertex.size()) {
+    vbo_edge_class.resize(he_vertex.size(), -1);
+    vbo_edge_slot.resize(he_vertex.size(), -1);
+  }
+  if (vbo_gouraud && (int)vbo_vertex_first.size() < numVertices()) {
+    vbo_vertex_first.resize(numVertices(), -1);
+    vbo_vertex_count.resize(numVertices(), 0);
+  }
+
+  // the triangles to rewrite: the dirty ones & the ones around a dirty
+  // vertex, which may have moved
+  std::vector<int> triangles = dirty_triangles;
+  std::vector<int> outgoing;
+  for (unsigned int i = 0; i < dirty_vertices.size(); i++) {
+    int v = dirty_vertices[i];
+    if (!isVertexAlive(v)) continue;
+    getOutgoingHalfEdges(v, outgoing);
+    for (unsigned int j = 0; j < outgoing.size(); j++) triangles.push_back(halfEdgeTriangle(outgoing[j]));
+  }
+  sortUnique(triangles);
+  double max_rewrite = vbo_gouraud ? VBO_MAX_REWRITE_GOURAUD : VBO_MAX_REWRITE_FLAT;
+  if (triangles.size() > max_rewrite * numTriangles()) return false;
+
+  std::vector<std::pair<int,unsigned int> > index_records;
+  std::vector<std::pair<int,VBOTriVert> > vertex_records;
+
+  // removed triangles first, so new ones can take their slots
+  for (unsigned int i = 0; i < triangles.size(); i++) {
+    int t = triangles[i];
+    int s = vbo_tri_slot[t];
+    if (isTriangleAlive(t) || s < 0) continue;
+    for (int k = 0; k < 3; k++) index_records.push_back(std::make_pair(3*s+k, 0u));
+    vbo_tri_slots.release(s);
+    vbo_tri_slot[t] = -1;
+  }
+  for (unsigned int i = 0; i < triangles.size(); i++) {
+    int t = triangles[i];
+    if (!isTriangleAlive(t)) continue;
+    if (vbo_tri_slot[t] < 0) {
+      vbo_tri_slot[t] = vbo_tri_slots.allocate();
+      if (vbo_tri_slot[t] < 0) return false;
+    }
+    if (vbo_gouraud) continue;
+    // flat: the 3 vertices of the triangle are the ones of its slot
+    int s = vbo_tri_slot[t];
+    Vec3f a = positions[he_vertex[3*t]];
+    Vec3f b = positions[he_vertex[3*t+1]];
+    Vec3f c = positions[he_vertex[3*t+2]];
+    Vec3f normal = ComputeNormal(a,b,c);
+    vertex_records.push_back(std::make_pair(3*s, VBOTriVert(a,normal)));
+    vertex_records.push_back(std::make_pair(3*s+1, VBOTriVert(b,normal)));
+    vertex_records.push_back(std::make_pair(3*s+2, VBOTriVert(c,normal)));
+    for (int k = 0; k < 3; k++) index_records.push_back(std::make_pair(3*s+k, (unsigned int)(3*s+k)));
+  }
+
+  if (vbo_gouraud) {
+    // the normals of a vertex depend on all the triangles around it, so
+    // the neighbors of a dirty vertex get new ones as well
+    std::vector<int> smooth;
+    std::vector<int> ring;
+    for (unsigned int i = 0; i < dirty_vertices.size(); i++) {
+      int v = dirty_vertices[i];
+      if (!isVertexAlive(v)) {
+        // collapsed away, its render vertices are garbage now
+        if (vbo_vertex_first[v] >= 0) vbo_render_garbage += vbo_vertex_count[v];
+        vbo_vertex_first[v] = -1;
+        vbo_vertex_count[v] = 0;
+        continue;
+      }
+      smooth.push_back(v);
+      getOneRing(v, ring);
+      smooth.insert(smooth.end(), ring.begin(), ring.end());
+    }
+    sortUnique(smooth);
+
+    std::vector<int> corners, groups, written;
+    std::vector<Vec3f> normals;
+    for (unsigned int i = 0; i < smooth.size(); i++) {
+      int v = smooth[i];
+      int count = getSmoothingGroups(v, corners, groups);
+      if (vbo_vertex_first[v] < 0 || count > vbo_vertex_count[v]) {
+        // no room where it is, move it to the end
+        if (vbo_vertex_first[v] >= 0) vbo_render_garbage += vbo_vertex_count[v];
+        if (vbo_render_verts + count > vbo_render_capacity) return false;
+        vbo_vertex_first[v] = vbo_render_verts;
+        vbo_vertex_count[v] = count;
+        vbo_render_verts += count;
+      }
+      int first = vbo_vertex_first[v];
+      normals.assign(count, Vec3f(0,0,0));
+      for (unsigned int j = 0; j < corners.size(); j++) {
+        int h = corners[j];
+        int t = halfEdgeTriangle(h);
+        Vec3f face_normal;
+        const Vec3f &a = positions[he_vertex[3*t]];
+        Vec3f::Cross3(face_normal, positions[he_vertex[3*t+1]] - a, positions[he_vertex[3*t+2]] - a);
+        normals[groups[j]] += face_normal;
+        index_records.push_back(std::make_pair(3*vbo_tri_slot[t] + h%3, (unsigned int)(first + groups[j])));
+        written.push_back(h);
+      }
+      for (int g = 0; g < count; g++) {
+        normals[g].Normalize();
+        vertex_records.push_back(std::make_pair(first + g, VBOTriVert(positions[v], normals[g])));
+      }
+    }
+
+    // the edits keep the mesh manifold (see addTriangle &
+    // removeTriangle), so the walks should have reached every corner of
+    // the rewritten triangles; if not, rebuild
+    sortUnique(written);
+    for (unsigned int i = 0; i < triangles.size(); i++) {
+      int t = triangles[i];
+      if (!isTriangleAlive(t)) continue;
+      for (int k = 0; k < 3; k++) {
+        if (!std::binary_search(written.begin(), written.end(), 3*t+k)) return false;
+      }
+    }
+  }
+
+  // the edges of the rewritten triangles, from both sides
+  std::vector<int> half_edges;
+  for (unsigned int i = 0; i < triangles.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      int h = 3*triangles[i]+k;
+      half_edges.push_back(h);
+      if (he_opposite[h] >= 0) half_edges.push_back(he_opposite[h]);
+    }
+  }
+  sortUnique(half_edges);
+  std::vector<std::pair<int,VBOEdge> > edge_records[3];
+  for (unsigned int i = 0; i < half_edges.size(); i++) {
+    int h = half_edges[i];
+    int c = edgeClass(h);
+    int old = vbo_edge_class[h];
+    if (old >= 0 && old != c) {
+      edge_records[old].push_back(std::make_pair(vbo_edge_slot[h], VBOEdge(0,0)));
+      vbo_edge_slots[old].release(vbo_edge_slot[h]);
+      vbo_edge_class[h] = -1;
+      vbo_edge_slot[h] = -1;
+    }
+    if (c < 0) continue;
+    if (vbo_edge_class[h] < 0) {
+      int s = vbo_edge_slots[c].allocate();
+      if (s < 0) return false;
+      vbo_edge_class[h] = c;
+      vbo_edge_slot[h] = s;
+    }
+    edge_records[c].push_back(std::make_pair(vbo_edge_slot[h], VBOEdge(he_vertex[h],endVertex(h))));
+  }
+
+  if (!vbo_gouraud) vbo_render_verts = 3 * vbo_tri_slots.count;
+
+  std::vector<std::pair<int,VBOVert> > vert_records;
+  for (unsigned int i = 0; i < dirty_vertices.size(); i++) {
+    int v = dirty_vertices[i];
+    if (isVertexAlive(v)) vert_records.push_back(std::make_pair(v, VBOVert(positions[v])));
+  }
+
+  uploadRecords(GL_ARRAY_BUFFER, mesh_tri_verts_VBO, vertex_records);
+  uploadRecords(GL_ELEMENT_ARRAY_BUFFER, mesh_tri_indices_VBO, index_records);
+  uploadRecords(GL_ARRAY_BUFFER, mesh_verts_VBO, vert_records);
+  GLuint edge_VBOs[3] = { mesh_boundary_edge_indices_VBO, mesh_crease_edge_indices_VBO, mesh_other_edge_indices_VBO };
+  for (int c = 0; c < 3; c++) uploadRecords(GL_ELEMENT_ARRAY_BUFFER, edge_VBOs[c], edge_records[c]);
+  return true;
+}
+
+// =======================================================================
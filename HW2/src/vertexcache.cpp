@@ -0,0 +1,197 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "vertexcache.h"
+
+// ====================================================================
+// the scoring constants from the paper
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRI_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+// up to this many remaining triangles the valence boost is tabulated
+#define MAX_VALENCE_SCORE 32
+
+struct ScoreTables {
+  ScoreTables() {
+    for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+      if (i < 3) {
+        // the vertices of the last triangle get a fixed score, so the
+        // next triangle does not just reuse its edge & strip along
+        cache[i] = LAST_TRI_SCORE;
+      } else {
+        float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+        cache[i] = powf(1.0f - (i - 3) * scaler, CACHE_DECAY_POWER);
+      }
+    }
+    valence[0] = 0;
+    for (int i = 1; i < MAX_VALENCE_SCORE; i++) {
+      valence[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+  }
+  float cache[VERTEX_CACHE_SIZE];
+  float valence[MAX_VALENCE_SCORE];
+};
+
+static const ScoreTables score_tables;
+
+// cache_position is -1 if the vertex is not in the cache
+static float vertexScore(int cache_position, int remaining) {
+  if (remaining == 0) return -1;
+  float score = (cache_position >= 0) ? score_tables.cache[cache_position] : 0;
+  if (remaining < MAX_VALENCE_SCORE) score += score_tables.valence[remaining];
+  else score += VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+  return score;
+}
+
+// ====================================================================
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, int num_vertices,
+                         std::vector<int> *order) {
+  int num_tris = indices.size() / 3;
+  if (order != NULL) order->clear();
+  if (num_tris == 0) return;
+
+  // the triangles of every vertex (compressed rows)
+  std::vector<int> offsets(num_vertices+1, 0);
+  for (unsigned int i = 0; i < indices.size(); i++) {
+    assert ((int)indices[i] < num_vertices);
+    offsets[indices[i]+1]++;
+  }
+  for (int v = 0; v < num_vertices; v++) offsets[v+1] += offsets[v];
+  std::vector<int> vertex_tris(indices.size());
+  std::vector<int> remaining(num_vertices, 0);
+  for (int t = 0; t < num_tris; t++) {
+    for (int k = 0; k < 3; k++) {
+      int v = indices[3*t+k];
+      vertex_tris[offsets[v] + remaining[v]++] = t;
+    }
+  }
+  // remaining[v] is the number of v's triangles that are not emitted
+  // yet; they are kept at the front of v's row
+
+  std::vector<int> cache_position(num_vertices, -1);
+  std::vector<float> vertex_score(num_vertices);
+  for (int v = 0; v < num_vertices; v++) {
+    vertex_score[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> tri_score(num_tris);
+  std::vector<char> emitted(num_tris, 0);
+  for (int t = 0; t < num_tris; t++) {
+    tri_score[t] = vertex_score[indices[3*t]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+  }
+
+  std::vector<unsigned int> result;
+  result.reserve(indices.size());
+  // LRU cache, with room for the 3 vertices pushed in front of it
+  int cache[VERTEX_CACHE_SIZE+3];
+  int cache_size = 0;
+  // where to continue the full scan when the cache gives no candidate
+  int scan = 0;
+
+  int best = -1;
+  for (int n = 0; n < num_tris; n++) {
+    if (best < 0) {
+      // nothing in the cache touches a remaining triangle: take the
+      // best scoring of all the remaining ones (in practice the first
+      // few remaining are as good as any)
+      while (emitted[scan]) scan++;
+      best = scan;
+      for (int t = scan; t < num_tris && t < scan + 64; t++) {
+        if (!emitted[t] && tri_score[t] > tri_score[best]) best = t;
+      }
+    }
+
+    // emit it
+    emitted[best] = 1;
+    if (order != NULL) order->push_back(best);
+    int corners[3] = { (int)indices[3*best], (int)indices[3*best+1], (int)indices[3*best+2] };
+    for (int k = 0; k < 3; k++) {
+      int v = corners[k];
+      result.push_back(v);
+      // move best to the end of v's remaining triangles & drop it
+      int *row = &vertex_tris[offsets[v]];
+      for (int i = 0; i < remaining[v]; i++) {
+        if (row[i] == best) {
+          std::swap(row[i], row[remaining[v]-1]);
+          break;
+        }
+      }
+      remaining[v]--;
+    }
+
+    // the corners go to the front of the cache, in order
+    int new_cache[VERTEX_CACHE_SIZE+3];
+    int new_size = 0;
+    for (int k = 0; k < 3; k++) new_cache[new_size++] = corners[k];
+    for (int i = 0; i < cache_size; i++) {
+      int v = cache[i];
+      if (v != corners[0] && v != corners[1] && v != corners[2]) new_cache[new_size++] = v;
+    }
+    // the ones that fall out are no longer in the cache
+    for (int i = VERTEX_CACHE_SIZE; i < new_size; i++) {
+      cache_position[new_cache[i]] = -1;
+      vertex_score[new_cache[i]] = vertexScore(-1, remaining[new_cache[i]]);
+    }
+    cache_size = std::min(new_size, VERTEX_CACHE_SIZE);
+    for (int i = 0; i < cache_size; i++) cache[i] = new_cache[i];
+
+    // rescore the cached vertices & their remaining triangles, and pick
+    // the best of those as the next triangle
+    for (int i = 0; i < cache_size; i++) {
+      int v = cache[i];
+      cache_position[v] = i;
+      vertex_score[v] = vertexScore(i, remaining[v]);
+    }
+    best = -1;
+    float best_score = -1;
+    for (int i = 0; i < cache_size; i++) {
+      int v = cache[i];
+      const int *row = &vertex_tris[offsets[v]];
+      for (int j = 0; j < remaining[v]; j++) {
+        int t = row[j];
+        float score = vertex_score[indices[3*t]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+        tri_score[t] = score;
+        if (score > best_score) {
+          best_score = score;
+          best = t;
+        }
+      }
+    }
+  }
+  indices.swap(result);
+}
+
+
+void reorderVerticesByFirstUse(std::vector<unsigned int> &indices, int num_vertices,
+                               std::vector<int> &new_index) {
+  new_index.assign(num_vertices, -1);
+  int next = 0;
+  for (unsigned int i = 0; i < indices.size(); i++) {
+    int &index = new_index[indices[i]];
+    if (index < 0) index = next++;
+    indices[i] = index;
+  }
+}
+
+
+double averageCacheMissRatio(const std::vector<unsigned int> &indices, int num_vertices, int cache_size) {
+  int num_tris = indices.size() / 3;
+  if (num_tris == 0) return 0;
+  // FIFO: a vertex is in the cache if it went in less than cache_size
+  // misses ago
+  std::vector<long long> entered(num_vertices, -(1LL << 40));
+  long long misses = 0;
+  for (unsigned int i = 0; i < indices.size(); i++) {
+    int v = indices[i];
+    if (misses - entered[v] >= cache_size) {
+      entered[v] = misses;
+      misses++;
+    }
+  }
+  return (double)misses / num_tris;
+}
+
+// ====================================================================
@@ -0,0 +1,40 @@
+#ifndef _VERTEX_CACHE_H_
+#define _VERTEX_CACHE_H_
+
+#include <vector>
+#include <cstddef>
+
+// ====================================================================
+// Triangle & vertex ordering for the post-transform vertex cache of the
+// GPU (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").  The
+// triangles are emitted greedily: next is always the triangle whose
+// vertices score best, where a vertex scores higher if it was used
+// recently (it is still in a simulated LRU cache) and if few of its
+// triangles are left (so it can leave the cache for good).
+//
+// indices holds 3 vertex indices per triangle, vertices are numbered
+// 0..num_vertices-1.
+// ====================================================================
+
+#define VERTEX_CACHE_SIZE 32
+
+// reorder the triangles in place; if order is given, order[i] is the
+// old number of the triangle that is now the i-th
+void optimizeVertexCache(std::vector<unsigned int> &indices, int num_vertices,
+                         std::vector<int> *order = NULL);
+
+// renumber the vertices in the order the triangles first use them (so
+// the vertex fetches go through memory in order as well); new_index
+// gives the new number of every old vertex, -1 if it is not used
+void reorderVerticesByFirstUse(std::vector<unsigned int> &indices, int num_vertices,
+                               std::vector<int> &new_index);
+
+// average cache miss ratio (transformed vertices per triangle) for a
+// FIFO cache of the given size; 0.5 is about the best possible for a
+// large regular mesh, 3 is no reuse at all
+double averageCacheMissRatio(const std::vector<unsigned int> &indices, int num_vertices,
+                             int cache_size = VERTEX_CACHE_SIZE);
+
+// ====================================================================
+
+#endif
@@ -9,7 +9,7 @@
 
 // ================================================================================
 // ================================================================================
-enum AnimateType { Animate, Runge_Kutta, AdaptiveTimestep};
+enum AnimateType { Animate, Runge_Kutta, AdaptiveTimestep, Implicit};
 class ArgParser {
 
 public:
@@ -39,6 +39,7 @@ public:
         assert (timestep > 0);
       } else if (argv[i] == std::string("-animatetype")) {
           i++; assert(i < argc);
+          char str4[] = "implicit";
           char str3[] = "adaptive_timestep";
           char str2[] = "runge_kutta";
           char str1[] = "animate";
@@ -50,14 +51,34 @@ public:
              animateType = AnimateType::Runge_Kutta;
           else if (0 == strcmp(str0, str3))
               animateType = AnimateType::AdaptiveTimestep;
+          else if (0 == strcmp(str0, str4))
+              animateType = AnimateType::Implicit;
       }else if (argv[i] == std::string("-dynamicInverseConstraints")) {
           //i++; assert(i < argc);
           isDynamicInverseConstraints = true;
       }
+      else if (argv[i] == std::string("-xpbdConstraints")) {
+          isXPBDConstraints = true;
+      }
+      else if (argv[i] == std::string("-constraintIterations")) {
+          i++; assert(i < argc);
+          constraintIterations = atoi(argv[i]);
+          assert(constraintIterations >= 1);
+      }
+      else if (argv[i] == std::string("-constraintCompliance")) {
+          i++; assert(i < argc);
+          constraintCompliance = atof(argv[i]);
+          assert(constraintCompliance >= 0);
+      }
       else if (argv[i] == std::string("-iterations")) {
           i++; assert(i < argc);
           num = atoi(argv[i]);
       }
+      else if (argv[i] == std::string("-threads")) {
+          i++; assert(i < argc);
+          num_threads = atoi(argv[i]);
+          assert(num_threads >= 0);
+      }
       else {
 	        printf ("whoops error with command line argument %d: '%s'\n",i,argv[i]);
 	        assert(0);
@@ -71,7 +92,11 @@ public:
         std::cout << "Method:  Runge_Kutta Method" << std::endl;
     else if (animateType == AnimateType::AdaptiveTimestep)
         std::cout << "Method:  AdaptiveTimestep Method" << std::endl;
-    if (isDynamicInverseConstraints)
+    else if (animateType == AnimateType::Implicit)
+        std::cout << "Method:  Implicit (backward Euler) Method" << std::endl;
+    if (isXPBDConstraints)
+        std::cout << "XPBD Constraints: ON, " << constraintIterations << " iterations, compliance " << constraintCompliance << std::endl;
+    else if (isDynamicInverseConstraints)
         std::cout << "Dynamic Inverse Constraints On Deformation Rate: ON" << std::endl;
     else
         std::cout << "Dynamic Inverse Constraints On Deformation Rate: OFF" << std::endl;
@@ -79,6 +104,10 @@ public:
         std::cout << "Iterations: INFINITE" << std::endl;
     else
         std::cout << "Iterations: " <<num<< std::endl;
+    if (num_threads == 0)
+        std::cout << "Threads: ALL" << std::endl;
+    else
+        std::cout << "Threads: " << num_threads << std::endl;
 
 
   }
@@ -116,7 +145,11 @@ public:
     //ZYF ADD
     animateType = AnimateType::Animate;
     isDynamicInverseConstraints = false;
+    isXPBDConstraints = false;
+    constraintIterations = 4;
+    constraintCompliance = 0;
     num = -1;
+    num_threads = 0;
     
   }
 
@@ -159,7 +192,14 @@ public:
   //ZYF ADD
   AnimateType animateType;
   bool isDynamicInverseConstraints;
+  // the same limits as isDynamicInverseConstraints, projected with XPBD
+  // (cloth_constraints.cpp) instead; replaces it when both are given
+  bool isXPBDConstraints;
+  int constraintIterations;
+  double constraintCompliance;
   int num;
+  // threads of the cloth step, 0 = one per hardware thread
+  int num_threads;
 };
 
 // ================================================================================
@@ -4,56 +4,90 @@
 #include "argparser.h"
 #include "boundingbox.h"
 #include "vbo_structs.h"
+#include "threadpool.h"
 #include <vector>
 
 // =====================================================================================
 // Cloth Particles
 // =====================================================================================
 
-class ClothParticle {
+// the simulation runs in double precision, or in single precision when
+// built with CLOTH_FLOAT defined (twice as many values per vector
+// instruction)
+#ifdef CLOTH_FLOAT
+typedef float cloth_real;
+#else
+typedef double cloth_real;
+#endif
+
+// one vector quantity (position, velocity, ...) of all the particles,
+// stored as separate x, y & z arrays so that the loops over the
+// particles in cloth.cpp can be vectorized (build with AVX2 enabled,
+// e.g. /arch:AVX2, or -O3 -mavx2 -fno-math-errno with gcc, to get 4
+// doubles / 8 floats at once).  The loops take a range of particles, so
+// that every thread of the step works on its own block.
+class ParticleVectors {
 public:
-  // ACCESSORS
-  const Vec3f& getOriginalPosition() const{ return original_position; }
-  const Vec3f& getPosition() const{ return position; }
-  const Vec3f& getVelocity() const{ return velocity; }
-  const Vec3f& getAcceleration() const { return acceleration; }
-  Vec3f getForce() const { return mass*acceleration; }
-  double getMass() const { return mass; }
-  bool isFixed() const { return fixed; }
-  // MODIFIERS
-  void setOriginalPosition(const Vec3f &p) { original_position = p; }
-  void setPosition(const Vec3f &p) { position = p; }
-  void setVelocity(const Vec3f &v) { velocity = v; }
-  void setAcceleration(const Vec3f &a) { acceleration = a; }
-  void setMass(double m) { mass = m; }
-  void setFixed(bool b) { fixed = b; }
+  void resize(int n) { x.assign(n,0); y.assign(n,0); z.assign(n,0); }
+  int size() const { return x.size(); }
+  Vec3f get(int k) const { return Vec3f(x[k],y[k],z[k]); }
+  void set(int k, const Vec3f &v) { x[k] = v.x(); y[k] = v.y(); z[k] = v.z(); }
+  // the x (0), y (1) or z (2) array
+  cloth_real* component(int c) { return (c == 0) ? &x[0] : (c == 1) ? &y[0] : &z[0]; }
+  const cloth_real* component(int c) const { return (c == 0) ? &x[0] : (c == 1) ? &y[0] : &z[0]; }
+  // this = v, for the particles in [begin,end)
+  void copy(const ParticleVectors &v, int begin, int end);
+  // this = s * v, for the particles in [begin,end)
+  void assignScaled(cloth_real s, const ParticleVectors &v, int begin, int end);
+  // this += s * v, for the particles in [begin,end)
+  void addScaled(cloth_real s, const ParticleVectors &v, int begin, int end);
 
-  //ZYF ADD
-  void setLastPosition(const Vec3f& p) { last_position = p; }
-  void setLastVelocity(const Vec3f& v) { last_velocity = v; }
-  void setLastAcceleration(const Vec3f& a) { last_acceleration = a; }
-  void setRKVelocity(const Vec3f& v) { Runge_Kutta_velocity = v; }
+  std::vector<cloth_real> x;
+  std::vector<cloth_real> y;
+  std::vector<cloth_real> z;
+};
 
-  const Vec3f& getLastPosition() const { return last_position; }
-  const Vec3f& getLastVelocity() const { return last_velocity; }
-  const Vec3f& getLastAcceleration() const { return last_acceleration; }
-  const Vec3f& getRKVelocity() const { return Runge_Kutta_velocity; }
+// symmetric 3x3 matrices, one per element, stored as separate arrays
+// of their 6 distinct entries like ParticleVectors
+struct SymmetricBlocks {
+  void resize(int n) { xx.assign(n,0); xy.assign(n,0); xz.assign(n,0); yy.assign(n,0); yz.assign(n,0); zz.assign(n,0); }
+  int size() const { return xx.size(); }
 
+  std::vector<cloth_real> xx;
+  std::vector<cloth_real> xy;
+  std::vector<cloth_real> xz;
+  std::vector<cloth_real> yy;
+  std::vector<cloth_real> yz;
+  std::vector<cloth_real> zz;
+};
 
-private:
-  // REPRESENTATION
-  Vec3f original_position;
-  Vec3f position;
-  Vec3f velocity;
-  Vec3f acceleration;
-  double mass;
-  bool fixed;
+// =====================================================================================
+// Cloth Springs
+// =====================================================================================
 
-  //ZYF ADD
-  Vec3f last_position;
-  Vec3f last_velocity;
-  Vec3f last_acceleration;
-  Vec3f Runge_Kutta_velocity;
+enum SpringType { STRUCTURAL_SPRING, SHEAR_SPRING, FLEXION_SPRING };
+
+// the springs of one type that go from every particle k to particle
+// k+offset, i.e. one direction (di,dj) on the grid; built once in the
+// Cloth constructor.  The arrays have an entry for every k < number of
+// particles - offset, with stiffness 0 where k has no such spring (the
+// neighbour would be off the edge of the grid).
+struct SpringSet {
+  SpringType type;
+  int di;
+  int dj;
+  int offset;
+  std::vector<cloth_real> rest_length;
+  std::vector<cloth_real> stiffness;
+  // scratch, the force of spring k on particle k in this pass (and minus
+  // that on particle k+offset)
+  ParticleVectors force;
+  // the implicit integrator only (cloth_implicit.cpp): minus the
+  // derivative of that force by the position of particle k
+  SymmetricBlocks jacobian;
+  // the XPBD constraints only (cloth_constraints.cpp): the Lagrange
+  // multiplier of the stretch limit of spring k in this step
+  std::vector<cloth_real> lambda;
 };
 
 // =====================================================================================
@@ -64,10 +98,16 @@ class Cloth {
 
 public:
   Cloth(ArgParser *args);
-  ~Cloth() { delete [] particles; cleanupVBOs(); }
+  ~Cloth() { cleanupVBOs(); delete pool; }
 
   // ACCESSORS
   const BoundingBox& getBoundingBox() const { return box; }
+  int numParticles() const { return nx*ny; }
+  // the average time of Animate / Runge_Kutta / Implicit_Euler so far,
+  // without the VBOs
+  double getNanosecondsPerParticleStep() const;
+  // the average number of conjugate gradient iterations of Implicit_Euler
+  double getAverageCGIterations() const;
 
   // PAINTING & ANIMATING
   void Paint() const;
@@ -79,35 +119,88 @@ public:
   void cleanupVBOs();
 
   //ZYF ADD
-  Vec3f computeF(ClothParticle& p, int i, int j);
+  // the total force on every particle into forces, from the positions
+  // & velocities at the start of the pass
+  void computeForces();
   void Dynamic_Inverse_Constraints_On_Deformation_Rate();
   void AdaptiveTimestep();
   double GetMaxVelocity(int type);
   void ResetParticle();
   void Runge_Kutta();
+  // one backward Euler step (cloth_implicit.cpp)
+  void Implicit_Euler();
+  // the stretch limits of the structural & shear springs, by XPBD
+  // (cloth_constraints.cpp)
+  void XPBD_Constraints();
+  // after the last XPBD_Constraints: the largest stretch or compression
+  // of a spring beyond its limit, relative to the rest length
+  double getConstraintViolation() const { return constraint_violation; }
 
 private:
 
   // PRIVATE ACCESSORS
-  const ClothParticle& getParticle(int i, int j) const {
-    assert (i >= 0 && i < nx && j >= 0 && j < ny);
-    return particles[i + j*nx]; }
-  ClothParticle& getParticle(int i, int j) {
+  // particle (i,j) is element i + j*nx of all the particle arrays
+  int getIndex(int i, int j) const {
     assert (i >= 0 && i < nx && j >= 0 && j < ny);
-    return particles[i + j*nx]; }
+    return i + j*nx; }
 
   Vec3f computeGouraudNormal(int i, int j) const;
 
   // HELPER FUNCTION
   void computeBoundingBox();
   void AddVBOEdge(int i1, int j1, int i2, int j2, double correction);
+  // the structural, shear & flexion springs of the grid, each once
+  void buildSprings();
+  void addSpringSet(int di, int dj, SpringType type, double k);
+  // f(begin,end) on blocks of whole rows of particles, in parallel
+  void parallelRows(const std::function<void(int,int)> &f);
+  // one evaluation of the forces in two parallel passes: the springs
+  // starting at every particle (after saving the state, if asked), then
+  // the sum on every particle, followed by then(begin,end) on its block.
+  // Every particle adds its springs in the same order whatever the
+  // blocks are, so the result does not depend on the number of threads.
+  void forcePass(bool save_state, const std::function<void(int,int)> &then);
+  void computeSpringForces(int begin, int end);
+  void gatherForces(int begin, int end);
+  // acceleration = force / mass, velocity += acceleration * dt_velocity,
+  // position += velocity * dt_position (fixed particles stay put)
+  void integrate(cloth_real dt_velocity, cloth_real dt_position, int begin, int end);
+  // remember the state in the last_ arrays
+  void saveState(int begin, int end);
+  // the Provot correction of the springs around the particles of column i
+  void correctColumn(int i);
+  // the implicit integrator (cloth_implicit.cpp)
+  void computeSpringJacobians(int begin, int end);
+  // out = -K x, K the derivative of the spring forces by the positions
+  void stiffnessProduct(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const;
+  void stiffnessProductChunk(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const;
+  // out = A x for the particles that are not fixed, 0 for the fixed ones
+  void systemProduct(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const;
+  // the dot product of a & b on every row of the block, kept in slot
+  // 0, 1 or 2 of row_sums; sumRows adds the rows up in order, so the
+  // result does not depend on the number of threads either
+  void dotRows(const ParticleVectors &a, const ParticleVectors &b, int slot, int begin, int end);
+  double sumRows(int slot) const;
+  // the XPBD constraints (cloth_constraints.cpp): one color of a spring
+  // set, on the rows of the block
+  void projectConstraints(SpringSet &set, int parity, cloth_real alpha, int begin, int end);
+  // the largest error of the constraints on the rows of the block,
+  // relative to the rest length, into row_violation
+  void measureConstraints(int begin, int end);
 
   // REPRESENTATION
   ArgParser *args;
   // grid data structure
   int nx, ny;
-  ClothParticle *particles;
   BoundingBox box;
+  // the particles
+  ParticleVectors original_position;
+  ParticleVectors position;
+  ParticleVectors velocity;
+  ParticleVectors acceleration;
+  double mass;                        // the same for all particles
+  std::vector<bool> fixed;
+  std::vector<cloth_real> inverse_mass;   // 0 for the fixed particles
   // simulation parameters
   double damping;
   // spring constants
@@ -125,7 +218,7 @@ private:
   GLuint cloth_unhappy_edge_indices_VBO;
   GLuint cloth_velocity_visualization_VBO;
   GLuint cloth_force_visualization_VBO;
-  std::vector<VBOPosNormalColor> cloth_verts; 
+  std::vector<VBOPosNormalColor> cloth_verts;
   std::vector<VBOIndexedQuad> cloth_quad_indices;
   std::vector<VBOIndexedEdge> cloth_happy_edge_indices;
   std::vector<VBOIndexedEdge> cloth_unhappy_edge_indices;
@@ -134,7 +227,33 @@ private:
 
   //ZYF ADD
   double last_maxV=0;
-  
+  ParticleVectors last_position;
+  ParticleVectors last_velocity;
+  ParticleVectors last_acceleration;
+  ParticleVectors Runge_Kutta_velocity;
+  std::vector<SpringSet> springs;
+  ParticleVectors forces;           // filled by computeForces
+  ThreadPool *pool;
+  // time spent in Animate / Runge_Kutta / Implicit_Euler
+  double step_seconds=0;
+  int num_steps=0;
+  // the implicit integrator: the velocity change of the last step (the
+  // first guess of the next solve) & the conjugate gradient vectors
+  ParticleVectors delta_velocity;
+  ParticleVectors implicit_rhs;
+  ParticleVectors inverse_diagonal;
+  ParticleVectors cg_residual;
+  ParticleVectors cg_preconditioned;
+  ParticleVectors cg_direction;
+  ParticleVectors cg_product;
+  std::vector<double> row_sums;
+  long long cg_iterations=0;
+  int implicit_steps=0;
+  // the XPBD constraints: the positions before the projection (for the
+  // velocity update) & the largest error on every row
+  ParticleVectors constraint_start;
+  std::vector<double> row_violation;
+  double constraint_violation=0;
 
 };
 
@@ -0,0 +1,109 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ================================================================================
+// A fixed set of worker threads that is started once and reused for
+// every loop of the cloth step (starting threads every step would cost
+// more than the step itself on the small grids).  run(n,f) calls f(task)
+// for every task in [0,n), on whichever thread is free next, and only
+// returns when all of them are done, so consecutive runs are separated
+// by a barrier.  The tasks must only write data that no other task of
+// the same run touches; then the result does not depend on the number
+// of threads or on which thread did which task.
+// ================================================================================
+
+class ThreadPool {
+
+public:
+  // 0 threads = one per hardware thread; the calling thread is one of them
+  explicit ThreadPool(int num_threads) {
+    if (num_threads <= 0) num_threads = std::thread::hardware_concurrency();
+    num_threads = std::max(num_threads, 1);
+    for (int i = 1; i < num_threads; i++) {
+      workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+  }
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    start_condition.notify_all();
+    for (unsigned int i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+  }
+
+  int numThreads() const { return workers.size() + 1; }
+
+  void run(int n, const std::function<void(int)> &f) {
+    if (workers.empty() || n <= 1) {
+      for (int i = 0; i < n; i++) f(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &f;
+      num_tasks = n;
+      next_task = 0;
+      busy_workers = workers.size();
+      generation++;
+    }
+    start_condition.notify_all();
+    doTasks(f, n);
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this]() { return busy_workers == 0; });
+    job = NULL;
+  }
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  void doTasks(const std::function<void(int)> &f, int n) {
+    for (int i = next_task++; i < n; i = next_task++) f(i);
+  }
+
+  void workerLoop() {
+    unsigned int seen = 0;
+    while (true) {
+      const std::function<void(int)> *f;
+      int n;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start_condition.wait(lock, [&]() { return quit || generation != seen; });
+        if (quit) return;
+        seen = generation;
+        f = job;
+        n = num_tasks;
+      }
+      doTasks(*f, n);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy_workers == 0) done_condition.notify_one();
+    }
+  }
+
+  // REPRESENTATION
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start_condition;
+  std::condition_variable done_condition;
+  const std::function<void(int)> *job = NULL;
+  int num_tasks = 0;
+  std::atomic<int> next_task{0};
+  int busy_workers = 0;
+  unsigned int generation = 0;
+  bool quit = false;
+};
+
+// ================================================================================
+
+#endif
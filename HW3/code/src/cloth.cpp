@@ -1,6 +1,8 @@
 #include "glCanvas.h"
 
 #include <fstream>
+#include <chrono>
+#include <algorithm>
 #include "cloth.h"
 #include "argparser.h"
 #include "vectors.h"
@@ -12,6 +14,7 @@
 
 Cloth::Cloth(ArgParser *_args) {
   args =_args;
+  pool = new ThreadPool(args->num_threads);
 
   // open the file
   std::ifstream istr(args->cloth_file.c_str());
@@ -51,21 +54,24 @@ Cloth::Cloth(ArgParser *_args) {
   double area = AreaOfTriangle(a,b,c) + AreaOfTriangle(a,c,d);
 
   // create the particles
-  particles = new ClothParticle[nx*ny];
-  double mass = area*fabric_weight / double(nx*ny);
+  int num_particles = nx*ny;
+  ParticleVectors *arrays[] = { &original_position, &position, &velocity, &acceleration,
+                                &last_position, &last_velocity, &last_acceleration,
+                                &Runge_Kutta_velocity, &forces };
+  for (int n = 0; n < 9; n++) {
+    arrays[n]->resize(num_particles);
+  }
+  fixed.assign(num_particles, false);
+  mass = area*fabric_weight / double(num_particles);
   for (int i = 0; i < nx; i++) {
     double x = i/double(nx-1);
     Vec3f ab = (1-x)*a + x*b;
     Vec3f dc = (1-x)*d + x*c;
     for (int j = 0; j < ny; j++) {
       double y = j/double(ny-1);
-      ClothParticle &p = getParticle(i,j);
       Vec3f abdc = (1-y)*ab + y*dc;
-      p.setOriginalPosition(abdc);
-      p.setPosition(abdc);
-      p.setVelocity(Vec3f(0,0,0));
-      p.setMass(mass);
-      p.setFixed(false);
+      original_position.set(getIndex(i,j), abdc);
+      position.set(getIndex(i,j), abdc);
     }
   }
 
@@ -75,11 +81,18 @@ Cloth::Cloth(ArgParser *_args) {
     int i,j;
     double x,y,z;
     istr >> i >> j >> x >> y >> z;
-    ClothParticle &p = getParticle(i,j);
-    p.setPosition(Vec3f(x,y,z));
-    p.setFixed(true);
+    position.set(getIndex(i,j), Vec3f(x,y,z));
+    fixed[getIndex(i,j)] = true;
+  }
+  // a fixed particle has no velocity and gets no acceleration, so the
+  // integration leaves it where it is
+  inverse_mass.resize(num_particles);
+  for (int k = 0; k < num_particles; k++) {
+    inverse_mass[k] = fixed[k] ? 0 : 1 / mass;
   }
 
+  buildSprings();
+
   computeBoundingBox();
   initializeVBOs();
   setupVBOs();
@@ -87,14 +100,89 @@ Cloth::Cloth(ArgParser *_args) {
 
 // ================================================================================
 
-void Cloth::computeBoundingBox() {
-  box = BoundingBox(getParticle(0,0).getPosition());
-  for (int i = 0; i < nx; i++) {
-    for (int j = 0; j < ny; j++) {
-      box.Extend(getParticle(i,j).getPosition());
-      box.Extend(getParticle(i,j).getOriginalPosition());
+void ParticleVectors::copy(const ParticleVectors &v, int begin, int end) {
+  for (int c = 0; c < 3; c++) {
+    std::copy(v.component(c) + begin, v.component(c) + end, component(c) + begin);
+  }
+}
+
+void ParticleVectors::assignScaled(cloth_real s, const ParticleVectors &v, int begin, int end) {
+  for (int c = 0; c < 3; c++) {
+    cloth_real *a = component(c);
+    const cloth_real *b = v.component(c);
+    for (int k = begin; k < end; k++) a[k] = s * b[k];
+  }
+}
+
+void ParticleVectors::addScaled(cloth_real s, const ParticleVectors &v, int begin, int end) {
+  for (int c = 0; c < 3; c++) {
+    cloth_real *a = component(c);
+    const cloth_real *b = v.component(c);
+    for (int k = begin; k < end; k++) a[k] += s * b[k];
+  }
+}
+
+// ================================================================================
+
+void Cloth::addSpringSet(int di, int dj, SpringType type, double k) {
+  SpringSet set;
+  set.type = type;
+  set.di = di;
+  set.dj = dj;
+  set.offset = di + dj*nx;
+  int count = nx*ny - set.offset;
+  set.rest_length.assign(count, 0);
+  set.stiffness.assign(count, 0);
+  set.force.resize(count);
+  for (int j = 0; j < ny; j++) {
+    for (int i = 0; i < nx; i++) {
+      if (i+di < 0 || i+di >= nx || j+dj < 0 || j+dj >= ny) continue;
+      int a = getIndex(i,j);
+      int b = getIndex(i+di,j+dj);
+      set.rest_length[a] = (original_position.get(a) - original_position.get(b)).Length();
+      set.stiffness[a] = k;
     }
   }
+  springs.push_back(set);
+}
+
+void Cloth::buildSprings() {
+  springs.clear();
+  // only the neighbours in +i / +j (and +j on both diagonals), so that
+  // every spring is in exactly one set
+  addSpringSet( 1, 0, STRUCTURAL_SPRING, k_structural);
+  addSpringSet( 0, 1, STRUCTURAL_SPRING, k_structural);
+  addSpringSet( 1, 1, SHEAR_SPRING, k_shear);
+  addSpringSet(-1, 1, SHEAR_SPRING, k_shear);
+  addSpringSet( 2, 0, FLEXION_SPRING, k_bend);
+  addSpringSet( 0, 2, FLEXION_SPRING, k_bend);
+}
+
+// ================================================================================
+
+void Cloth::parallelRows(const std::function<void(int,int)> &f) {
+  // a few blocks per thread, the threads that finish early take more
+  int num_blocks = (pool->numThreads() == 1) ? 1 : std::min(ny, 4 * pool->numThreads());
+  pool->run(num_blocks, [&](int b) {
+    int first_row = (long long)ny * b / num_blocks;
+    int last_row = (long long)ny * (b+1) / num_blocks;
+    f(first_row * nx, last_row * nx);
+  });
+}
+
+// ================================================================================
+
+void Cloth::computeBoundingBox() {
+  box = BoundingBox(position.get(0));
+  for (int k = 0; k < nx*ny; k++) {
+    box.Extend(position.get(k));
+    box.Extend(original_position.get(k));
+  }
+}
+
+double Cloth::getNanosecondsPerParticleStep() const {
+  if (num_steps == 0) return 0;
+  return step_seconds * 1e9 / (double(num_steps) * nx * ny);
 }
 /// <summary>
 /// ȡٶ
@@ -105,21 +193,15 @@ double Cloth::GetMaxVelocity(int type) {
     double MaxVelocity = 0;
 
     if (type == 1) {
-        for (int i = 0; i < nx; i++) {
-            for (int j = 0; j < ny; j++) {
-                ClothParticle& p = getParticle(i, j);
-                double LastV = p.getLastVelocity().Length();
-                if (MaxVelocity < LastV)MaxVelocity = LastV;
-            }
+        for (int k = 0; k < nx * ny; k++) {
+            double LastV = last_velocity.get(k).Length();
+            if (MaxVelocity < LastV)MaxVelocity = LastV;
         }
     }
     else if (type == 2) {
-        for (int i = 0; i < nx; i++) {
-            for (int j = 0; j < ny; j++) {
-                ClothParticle& p = getParticle(i, j);
-                double V = p.getVelocity().Length();
-                if (MaxVelocity < V)MaxVelocity = V;
-            }
+        for (int k = 0; k < nx * ny; k++) {
+            double V = velocity.get(k).Length();
+            if (MaxVelocity < V)MaxVelocity = V;
         }
     }
     return MaxVelocity;
@@ -128,14 +210,9 @@ double Cloth::GetMaxVelocity(int type) {
 /// ״̬
 /// </summary>
 void Cloth::ResetParticle() {
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            p.setPosition(p.getLastPosition());
-            p.setVelocity(p.getLastVelocity());
-            p.setAcceleration(p.getLastAcceleration());
-        }
-    }
+    position = last_position;
+    velocity = last_velocity;
+    acceleration = last_acceleration;
 }
 /// <summary>
 /// Ӧ
@@ -192,312 +269,247 @@ void Cloth::Animate() {
   // (position & velocity) of each particle.
   //
   // *********************************************************************    
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            p.setLastPosition(p.getPosition());
-            p.setLastVelocity(p.getVelocity());
-            p.setLastAcceleration(p.getAcceleration());
-
-            Vec3f F = computeF(p, i, j);
-
-            //²
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f velocity = p.getVelocity() + acceleration * args->timestep;
-
-                velocity = (velocity + p.getVelocity()) * 0.5;
-                acceleration = (acceleration + p.getAcceleration()) * 0.5;
-
-                Vec3f position = p.getPosition() + velocity * args->timestep;
-                p.setPosition(position);
-                p.setVelocity(velocity);
-                p.setAcceleration(acceleration);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    //²ηٶȺͼٶȡ¾ɵƽ
+    cloth_real dt = args->timestep;
+    const cloth_real* m_inv = &inverse_mass[0];
+    forcePass(true, [&](int begin, int end) {
+        for (int c = 0; c < 3; c++) {
+            cloth_real* p = position.component(c);
+            cloth_real* v = velocity.component(c);
+            cloth_real* a = acceleration.component(c);
+            const cloth_real* f = forces.component(c);
+            for (int k = begin; k < end; k++) {
+                cloth_real new_a = f[k] * m_inv[k];
+                cloth_real new_v = v[k] + new_a * dt;
+                new_v = (new_v + v[k]) * cloth_real(0.5);
+                a[k] = (new_a + a[k]) * cloth_real(0.5);
+                v[k] = new_v;
+                p[k] += new_v * dt;
             }
-
-
         }
-    }
-    if (args->isDynamicInverseConstraints)
+    });
+    if (args->isXPBDConstraints)
+        XPBD_Constraints();
+    else if (args->isDynamicInverseConstraints)
         Dynamic_Inverse_Constraints_On_Deformation_Rate();
-
-
+    step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    num_steps++;
 
   // redo VBOs for rendering
   setupVBOs();
 }
+// the force of the springs from a[k] to b[k] on a[k]: -k * (l - l0) along
+// the unit vector from b to a.  The outputs are restrict (they never
+// alias the inputs), otherwise the loop has too many pointers to check
+// for overlap and does not vectorize; the sqrt only vectorizes without
+// errno (-fno-math-errno, or any MSVC /fp mode).
+static void springForces(int count, const cloth_real* ax, const cloth_real* ay, const cloth_real* az,
+                         const cloth_real* bx, const cloth_real* by, const cloth_real* bz,
+                         const cloth_real* rest_length, const cloth_real* stiffness,
+                         cloth_real* __restrict fx, cloth_real* __restrict fy, cloth_real* __restrict fz) {
+    for (int k = 0; k < count; k++) {
+        cloth_real dx = ax[k] - bx[k];
+        cloth_real dy = ay[k] - by[k];
+        cloth_real dz = az[k] - bz[k];
+        cloth_real length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        // no branch for length 0, the direction is 0 then anyway
+        cloth_real s = -stiffness[k] * (length - rest_length[k]) / my_max(length, cloth_real(1e-12));
+        fx[k] = s * dx;
+        fy[k] = s * dy;
+        fz[k] = s * dz;
+    }
+}
+
 /// <summary>
-/// ļF
+/// ļܵᣬһһ㵯ɣ
+/// ÿֻһΣСȷ෴ؼӵˡȫһ鿪ʼʱλúٶ
 /// </summary>
-/// <param name="p"></param>
-/// <param name="i">ӶӦ</param>
-/// <param name="j">ӶӦ</param>
-/// <returns></returns>
-Vec3f Cloth::computeF(ClothParticle& p, int i, int j) {
+void Cloth::computeForces() {
+    forcePass(false, [](int, int) {});
+}
 
-    std::vector<ClothParticle> p_structural_springs;
-    std::vector<ClothParticle> p_shear_springs;
-    std::vector<ClothParticle> p_flexion_springs;
+void Cloth::forcePass(bool save_state, const std::function<void(int,int)> &then) {
+    //һ飺ÿֻдԼӳĵԼlast_״̬
+    parallelRows([&](int begin, int end) {
+        if (save_state) saveState(begin, end);
+        computeSpringForces(begin, end);
+    });
+    //ڶ飺ÿֻдԼܵĺҪĿĵ֮Ҫ߳
+    parallelRows([&](int begin, int end) {
+        gatherForces(begin, end);
+        then(begin, end);
+    });
+}
 
-    //structural springs
-    if (i + 1 >= 0 && i + 1 < nx) {
-        p_structural_springs.push_back(getParticle(i + 1, j));
-    }
-    if (i - 1 >= 0 && i - 1 < nx) {
-        p_structural_springs.push_back(getParticle(i - 1, j));
-    }
-    if (j + 1 >= 0 && j + 1 < ny) {
-        p_structural_springs.push_back(getParticle(i, j + 1));
-    }
-    if (j - 1 >= 0 && j - 1 < ny) {
-        p_structural_springs.push_back(getParticle(i, j - 1));
-    }
-    //shear springs
-    if (i + 1 >= 0 && i + 1 < nx && j + 1 >= 0 && j + 1 < ny) {
-        p_shear_springs.push_back(getParticle(i + 1, j + 1));
-    }
-    if (i + 1 >= 0 && i + 1 < nx && j - 1 >= 0 && j - 1 < ny) {
-        p_shear_springs.push_back(getParticle(i + 1, j - 1));
-    }
-    if (i - 1 >= 0 && i - 1 < nx && j + 1 >= 0 && j + 1 < ny) {
-        p_shear_springs.push_back(getParticle(i - 1, j + 1));
-    }
-    if (i - 1 >= 0 && i - 1 < nx && j - 1 >= 0 && j - 1 < ny) {
-        p_shear_springs.push_back(getParticle(i - 1, j - 1));
-    }
-    //flexion springs
-    if (i + 2 >= 0 && i + 2 < nx) {
-        p_flexion_springs.push_back(getParticle(i + 2, j));
-    }
-    if (i - 2 >= 0 && i - 2 < nx) {
-        p_flexion_springs.push_back(getParticle(i - 2, j));
-    }
-    if (j + 2 >= 0 && j + 2 < ny) {
-        p_flexion_springs.push_back(getParticle(i, j + 2));
-    }
-    if (j - 2 >= 0 && j - 2 < ny) {
-        p_flexion_springs.push_back(getParticle(i, j - 2));
+void Cloth::computeSpringForces(int begin, int end) {
+    const cloth_real* px = position.component(0);
+    const cloth_real* py = position.component(1);
+    const cloth_real* pz = position.component(2);
+    for (unsigned int n = 0; n < springs.size(); n++) {
+        SpringSet& set = springs[n];
+        int o = set.offset;
+        int last = std::min(end, nx * ny - o);
+        if (begin >= last) continue;
+        springForces(last - begin, px + begin, py + begin, pz + begin, px + begin + o, py + begin + o, pz + begin + o,
+                     &set.rest_length[begin], &set.stiffness[begin],
+                     set.force.component(0) + begin, set.force.component(1) + begin, set.force.component(2) + begin);
     }
+}
 
-    Vec3f p_position = p.getPosition();
-    Vec3f p_original_position = p.getOriginalPosition();
-    Vec3f F_structural_springs(0, 0, 0);
-    Vec3f F_shear_springs(0, 0, 0);
-    Vec3f F_flexion_springs(0, 0, 0);
-    // F_structural_springs
-    for (int e = 0; e < p_structural_springs.size(); e++) {
-        ClothParticle& p_temp = p_structural_springs[e];
-        Vec3f p_temp_position = p_temp.getPosition();
-        Vec3f p_temp_original_position = p_temp.getOriginalPosition();
-        Vec3f F_direction = p_position - p_temp_position;
-        F_direction.Normalize();
-        float original_length = (p_original_position - p_temp_original_position).Length();
-        float new_length = (p_position - p_temp_position).Length();
-        Vec3f F_p_p_temp = (-1) * k_structural * F_direction * (new_length - original_length);
-        F_structural_springs = F_structural_springs + F_p_p_temp;
+void Cloth::gatherForces(int begin, int end) {
+    for (int c = 0; c < 3; c++) {
+        cloth_real gravity = args->gravity[c] * mass;
+        const cloth_real* v = velocity.component(c);
+        cloth_real* f = forces.component(c);
+        for (int k = begin; k < end; k++) {
+            f[k] = gravity - damping * v[k];
+        }
     }
-    //F_shear_springs
-    for (int e = 0; e < p_shear_springs.size(); e++) {
-        ClothParticle& p_temp = p_shear_springs[e];
-        Vec3f p_temp_position = p_temp.getPosition();
-        Vec3f p_temp_original_position = p_temp.getOriginalPosition();
-        Vec3f F_direction = p_position - p_temp_position;
-        F_direction.Normalize();
-        float original_length = (p_original_position - p_temp_original_position).Length();
-        float new_length = (p_position - p_temp_position).Length();
-        Vec3f F_p_p_temp = (-1) * k_shear * F_direction * (new_length - original_length);
-        F_shear_springs = F_shear_springs + F_p_p_temp;
+    //ÿӰͬ˳ÿһĵɣȥĵ
+    for (unsigned int n = 0; n < springs.size(); n++) {
+        const SpringSet& set = springs[n];
+        int o = set.offset;
+        int last = std::min(end, nx * ny - o);
+        int first = std::max(begin, o);
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* sf = set.force.component(c);
+            cloth_real* f = forces.component(c);
+            for (int k = begin; k < last; k++) f[k] += sf[k];
+            for (int k = first; k < end; k++) f[k] -= sf[k - o];
+        }
     }
-    //F_flexion_springs
-    for (int e = 0; e < p_flexion_springs.size(); e++) {
-        ClothParticle& p_temp = p_flexion_springs[e];
-        Vec3f p_temp_position = p_temp.getPosition();
-        Vec3f p_temp_original_position = p_temp.getOriginalPosition();
-        Vec3f F_direction = p_position - p_temp_position;
-        F_direction.Normalize();
-        float original_length = (p_original_position - p_temp_original_position).Length();
-        float new_length = (p_position - p_temp_position).Length();
-        Vec3f F_p_p_temp = (-1) * k_bend * F_direction * (new_length - original_length);
-        F_flexion_springs = F_flexion_springs + F_p_p_temp;
+}
+
+void Cloth::integrate(cloth_real dt_velocity, cloth_real dt_position, int begin, int end) {
+    const cloth_real* m_inv = &inverse_mass[0];
+    for (int c = 0; c < 3; c++) {
+        cloth_real* p = position.component(c);
+        cloth_real* v = velocity.component(c);
+        cloth_real* a = acceleration.component(c);
+        const cloth_real* f = forces.component(c);
+        for (int k = begin; k < end; k++) {
+            a[k] = f[k] * m_inv[k];
+            v[k] += a[k] * dt_velocity;
+            p[k] += v[k] * dt_position;
+        }
     }
-    Vec3f F_gr = args->gravity * p.getMass();
-    Vec3f F_dis = (-1) * damping * p.getVelocity();
+}
 
-    Vec3f F = F_structural_springs + F_shear_springs + F_flexion_springs + F_gr + F_dis;
-    return F;
+void Cloth::saveState(int begin, int end) {
+    last_position.copy(position, begin, end);
+    last_velocity.copy(velocity, begin, end);
+    last_acceleration.copy(acceleration, begin, end);
 }
 
 /// <summary>
 /// ʳֵʱԵɽ޸
 /// </summary>
 void Cloth::Dynamic_Inverse_Constraints_On_Deformation_Rate() {
+    //iʱĵi-1i+1еӣԸепͬʱ
+    //֣ÿн̣ͬ߳߳޹
+    for (int phase = 0; phase < 3; phase++) {
+        int num_columns = (nx - phase + 2) / 3;
+        pool->run(num_columns, [&](int n) { correctColumn(phase + 3 * n); });
+    }
+}
 
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            for (int n = -1; n < 2; n++) {
-                for (int m = -1; m < 2; m++) {
-                    if (i + n < 0 || i + n >= nx || j + m < 0 || j + m >= ny || (n == 0 && m == 0)) {
-                        continue;
-                    }
-                    double correction = 0;
-                    if (abs(n) + abs(m) == 1) {//structural
-                        correction = provot_structural_correction;
+void Cloth::correctColumn(int i) {
+    for (int j = 0; j < ny; j++) {
+        int k = getIndex(i, j);
+        for (int n = -1; n < 2; n++) {
+            for (int m = -1; m < 2; m++) {
+                if (i + n < 0 || i + n >= nx || j + m < 0 || j + m >= ny || (n == 0 && m == 0)) {
+                    continue;
+                }
+                double correction = 0;
+                if (abs(n) + abs(m) == 1) {//structural
+                    correction = provot_structural_correction;
+                }
+                else if (abs(n) + abs(m) == 2) {//shear
+                    correction = provot_shear_correction;
+                }
+                int k2 = getIndex(i + n, j + m);
+                float original_length = (original_position.get(k) - original_position.get(k2)).Length();
+                float new_length = (position.get(k) - position.get(k2)).Length();
+                float defor_rate = (new_length - original_length) / original_length;
+
+                if (defor_rate > correction || defor_rate < -correction) {
+                    if (defor_rate < -correction) correction = -correction;
+
+
+                    if (fixed[k] && !fixed[k2]) {//p̶
+                        Vec3f p2_new_position = position.get(k) + (position.get(k2) - position.get(k)) * (1 + correction) * (original_length / new_length);
+                        Vec3f p2_new_velocity = (p2_new_position - last_position.get(k2)) * (1 / (p2_new_position - last_position.get(k2)).Length()) * ((1 + correction) * original_length / new_length) * velocity.get(k2).Length();
+                        // λúٶ
+                        position.set(k2, p2_new_position);
+                        velocity.set(k2, p2_new_velocity);
                     }
-                    else if (abs(n) + abs(m) == 2) {//shear
-                        correction = provot_shear_correction;
+                    else if (fixed[k2] && !fixed[k]) {//p2̶
+                        Vec3f p_new_position = position.get(k2) + (position.get(k) - position.get(k2)) * (1 + correction) * (original_length / new_length);
+                        Vec3f p_new_velocity = (p_new_position - last_position.get(k)) * (1 / (p_new_position - last_position.get(k)).Length()) * ((1 + correction) * original_length / new_length) * velocity.get(k).Length();
+                        // λúٶ
+                        position.set(k, p_new_position);
+                        velocity.set(k, p_new_velocity);
                     }
-                    ClothParticle& p2 = getParticle(i + n, j + m);
-                    float original_length = (p.getOriginalPosition() - p2.getOriginalPosition()).Length();
-                    float new_length = (p.getPosition() - p2.getPosition()).Length();
-                    float defor_rate = (new_length - original_length) / original_length;
-
-                    if (defor_rate > correction || defor_rate < -correction) {
-                        if (defor_rate < -correction) correction = -correction;
-
-
-                        if (p.isFixed() && !p2.isFixed()) {//p̶
-                            Vec3f p2_new_position = p.getPosition() + (p2.getPosition() - p.getPosition()) * (1 + correction) * (original_length / new_length);
-                            Vec3f p2_new_velocity = (p2_new_position - p2.getLastPosition()) * (1 / (p2_new_position - p2.getLastPosition()).Length()) * ((1 + correction) * original_length / new_length) * p2.getVelocity().Length();
-                            // λúٶ
-                            p2.setPosition(p2_new_position);
-                            p2.setVelocity(p2_new_velocity);
-                        }
-                        else if (p2.isFixed() && !p.isFixed()) {//p2̶
-                            Vec3f p_new_position = p2.getPosition() + (p.getPosition() - p2.getPosition()) * (1 + correction) * (original_length / new_length);
-                            Vec3f p_new_velocity = (p_new_position - p.getLastPosition()) * (1 / (p_new_position - p.getLastPosition()).Length()) * ((1 + correction) * original_length / new_length) * p.getVelocity().Length();
-                            // λúٶ
-                            p.setPosition(p_new_position);
-                            p.setVelocity(p_new_velocity);
-                        }
-                        else if (!p.isFixed() && !p2.isFixed()) {//̶
-                            Vec3f p2_new_position = p.getPosition() + (p2.getPosition() - p.getPosition()) * ((1 + correction) / 2 + (new_length / original_length) / 2) * (original_length / new_length);
-                            Vec3f p_new_position = p2.getPosition() + (p.getPosition() - p2.getPosition()) * ((1 + correction) / 2 + (new_length / original_length) / 2) * (original_length / new_length);
-                            // λúٶ
-                            p2.setPosition(p2_new_position);
-                            p.setPosition(p_new_position);
-
-                            //ٶ
-                            Vec3f p2_new_velocity = (p2_new_position - p2.getLastPosition()) * (1 / (p2_new_position - p2.getLastPosition()).Length()) * ((1 + correction) * original_length / new_length) * p2.getVelocity().Length();
-                            Vec3f p_new_velocity = (p_new_position - p.getLastPosition()) * (1 / (p_new_position - p.getLastPosition()).Length()) * ((1 + correction) * original_length / new_length) * p.getVelocity().Length();
-                            p2.setVelocity(p2_new_velocity);
-                            p.setVelocity(p_new_velocity);
-                        }
+                    else if (!fixed[k] && !fixed[k2]) {//̶
+                        Vec3f p2_new_position = position.get(k) + (position.get(k2) - position.get(k)) * ((1 + correction) / 2 + (new_length / original_length) / 2) * (original_length / new_length);
+                        Vec3f p_new_position = position.get(k2) + (position.get(k) - position.get(k2)) * ((1 + correction) / 2 + (new_length / original_length) / 2) * (original_length / new_length);
+                        // λúٶ
+                        position.set(k2, p2_new_position);
+                        position.set(k, p_new_position);
+
+                        //ٶ
+                        Vec3f p2_new_velocity = (p2_new_position - last_position.get(k2)) * (1 / (p2_new_position - last_position.get(k2)).Length()) * ((1 + correction) * original_length / new_length) * velocity.get(k2).Length();
+                        Vec3f p_new_velocity = (p_new_position - last_position.get(k)) * (1 / (p_new_position - last_position.get(k)).Length()) * ((1 + correction) * original_length / new_length) * velocity.get(k).Length();
+                        velocity.set(k2, p2_new_velocity);
+                        velocity.set(k, p_new_velocity);
                     }
                 }
             }
-
         }
-    }
 
+    }
 }
 /// <summary>
 /// ĽRunge-Kutta
 /// </summary>
 void Cloth::Runge_Kutta() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cloth_real dt = args->timestep;
     //һּ+1/6
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            p.setLastPosition(p.getPosition());
-            p.setLastVelocity(p.getVelocity());
-            p.setLastAcceleration(p.getAcceleration());
-            Vec3f F = computeF(p, i, j);
-
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f velocity = p.getVelocity() + acceleration * args->timestep * 0.5;
-                Vec3f position = p.getPosition() + velocity * args->timestep * 0.5;
-                Vec3f RKv = p.getVelocity() * 0.167 ;
-                p.setRKVelocity(RKv);
-                p.setPosition(position);
-                p.setVelocity(velocity);
-                p.setAcceleration(acceleration);
-
-            }
-        }
-    }
+    forcePass(true, [&](int begin, int end) {
+        Runge_Kutta_velocity.assignScaled(0.167, velocity, begin, end);
+        integrate(dt * 0.5, dt * 0.5, begin, end);
+    });
     //ڶּ  +1/3
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            p.setLastPosition(p.getPosition());
-            p.setLastVelocity(p.getVelocity());
-            p.setLastAcceleration(p.getAcceleration());
-            Vec3f F = computeF(p, i, j);
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f velocity = p.getVelocity() + acceleration * args->timestep * 0.5;
-                Vec3f position = p.getPosition() + velocity * args->timestep * 0.5;
-                Vec3f RKv = p.getRKVelocity()  + velocity * 0.333;
-                p.setRKVelocity(RKv);
-                p.setPosition(position);
-                p.setVelocity(velocity);
-                p.setAcceleration(acceleration);
-
-            }
-        }
-    }
+    forcePass(true, [&](int begin, int end) {
+        integrate(dt * 0.5, dt * 0.5, begin, end);
+        Runge_Kutta_velocity.addScaled(0.333, velocity, begin, end);
+    });
     //ּ  +1/3
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            Vec3f F = computeF(p, i, j);
-
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f velocity = p.getVelocity() + acceleration * args->timestep * 0.5;
-                Vec3f position = p.getPosition() + velocity * args->timestep * 0.5;
-                Vec3f RKv = p.getRKVelocity() + velocity * 0.333;
-                p.setRKVelocity(RKv);
-                p.setPosition(position);
-                p.setVelocity(velocity);
-                p.setAcceleration(acceleration);
-
-            }
-        }
-    }
+    forcePass(false, [&](int begin, int end) {
+        integrate(dt * 0.5, dt * 0.5, begin, end);
+        Runge_Kutta_velocity.addScaled(0.333, velocity, begin, end);
+    });
     //Ĳּ +1/6
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            Vec3f F = computeF(p, i, j);
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f velocity = p.getVelocity() + acceleration * args->timestep;
-                Vec3f position = p.getPosition() + velocity * args->timestep;
-                Vec3f RKv = p.getRKVelocity() + velocity * 0.167;
-                p.setRKVelocity(RKv);
-                p.setPosition(position);
-                p.setVelocity(velocity);
-                p.setAcceleration(acceleration);
-
-            }
-        }
-    }
-    //
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            ClothParticle& p = getParticle(i, j);
-            Vec3f F = computeF(p, i, j);
-            if (!p.isFixed()) {
-                double mass = p.getMass();
-                Vec3f acceleration = F * (1 / mass);
-                Vec3f position = p.getLastPosition() + p.getRKVelocity() * args->timestep;
-                p.setVelocity(p.getRKVelocity());
-                p.setPosition(position);
-                p.setAcceleration(acceleration);
-
-            }
-        }
-    }
-    if(args->isDynamicInverseConstraints)
+    forcePass(false, [&](int begin, int end) {
+        integrate(dt, dt, begin, end);
+        Runge_Kutta_velocity.addScaled(0.167, velocity, begin, end);
+    });
+    //ϣֻ¼ٶȣλúٶļȨٶȵõ̶ӼȨٶΪ0
+    forcePass(false, [&](int begin, int end) {
+        integrate(0, 0, begin, end);
+        position.copy(last_position, begin, end);
+        position.addScaled(dt, Runge_Kutta_velocity, begin, end);
+        velocity.copy(Runge_Kutta_velocity, begin, end);
+    });
+    if (args->isXPBDConstraints)
+        XPBD_Constraints();
+    else if (args->isDynamicInverseConstraints)
         Dynamic_Inverse_Constraints_On_Deformation_Rate();
+    step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    num_steps++;
     setupVBOs();
 }
 
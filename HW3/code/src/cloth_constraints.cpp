@@ -0,0 +1,144 @@
+#include "glCanvas.h"
+
+#include <algorithm>
+#include "cloth.h"
+#include "argparser.h"
+#include "vectors.h"
+#include "utils.h"
+
+// ================================================================================
+// Stretch limiting with XPBD (Macklin et al., "XPBD: Position-Based
+// Simulation of Compliant Constrained Dynamics").  Every structural &
+// shear spring must keep its length within provot_*_correction of its
+// rest length, the same limits as
+// Dynamic_Inverse_Constraints_On_Deformation_Rate.  A spring beyond its
+// limit moves its two particles (weighted by their inverse mass, so a
+// fixed particle stays put) back to the limit; with a compliance > 0 the
+// limit is soft.  The velocities change by the correction / timestep.
+//
+// A spring set only has springs from i to i+di, j to j+dj, so the
+// springs of a set that start on an even i (an even j for the (0,1)
+// set) share no particle, and neither do those that start on an odd
+// one.  The 4 sets x 2 parities are 8 colors; the springs of one color
+// are projected in parallel, in any order, and the result does not
+// depend on the number of threads.
+// ================================================================================
+
+// C of the stretch limit: how far the length is beyond [(1-limit) l0,
+// (1+limit) l0], 0 inside
+static cloth_real limitError(cloth_real length, cloth_real rest_length, cloth_real limit) {
+    cloth_real longest = rest_length * (1 + limit);
+    cloth_real shortest = rest_length * (1 - limit);
+    if (length > longest) return length - longest;
+    if (length < shortest) return length - shortest;
+    return 0;
+}
+
+static bool isConstraint(const SpringSet &set) {
+    return set.type == STRUCTURAL_SPRING || set.type == SHEAR_SPRING;
+}
+
+// ================================================================================
+
+void Cloth::projectConstraints(SpringSet &set, int parity, cloth_real alpha, int begin, int end) {
+    cloth_real limit = (set.type == STRUCTURAL_SPRING) ? provot_structural_correction : provot_shear_correction;
+    cloth_real* px = position.component(0);
+    cloth_real* py = position.component(1);
+    cloth_real* pz = position.component(2);
+    const cloth_real* m_inv = &inverse_mass[0];
+    // the (0,1) set is colored by row, the others by column
+    bool color_rows = (set.di == 0);
+    for (int j = begin / nx; j < end / nx; j++) {
+        if (j + set.dj >= ny) break;
+        if (color_rows && j % 2 != parity) continue;
+        int first_i = color_rows ? 0 : parity;
+        int step = color_rows ? 1 : 2;
+        for (int i = first_i; i < nx; i += step) {
+            if (i + set.di < 0 || i + set.di >= nx) continue;
+            int k = getIndex(i, j);
+            int k2 = k + set.offset;
+            cloth_real w = m_inv[k] + m_inv[k2];
+            if (w + alpha == 0) continue;
+            cloth_real dx = px[k] - px[k2];
+            cloth_real dy = py[k] - py[k2];
+            cloth_real dz = pz[k] - pz[k2];
+            cloth_real length = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (length < 1e-12) continue;
+            cloth_real C = limitError(length, set.rest_length[k], limit);
+            //ƷΧڵԼ
+            if (C == 0) continue;
+            cloth_real delta_lambda = (-C - alpha * set.lambda[k]) / (w + alpha);
+            set.lambda[k] += delta_lambda;
+            cloth_real s = delta_lambda / length;
+            px[k] += m_inv[k] * s * dx;
+            py[k] += m_inv[k] * s * dy;
+            pz[k] += m_inv[k] * s * dz;
+            px[k2] -= m_inv[k2] * s * dx;
+            py[k2] -= m_inv[k2] * s * dy;
+            pz[k2] -= m_inv[k2] * s * dz;
+        }
+    }
+}
+
+void Cloth::measureConstraints(int begin, int end) {
+    for (int j = begin / nx; j < end / nx; j++) {
+        double violation = 0;
+        for (unsigned int n = 0; n < springs.size(); n++) {
+            const SpringSet& set = springs[n];
+            if (!isConstraint(set) || j + set.dj >= ny) continue;
+            cloth_real limit = (set.type == STRUCTURAL_SPRING) ? provot_structural_correction : provot_shear_correction;
+            for (int i = 0; i < nx; i++) {
+                if (i + set.di < 0 || i + set.di >= nx) continue;
+                int k = getIndex(i, j);
+                cloth_real length = (position.get(k) - position.get(k + set.offset)).Length();
+                cloth_real C = limitError(length, set.rest_length[k], limit);
+                violation = std::max(violation, double(std::fabs(C) / set.rest_length[k]));
+            }
+        }
+        row_violation[j] = violation;
+    }
+}
+
+// ================================================================================
+
+/// <summary>
+/// XPBD Լ Provot һֵ 8 ɫͶӰ
+///  args->constraintIterations Σٶȼλõ/
+/// </summary>
+void Cloth::XPBD_Constraints() {
+    int num_particles = nx * ny;
+    if (constraint_start.size() != num_particles) {
+        constraint_start.resize(num_particles);
+        row_violation.assign(ny, 0);
+    }
+    for (unsigned int n = 0; n < springs.size(); n++) {
+        if (isConstraint(springs[n])) springs[n].lambda.assign(springs[n].rest_length.size(), 0);
+    }
+    cloth_real h = args->timestep;
+    cloth_real alpha = args->constraintCompliance / (h * h);
+
+    parallelRows([&](int begin, int end) {
+        constraint_start.copy(position, begin, end);
+    });
+    for (int iteration = 0; iteration < args->constraintIterations; iteration++) {
+        for (unsigned int n = 0; n < springs.size(); n++) {
+            if (!isConstraint(springs[n])) continue;
+            for (int parity = 0; parity < 2; parity++) {
+                parallelRows([&](int begin, int end) {
+                    projectConstraints(springs[n], parity, alpha, begin, end);
+                });
+            }
+        }
+    }
+    //ٶȼλõ/ͬʱͳʣµ
+    parallelRows([&](int begin, int end) {
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* p = position.component(c);
+            const cloth_real* start = constraint_start.component(c);
+            cloth_real* v = velocity.component(c);
+            for (int k = begin; k < end; k++) v[k] += (p[k] - start[k]) / h;
+        }
+        measureConstraints(begin, end);
+    });
+    constraint_violation = *std::max_element(row_violation.begin(), row_violation.end());
+}
@@ -0,0 +1,326 @@
+#include "glCanvas.h"
+
+#include <chrono>
+#include <algorithm>
+#include "cloth.h"
+#include "argparser.h"
+#include "vectors.h"
+#include "utils.h"
+
+// ================================================================================
+// Implicit (backward Euler) integration after Baraff & Witkin, "Large
+// Steps in Cloth Simulation".  With h the timestep, K = df/dx the
+// derivative of the spring forces by the positions and -damping * I that
+// of the forces by the velocities, the change of the velocities solves
+//
+//   A dv = h (f + h K v),    A = (mass + h damping) I - h^2 K
+//
+// and then v += dv, x += h v.  A is symmetric positive definite (the
+// compressed springs only keep their stiffness along the spring, see
+// computeSpringJacobians), so the system is solved with conjugate
+// gradients, preconditioned with the diagonal of A and started from the
+// dv of the previous step.  The fixed particles are kept out of the
+// solve: their rows of the residual are always 0, so their dv stays 0.
+//
+// A has one 3x3 block per spring (and on the diagonal), and the springs
+// are the same every step, so the matrix is stored as the Jacobian of
+// every spring in its SpringSet; a product with A is a gather over the
+// spring sets like gatherForces.
+// ================================================================================
+
+// the solve stops when |residual| < CG_TOLERANCE * |right hand side|,
+// or after CG_MAX_ITERATIONS
+#define CG_TOLERANCE 1e-3
+#define CG_MAX_ITERATIONS 200
+// particles per chunk of stiffnessProduct
+#define PRODUCT_CHUNK 4096
+
+// the Jacobian of the force of the springs from a[k] to b[k] on a[k], by
+// the position of a[k], negated: k (u u^T + max(0, 1 - l0/l) (I - u u^T))
+// with u the unit vector from b to a.  The I - u u^T part is dropped for
+// compressed springs, it would make A indefinite.  The outputs are
+// restrict for the same reason as in springForces.
+static void springJacobians(int count, const cloth_real* ax, const cloth_real* ay, const cloth_real* az,
+                            const cloth_real* bx, const cloth_real* by, const cloth_real* bz,
+                            const cloth_real* rest_length, const cloth_real* stiffness,
+                            cloth_real* __restrict jxx, cloth_real* __restrict jxy, cloth_real* __restrict jxz,
+                            cloth_real* __restrict jyy, cloth_real* __restrict jyz, cloth_real* __restrict jzz) {
+    for (int k = 0; k < count; k++) {
+        cloth_real dx = ax[k] - bx[k];
+        cloth_real dy = ay[k] - by[k];
+        cloth_real dz = az[k] - bz[k];
+        cloth_real length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        // no max with 1e-12 as in springForces, together with the max
+        // below that keeps the loop from vectorizing; u is 0 for length 0
+        cloth_real inverse_length = 1 / (length + cloth_real(1e-30));
+        cloth_real ux = dx * inverse_length;
+        cloth_real uy = dy * inverse_length;
+        cloth_real uz = dz * inverse_length;
+        // = (k - s) u u^T + s I
+        cloth_real s = stiffness[k] * my_max(length - rest_length[k], cloth_real(0)) * inverse_length;
+        cloth_real t = stiffness[k] - s;
+        jxx[k] = t * ux * ux + s;
+        jxy[k] = t * ux * uy;
+        jxz[k] = t * ux * uz;
+        jyy[k] = t * uy * uy + s;
+        jyz[k] = t * uy * uz;
+        jzz[k] = t * uz * uz + s;
+    }
+}
+
+// out[k] += J[k] (a[k] - b[k])
+static void addBlockProducts(int count, const cloth_real* jxx, const cloth_real* jxy, const cloth_real* jxz,
+                             const cloth_real* jyy, const cloth_real* jyz, const cloth_real* jzz,
+                             const cloth_real* ax, const cloth_real* ay, const cloth_real* az,
+                             const cloth_real* bx, const cloth_real* by, const cloth_real* bz,
+                             cloth_real* __restrict outx, cloth_real* __restrict outy, cloth_real* __restrict outz) {
+    for (int k = 0; k < count; k++) {
+        cloth_real dx = ax[k] - bx[k];
+        cloth_real dy = ay[k] - by[k];
+        cloth_real dz = az[k] - bz[k];
+        outx[k] += jxx[k] * dx + jxy[k] * dy + jxz[k] * dz;
+        outy[k] += jxy[k] * dx + jyy[k] * dy + jyz[k] * dz;
+        outz[k] += jxz[k] * dx + jyz[k] * dy + jzz[k] * dz;
+    }
+}
+
+// ================================================================================
+
+void Cloth::computeSpringJacobians(int begin, int end) {
+    const cloth_real* px = position.component(0);
+    const cloth_real* py = position.component(1);
+    const cloth_real* pz = position.component(2);
+    for (unsigned int n = 0; n < springs.size(); n++) {
+        SpringSet& set = springs[n];
+        int o = set.offset;
+        int last = std::min(end, nx * ny - o);
+        if (begin >= last) continue;
+        SymmetricBlocks& j = set.jacobian;
+        springJacobians(last - begin, px + begin, py + begin, pz + begin, px + begin + o, py + begin + o, pz + begin + o,
+                        &set.rest_length[begin], &set.stiffness[begin],
+                        &j.xx[begin], &j.xy[begin], &j.xz[begin], &j.yy[begin], &j.yz[begin], &j.zz[begin]);
+    }
+}
+
+void Cloth::stiffnessProduct(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const {
+    // in chunks, so that the Jacobians read for the springs from the
+    // particles of a chunk are still in the cache for the springs to them
+    for (int chunk = begin; chunk < end; chunk += PRODUCT_CHUNK) {
+        int chunk_end = std::min(end, chunk + PRODUCT_CHUNK);
+        stiffnessProductChunk(x, out, chunk, chunk_end);
+    }
+}
+
+void Cloth::stiffnessProductChunk(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const {
+    for (int c = 0; c < 3; c++) {
+        std::fill(out.component(c) + begin, out.component(c) + end, cloth_real(0));
+    }
+    const cloth_real* xx = x.component(0);
+    const cloth_real* xy = x.component(1);
+    const cloth_real* xz = x.component(2);
+    cloth_real* outx = out.component(0);
+    cloth_real* outy = out.component(1);
+    cloth_real* outz = out.component(2);
+    // the same order as gatherForces: the spring from k, then the one to k
+    for (unsigned int n = 0; n < springs.size(); n++) {
+        const SpringSet& set = springs[n];
+        const SymmetricBlocks& j = set.jacobian;
+        int o = set.offset;
+        int last = std::min(end, nx * ny - o);
+        if (begin < last) {
+            addBlockProducts(last - begin, &j.xx[begin], &j.xy[begin], &j.xz[begin], &j.yy[begin], &j.yz[begin], &j.zz[begin],
+                             xx + begin, xy + begin, xz + begin, xx + begin + o, xy + begin + o, xz + begin + o,
+                             outx + begin, outy + begin, outz + begin);
+        }
+        int first = std::max(begin, o);
+        if (first < end) {
+            int b = first - o;
+            addBlockProducts(end - first, &j.xx[b], &j.xy[b], &j.xz[b], &j.yy[b], &j.yz[b], &j.zz[b],
+                             xx + first, xy + first, xz + first, xx + b, xy + b, xz + b,
+                             outx + first, outy + first, outz + first);
+        }
+    }
+}
+
+void Cloth::systemProduct(const ParticleVectors &x, ParticleVectors &out, int begin, int end) const {
+    cloth_real h = args->timestep;
+    cloth_real diagonal = mass + h * damping;
+    stiffnessProduct(x, out, begin, end);
+    const cloth_real* m_inv = &inverse_mass[0];
+    for (int c = 0; c < 3; c++) {
+        const cloth_real* a = x.component(c);
+        cloth_real* y = out.component(c);
+        for (int k = begin; k < end; k++) {
+            cloth_real movable = (m_inv[k] > 0) ? 1 : 0;
+            y[k] = movable * (diagonal * a[k] + h * h * y[k]);
+        }
+    }
+}
+
+void Cloth::dotRows(const ParticleVectors &a, const ParticleVectors &b, int slot, int begin, int end) {
+    for (int row = begin / nx; row < end / nx; row++) {
+        double sum = 0;
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* u = a.component(c);
+            const cloth_real* v = b.component(c);
+            for (int k = row * nx; k < (row + 1) * nx; k++) sum += u[k] * v[k];
+        }
+        row_sums[slot * ny + row] = sum;
+    }
+}
+
+double Cloth::sumRows(int slot) const {
+    double sum = 0;
+    for (int row = 0; row < ny; row++) sum += row_sums[slot * ny + row];
+    return sum;
+}
+
+double Cloth::getAverageCGIterations() const {
+    if (implicit_steps == 0) return 0;
+    return cg_iterations / double(implicit_steps);
+}
+
+// ================================================================================
+
+/// <summary>
+/// ʽŷBaraff & Witkin A dv = h (f + h K v)ݶȷ
+/// ԽԤһ dv ֵ
+/// </summary>
+void Cloth::Implicit_Euler() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int num_particles = nx * ny;
+    if (delta_velocity.size() != num_particles) {
+        ParticleVectors *arrays[] = { &delta_velocity, &implicit_rhs, &inverse_diagonal, &cg_residual,
+                                      &cg_preconditioned, &cg_direction, &cg_product };
+        for (int n = 0; n < 7; n++) {
+            arrays[n]->resize(num_particles);
+        }
+        for (unsigned int n = 0; n < springs.size(); n++) {
+            springs[n].jacobian.resize(num_particles - springs[n].offset);
+        }
+        row_sums.assign(3 * ny, 0);
+    }
+    cloth_real h = args->timestep;
+    cloth_real diagonal = mass + h * damping;
+    const cloth_real* m_inv = &inverse_mass[0];
+
+    //ſɱȾһʼʱλ
+    parallelRows([&](int begin, int end) {
+        saveState(begin, end);
+        computeSpringForces(begin, end);
+        computeSpringJacobians(begin, end);
+    });
+    //ҶԤͳֵĲв
+    parallelRows([&](int begin, int end) {
+        gatherForces(begin, end);
+        stiffnessProduct(velocity, cg_product, begin, end);
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* f = forces.component(c);
+            const cloth_real* minus_Kv = cg_product.component(c);
+            cloth_real* b = implicit_rhs.component(c);
+            cloth_real* d = inverse_diagonal.component(c);
+            for (int k = begin; k < end; k++) {
+                cloth_real movable = (m_inv[k] > 0) ? 1 : 0;
+                b[k] = movable * h * (f[k] - h * minus_Kv[k]);
+                d[k] = 0;
+            }
+        }
+        //A ĶԽߣÿɵĿĶԽԪӵ
+        for (unsigned int n = 0; n < springs.size(); n++) {
+            const SymmetricBlocks& j = springs[n].jacobian;
+            const cloth_real* jcc[3] = { &j.xx[0], &j.yy[0], &j.zz[0] };
+            int o = springs[n].offset;
+            int last = std::min(end, num_particles - o);
+            int first = std::max(begin, o);
+            for (int c = 0; c < 3; c++) {
+                cloth_real* d = inverse_diagonal.component(c);
+                for (int k = begin; k < last; k++) d[k] += jcc[c][k];
+                for (int k = first; k < end; k++) d[k] += jcc[c][k - o];
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            cloth_real* d = inverse_diagonal.component(c);
+            for (int k = begin; k < end; k++) d[k] = 1 / (diagonal + h * h * d[k]);
+        }
+        systemProduct(delta_velocity, cg_product, begin, end);
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* b = implicit_rhs.component(c);
+            const cloth_real* q = cg_product.component(c);
+            const cloth_real* d = inverse_diagonal.component(c);
+            cloth_real* r = cg_residual.component(c);
+            cloth_real* z = cg_preconditioned.component(c);
+            cloth_real* p = cg_direction.component(c);
+            for (int k = begin; k < end; k++) {
+                r[k] = b[k] - q[k];
+                z[k] = d[k] * r[k];
+                p[k] = z[k];
+            }
+        }
+        dotRows(cg_residual, cg_preconditioned, 0, begin, end);
+        dotRows(cg_residual, cg_residual, 1, begin, end);
+        dotRows(implicit_rhs, implicit_rhs, 2, begin, end);
+    });
+    double rz = sumRows(0);
+    double rr = sumRows(1);
+    double bb = sumRows(2);
+
+    //ݶ
+    int iterations = 0;
+    while (iterations < CG_MAX_ITERATIONS && rr > CG_TOLERANCE * CG_TOLERANCE * bb) {
+        parallelRows([&](int begin, int end) {
+            systemProduct(cg_direction, cg_product, begin, end);
+            dotRows(cg_direction, cg_product, 0, begin, end);
+        });
+        double pq = sumRows(0);
+        if (pq <= 0) break;
+        cloth_real alpha = rz / pq;
+        parallelRows([&](int begin, int end) {
+            delta_velocity.addScaled(alpha, cg_direction, begin, end);
+            cg_residual.addScaled(-alpha, cg_product, begin, end);
+            for (int c = 0; c < 3; c++) {
+                const cloth_real* d = inverse_diagonal.component(c);
+                const cloth_real* r = cg_residual.component(c);
+                cloth_real* z = cg_preconditioned.component(c);
+                for (int k = begin; k < end; k++) z[k] = d[k] * r[k];
+            }
+            dotRows(cg_residual, cg_preconditioned, 0, begin, end);
+            dotRows(cg_residual, cg_residual, 1, begin, end);
+        });
+        double rz_new = sumRows(0);
+        rr = sumRows(1);
+        cloth_real beta = rz_new / rz;
+        rz = rz_new;
+        parallelRows([&](int begin, int end) {
+            for (int c = 0; c < 3; c++) {
+                const cloth_real* z = cg_preconditioned.component(c);
+                cloth_real* p = cg_direction.component(c);
+                for (int k = begin; k < end; k++) p[k] = z[k] + beta * p[k];
+            }
+        });
+        iterations++;
+    }
+    cg_iterations += iterations;
+    implicit_steps++;
+
+    //v += dv, x += h v̶ dv Ϊ0
+    parallelRows([&](int begin, int end) {
+        for (int c = 0; c < 3; c++) {
+            const cloth_real* dv = delta_velocity.component(c);
+            cloth_real* p = position.component(c);
+            cloth_real* v = velocity.component(c);
+            cloth_real* a = acceleration.component(c);
+            for (int k = begin; k < end; k++) {
+                a[k] = dv[k] / h;
+                v[k] += dv[k];
+                p[k] += v[k] * h;
+            }
+        }
+    });
+    if (args->isXPBDConstraints)
+        XPBD_Constraints();
+    else if (args->isDynamicInverseConstraints)
+        Dynamic_Inverse_Constraints_On_Deformation_Rate();
+    step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    num_steps++;
+    setupVBOs();
+}
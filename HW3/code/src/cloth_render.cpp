@@ -32,11 +32,10 @@ void Cloth::setupVBOs() {
   // mesh surface positions & normals
   for (int i = 0; i < nx; i++) {
     for (int j = 0; j < ny; j++) {
-      const ClothParticle &p = getParticle(i,j);
-      const Vec3f &pos = p.getPosition();
+      Vec3f pos = position.get(getIndex(i,j));
       Vec3f normal = computeGouraudNormal(i,j); 
       Vec3f color = Vec3f(0,0,0);
-      if (p.isFixed()) 
+      if (fixed[getIndex(i,j)]) 
 	color = Vec3f(0,1,0);
       cloth_verts.push_back(VBOPosNormalColor(pos,normal,color));
     }
@@ -67,9 +66,8 @@ void Cloth::setupVBOs() {
   // velocity & force visualization
   for (int i = 0; i < nx; i++) {
     for (int j = 0; j < ny; j++) {
-      const ClothParticle &p = getParticle(i,j);
-      const Vec3f &pos = p.getPosition();
-      const Vec3f &vel = p.getVelocity();
+      Vec3f pos = position.get(getIndex(i,j));
+      Vec3f vel = velocity.get(getIndex(i,j));
 
       float dt = args->timestep;
 
@@ -84,10 +82,9 @@ void Cloth::setupVBOs() {
       // Visualize the forces
       //
       // *********************************************************************    
-      const Vec3f& acceleration = p.getAcceleration();
-      double mass = p.getMass();
+      Vec3f acc = acceleration.get(getIndex(i,j));
       cloth_force_visualization.push_back(VBOPosColor(pos, Vec3f(0, 0, 1)));
-      cloth_force_visualization.push_back(VBOPosColor(pos + dt * 100*acceleration, Vec3f(0, 0, 1)));
+      cloth_force_visualization.push_back(VBOPosColor(pos + dt * 100*acc, Vec3f(0, 0, 1)));
 
     }
   }
@@ -252,10 +249,10 @@ void Cloth::cleanupVBOs() {
 
 void Cloth::AddVBOEdge(int i1, int j1, int i2, int j2, double correction) {
   Vec3f a_o, b_o, a, b;
-  a = getParticle(i1,j1).getPosition();
-  b = getParticle(i2,j2).getPosition();
-  a_o = getParticle(i1,j1).getOriginalPosition();
-  b_o = getParticle(i2,j2).getOriginalPosition();
+  a = position.get(getIndex(i1,j1));
+  b = position.get(getIndex(i2,j2));
+  a_o = original_position.get(getIndex(i1,j1));
+  b_o = original_position.get(getIndex(i2,j2));
   double length_o,length;
   length = (a-b).Length();
   length_o = (a_o-b_o).Length();
@@ -272,16 +269,16 @@ void Cloth::AddVBOEdge(int i1, int j1, int i2, int j2, double correction) {
 Vec3f Cloth::computeGouraudNormal(int i, int j) const {
   assert (i >= 0 && i < nx && j >= 0 && j < ny);
 
-  Vec3f pos = getParticle(i,j).getPosition();
+  Vec3f pos = position.get(getIndex(i,j));
   Vec3f north = pos;
   Vec3f south = pos;
   Vec3f east = pos;
   Vec3f west = pos;
   
-  if (i-1 >= 0) north = getParticle(i-1,j).getPosition();
-  if (i+1 < nx) south = getParticle(i+1,j).getPosition();
-  if (j-1 >= 0) east = getParticle(i,j-1).getPosition();
-  if (j+1 < ny) west = getParticle(i,j+1).getPosition();
+  if (i-1 >= 0) north = position.get(getIndex(i-1,j));
+  if (i+1 < nx) south = position.get(getIndex(i+1,j));
+  if (j-1 >= 0) east = position.get(getIndex(i,j-1));
+  if (j+1 < ny) west = position.get(getIndex(i,j+1));
 
   Vec3f vns = north - south;
   Vec3f vwe = west - east;
@@ -368,6 +368,8 @@ void GLCanvas::idle() {
                     cloth->Runge_Kutta();
                   else if (args->animateType == AnimateType::AdaptiveTimestep)
                     cloth->AdaptiveTimestep();
+                  else if (args->animateType == AnimateType::Implicit)
+                    cloth->Implicit_Euler();
               }
           }
       }
@@ -386,6 +388,8 @@ void GLCanvas::idle() {
                           cloth->Runge_Kutta();
                       else if (args->animateType == AnimateType::AdaptiveTimestep)
                           cloth->AdaptiveTimestep();
+                      else if (args->animateType == AnimateType::Implicit)
+                          cloth->Implicit_Euler();
                       num++;
                   }
               }
@@ -394,6 +398,14 @@ void GLCanvas::idle() {
                   double endtime = (double)(end_time - start_time) / CLOCKS_PER_SEC;
                   //std::cout << "1000 rounds, total time:" << endtime << std::endl;		//sΪλ
                   std::cout << "Total iterations: " << args->num << ". Total time : " << endtime * 1000 << "ms, " << endtime << "s" << std::endl;	//msΪλ
+                  if (cloth)
+                  {
+                      std::cout << "Simulation only: " << cloth->getNanosecondsPerParticleStep() << " ns per particle per step" << std::endl;
+                      if (args->animateType == AnimateType::Implicit)
+                          std::cout << "Conjugate gradient: " << cloth->getAverageCGIterations() << " iterations per step" << std::endl;
+                      if (args->isXPBDConstraints)
+                          std::cout << "XPBD constraints: " << cloth->getConstraintViolation() << " largest relative violation after the last step" << std::endl;
+                  }
                   num++;
               }
           }